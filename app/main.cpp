@@ -2,5 +2,7 @@
 #include <iostream>
 
 int main(int argc, char *argv[]) {
+  // buffered stdin, so the input can tell when a read would block
+  std::ios::sync_with_stdio(false);
   return jqcpp::run_jqcpp(argc, argv, std::cin, std::cout);
 }
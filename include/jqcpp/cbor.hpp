@@ -0,0 +1,109 @@
+#pragma once
+#include "json_value.hpp"
+#include "output_buffer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jqcpp::json {
+
+class CBORError : public std::runtime_error {
+public:
+  CBORError(const std::string &message) : std::runtime_error(message) {}
+};
+
+/**
+ * @class CBORReader
+ * @brief decode CBOR (RFC 8949) into JSONValue
+ *
+ * Integers and floats become numbers, text and byte strings become strings
+ * (byte strings keep their raw bytes), undefined becomes null. Bignums are
+ * read as numbers and the typed arrays of RFC 8746 as arrays of numbers,
+ * decoded straight from the bytes of their byte string. Other tags are
+ * dropped and their content kept. Indefinite length strings, arrays and
+ * maps are read chunk by chunk up to their break. Map keys must be strings
+ * or integers, integers are written in decimal. The open arrays and maps
+ * are kept on an explicit stack, nesting past max_depth throws CBORError.
+ */
+class CBORReader {
+public:
+  explicit CBORReader(std::size_t max_depth = kDefaultMaxDepth)
+      : max_depth_(max_depth) {}
+
+  // the initial byte and argument of an item
+  struct Head {
+    std::uint8_t major = 0;
+    std::uint8_t info = 0;
+    std::uint64_t argument = 0;
+    // additional info 31, the break code for major type 7
+    bool indefinite = false;
+  };
+
+  // decode the item at offset, offset moves past it
+  JSONValue read(std::string_view data, std::size_t &offset);
+  // the end of the item at offset without decoding it, npos if the data
+  // ends inside the item
+  static std::size_t find_end(std::string_view data, std::size_t offset);
+  // read the head at offset and move past it, false if the data ends
+  // inside the head
+  static bool read_head(std::string_view data, std::size_t &offset,
+                        Head &head);
+
+private:
+  // an open array or map, its items left unless it is indefinite, and the
+  // key of its next member
+  struct Frame {
+    bool is_map;
+    bool indefinite;
+    std::uint64_t left;
+    JSONArray array;
+    JSONObject object;
+    std::string key;
+  };
+
+  Head head();
+  bool at_break();
+  JSONValue read_value();
+  // a scalar item in value, false with its head for an array or map
+  bool read_item(JSONValue &value, Head &head);
+  JSONValue read_scalar(const Head &head);
+  JSONValue read_tagged(std::uint64_t tag);
+  JSONValue read_typed_array(std::uint64_t tag);
+  std::string read_key();
+  // the bytes of a string item with the given head, chunks are joined
+  std::string_view read_bytes(const Head &head, std::string &joined);
+  std::string_view take(std::size_t size);
+
+  std::string_view data_;
+  std::size_t pos_ = 0;
+  std::size_t max_depth_;
+  // kept across read() calls, so its memory is reused
+  std::vector<Frame> stack_;
+};
+
+/**
+ * @class CBORWriter
+ * @brief encode JSONValue as CBOR, each item in its smallest form
+ *
+ * Integral numbers which fit in 64 bits are written as integers, the other
+ * numbers as float 32 when that is exact and as float 64 otherwise. Strings
+ * which are not valid UTF-8 are written as byte strings. Containers are
+ * walked with an explicit stack, so any depth can be written.
+ */
+class CBORWriter {
+public:
+  void write(const JSONValue &value, OutputBuffer &out);
+
+private:
+  void write_scalar(const JSONValue &value, OutputBuffer &out);
+  void write_text(std::string_view text, OutputBuffer &out);
+  void write_head(std::uint8_t major, std::uint64_t argument,
+                  OutputBuffer &out);
+  void write_integer(std::int64_t value, OutputBuffer &out);
+  void write_number(double value, OutputBuffer &out);
+};
+
+} // namespace jqcpp::json
@@ -0,0 +1,53 @@
+#pragma once
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace jqcpp {
+
+enum class Compression { None, Gzip, Zstd };
+
+// "none", "gzip" or "zstd", throws std::invalid_argument otherwise
+Compression parse_compression(const std::string &name);
+// false if the format was left out of this build (zlib or zstd missing)
+bool compression_supported(Compression format);
+
+/**
+ * @brief the compression of the stream, from its first byte
+ *
+ * gzip starts with 1f 8b and zstd with 28 b5 2f fd, neither byte can start
+ * a JSON text, so one byte of lookahead is enough. Nothing is consumed.
+ */
+Compression detect_compression(std::istream &in);
+
+/**
+ * @brief wrap in with a decoder when it is compressed, nullptr otherwise
+ *
+ * The returned stream reads the decoded bytes. Decoding runs on its own
+ * thread and hands 64 KiB chunks over through an SPSC queue, so it
+ * overlaps with the parsing. Decoding errors are rethrown by the reads of
+ * the returned stream.
+ */
+std::unique_ptr<std::istream> open_decompressed(std::istream &in);
+
+/**
+ * @class CompressingOutput
+ * @brief an output stream which compresses into another stream
+ *
+ * The bytes are compressed in chunks as they are written, finish() writes
+ * the end of the compressed stream (the destructor calls it too).
+ */
+class CompressingOutput : public std::ostream {
+public:
+  CompressingOutput(std::ostream &sink, Compression format);
+  ~CompressingOutput() override;
+
+  void finish();
+
+private:
+  class Encoder;
+  std::unique_ptr<Encoder> encoder_;
+};
+
+} // namespace jqcpp
@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// x86 kernels are compiled for each level with target attributes, so one
+// binary runs on any x86 CPU
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define JQCPP_X86_DISPATCH 1
+#define JQCPP_TARGET(features) __attribute__((target(features)))
+#endif
+
+namespace jqcpp::json {
+
+// instruction set levels of the vectorized kernels, each includes the ones
+// before it
+enum class SimdLevel { Scalar, Sse2, Ssse3, Avx2, Avx512 };
+
+// the best level this CPU supports, detected once
+SimdLevel detected_simd_level();
+// the level the kernels are bound to
+SimdLevel simd_level();
+/**
+ * @brief bind the kernels to level instead of the detected one
+ *
+ * Meant for benchmarks, call it before any parsing. Throws
+ * std::invalid_argument if the CPU does not support level.
+ */
+void set_simd_level(SimdLevel level);
+// "scalar", "sse2", "ssse3", "avx2" or "avx512"
+const char *simd_level_name(SimdLevel level);
+// the level named name, false for anything else
+bool parse_simd_level(const std::string &name, SimdLevel &level);
+// the features of this CPU which the kernels look for, e.g. "sse2 avx2"
+std::string cpu_feature_names();
+
+namespace detail {
+
+// the hot kernels, one table per level
+struct SimdKernels {
+  std::size_t (*find_escape_char)(std::string_view);
+  std::size_t (*find_string_end)(std::string_view, bool &);
+  std::size_t (*find_non_ascii)(std::string_view);
+  bool (*is_utf8)(std::string_view);
+};
+
+// the table in use, starts as stubs that bind the detected level on their
+// first call
+extern std::atomic<const SimdKernels *> active_kernels;
+
+inline const SimdKernels &kernels() {
+  return *active_kernels.load(std::memory_order_acquire);
+}
+
+// fill in the kernels of each module for level
+void bind_string_kernels(SimdLevel level, SimdKernels &table);
+void bind_utf8_kernels(SimdLevel level, SimdKernels &table);
+
+} // namespace detail
+
+} // namespace jqcpp::json
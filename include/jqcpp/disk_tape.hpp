@@ -0,0 +1,49 @@
+#pragma once
+#include "mapped_file.hpp"
+#include "tape.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+
+namespace jqcpp::json {
+
+/**
+ * @class DiskTape
+ * @brief a tape built in temporary files, for inputs larger than memory
+ *
+ * The builder keeps about budget bytes of the tape in memory and spills the
+ * rest to a words file and a strings file in the temporary directory. Once
+ * the input is done both files are mapped, so the tape is paged in as it is
+ * visited and the kernel drops pages under memory pressure. The files are
+ * removed with the DiskTape.
+ */
+class DiskTape : private TapeBuilder::Spill {
+public:
+  explicit DiskTape(std::size_t budget);
+  ~DiskTape() override;
+
+  DiskTape(const DiskTape &) = delete;
+  DiskTape &operator=(const DiskTape &) = delete;
+
+  // the handler to parse the input with
+  JSONHandler &handler() { return builder_; }
+  // all input was handled, write the rest and map the files
+  const TapeView &finish();
+
+private:
+  void write(const Tape &piece) override;
+  void patch(std::size_t index, std::uint64_t word) override;
+
+  std::string words_path_;
+  std::string strings_path_;
+  std::ofstream words_;
+  std::ofstream strings_;
+  TapeBuilder builder_;
+  std::unique_ptr<MappedFile> words_file_;
+  std::unique_ptr<MappedFile> strings_file_;
+  TapeView tape_;
+};
+
+} // namespace jqcpp::json
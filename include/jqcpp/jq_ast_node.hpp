@@ -20,6 +20,9 @@ enum class ASTNodeType {
   Pipe,
   Literal,
   NumberLiteralNode,
+  ToStream,
+  FromStream,
+  TruncateStream,
 };
 
 class ASTNode {
@@ -146,10 +149,11 @@ public:
   }
 };
 
+// a number of the filter, value holds the text as written
 class LiteralNode : public ASTNode {
 public:
-  LiteralNode(double value)
-      : ASTNode(ASTNodeType::Literal, std::to_string(value)) {}
+  LiteralNode(std::string text)
+      : ASTNode(ASTNodeType::Literal, std::move(text)) {}
   json::JSONValue accept(ASTVisitor &visitor) const override {
     return visitor.visitLiteral(*this);
   }
@@ -158,13 +162,41 @@ public:
 class NumberLiteralNode : public ASTNode {
 
 public:
-  NumberLiteralNode(double value)
-      : ASTNode(ASTNodeType::NumberLiteralNode), value(value) {}
+  NumberLiteralNode(std::string text)
+      : ASTNode(ASTNodeType::NumberLiteralNode, std::move(text)) {}
   json::JSONValue accept(ASTVisitor &visitor) const override {
     return visitor.visitNumberLiteral(*this);
   }
+};
+
+// the jq --stream events of the input, collected into an array
+class ToStreamNode : public ASTNode {
+public:
+  ToStreamNode() : ASTNode(ASTNodeType::ToStream) {}
+  json::JSONValue accept(ASTVisitor &visitor) const override {
+    return visitor.visitToStream(*this);
+  }
+};
+
+// fromstream(events): the values rebuilt from an array of events
+class FromStreamNode : public ASTNode {
+public:
+  FromStreamNode(std::unique_ptr<ASTNode> events)
+      : ASTNode(ASTNodeType::FromStream, "", std::move(events)) {}
+  json::JSONValue accept(ASTVisitor &visitor) const override {
+    return visitor.visitFromStream(*this);
+  }
+};
 
-  double value;
+// events | truncate_stream(depth): the events with their first depth path
+// components removed, the input is an array of events or a single event
+class TruncateStreamNode : public ASTNode {
+public:
+  TruncateStreamNode(std::unique_ptr<ASTNode> events)
+      : ASTNode(ASTNodeType::TruncateStream, "", std::move(events)) {}
+  json::JSONValue accept(ASTVisitor &visitor) const override {
+    return visitor.visitTruncateStream(*this);
+  }
 };
 
 } // namespace jqcpp
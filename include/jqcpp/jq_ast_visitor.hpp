@@ -18,6 +18,9 @@ class KeysNode;
 class PipeNode;
 class LiteralNode;
 class NumberLiteralNode;
+class ToStreamNode;
+class FromStreamNode;
+class TruncateStreamNode;
 
 class ASTVisitor {
 public:
@@ -36,6 +39,10 @@ public:
   virtual json::JSONValue visitPipe(const PipeNode &node) = 0;
   virtual json::JSONValue visitLiteral(const LiteralNode &node) = 0;
   virtual json::JSONValue visitNumberLiteral(const NumberLiteralNode &node) = 0;
+  virtual json::JSONValue visitToStream(const ToStreamNode &node) = 0;
+  virtual json::JSONValue visitFromStream(const FromStreamNode &node) = 0;
+  virtual json::JSONValue
+  visitTruncateStream(const TruncateStreamNode &node) = 0;
 };
 
 } // namespace jqcpp
@@ -24,6 +24,10 @@ public:
   json::JSONValue visitPipe(const PipeNode &node) override;
   json::JSONValue visitLiteral(const LiteralNode &node) override;
   json::JSONValue visitNumberLiteral(const NumberLiteralNode &node) override;
+  json::JSONValue visitToStream(const ToStreamNode &node) override;
+  json::JSONValue visitFromStream(const FromStreamNode &node) override;
+  json::JSONValue
+  visitTruncateStream(const TruncateStreamNode &node) override;
 
 private:
   std::stack<const json::JSONValue *> contextStack;
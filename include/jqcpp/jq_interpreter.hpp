@@ -3,13 +3,28 @@
 #include "jq_evaluator.hpp"
 #include "jq_parser.hpp"
 #include "json_value.hpp"
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace jqcpp {
 
 int run_jqcpp(int argc, char *argv[], std::istream &input,
               std::ostream &output);
 
+// one step of the path a filter starts with, .key, .[index] or .[start:end]
+struct PathStep {
+  enum class Kind { Key, Index, Slice };
+
+  Kind kind = Kind::Key;
+  std::string key;
+  // the index, or the start of a slice
+  std::optional<double> index;
+  // the end of a slice
+  std::optional<double> end;
+};
+
 class JQInterpreter {
   std::string expr_;
 
@@ -17,13 +32,42 @@ public:
   JQInterpreter(const std::string &expr) : expr_(expr) {}
   json::JSONValue execute(const std::string &jqExpression,
                           const json::JSONValue &input);
-  json::JSONValue execute(const json::JSONValue &input) {
-    return execute(expr_, input);
-  }
+  // run the filter given to the constructor, it is only parsed once
+  json::JSONValue execute(const json::JSONValue &input);
+  // parse the filter now, so syntax errors show up before any input is read
+  void compile() { compiled(); }
+
+  // if the filter starts with .[] over its input, drop that iterator so
+  // execute() runs the rest of the filter on a single element. Only done
+  // once, later calls give the same answer.
+  bool strip_root_iterator();
+
+  // the .key and .[index] steps the filter starts with, e.g. .a[2] of
+  // .a[2].b | length, so a caller can select that part of its input itself.
+  // A slice with literal bounds can only be the last step.
+  const std::vector<PathStep> &root_path();
+  // run the rest of the filter on the value root_path() selects
+  json::JSONValue execute_after_path(const json::JSONValue &selected);
+  // the rest of the filter itself, e.g. length
+  const ASTNode &after_path();
+  // if the rest of the filter starts with .[] over its input, drop that
+  // iterator so execute_after_path() runs on a single element of the value
+  // root_path() selects. Only done once, later calls give the same answer.
+  bool iterates_after_path();
 
 private:
+  const ASTNode &compiled();
+  void split_root_path();
+
   JQParser parser;
   JQEvaluator evaluator;
+  std::unique_ptr<ASTNode> ast_;
+  // the filter without its root path
+  std::unique_ptr<ASTNode> rest_ast_;
+  std::vector<PathStep> root_path_;
+  // set by strip_root_iterator() and iterates_after_path()
+  std::optional<bool> root_iterates_;
+  std::optional<bool> rest_iterates_;
 };
 
 } // namespace jqcpp
@@ -47,6 +47,9 @@ enum class TokenType {
   RightBrace,
   Length,
   Keys,
+  ToStream,
+  FromStream,
+  TruncateStream,
   End
 };
 
@@ -91,6 +94,9 @@ private:
         {"not", TokenType::Not},
         {"length", TokenType::Length},
         {"keys", TokenType::Keys},
+        {"tostream", TokenType::ToStream},
+        {"fromstream", TokenType::FromStream},
+        {"truncate_stream", TokenType::TruncateStream},
         {"null", TokenType::Identifier}, // Treat null as a special identifier
         {"true", TokenType::Identifier}, // Treat true as a special identifier
         {"false", TokenType::Identifier} // Treat false as a special identifier
@@ -171,10 +177,12 @@ private:
         {"-", TokenType::Minus},
         {"[", TokenType::LeftBracket},
         {"]", TokenType::RightBracket},
-        {":", TokenType::Colon}
+        {":", TokenType::Colon},
+        {"|", TokenType::Pipe},
+        {"(", TokenType::LeftParen},
+        {")", TokenType::RightParen}
 
         // TODO: the following operations are not supported currently
-        // {"|", TokenType::Pipe},
         // {",", TokenType::Comma},       {"=", TokenType::Equals},
         // {";", TokenType::Semicolon},   {"?", TokenType::QuestionMark},
         // {"@", TokenType::At},          {"$", TokenType::Dollar},
@@ -27,12 +27,14 @@ private:
   std::unique_ptr<ASTNode> parseSubtraction();
   std::unique_ptr<ASTNode> parseLength();
   std::unique_ptr<ASTNode> parseKeys();
+  std::unique_ptr<ASTNode> parseCallArgument();
 
   Token peek() const;
   Token advance();
   bool match(TokenType type);
   void consume(TokenType type, const std::string &message);
   bool isAtEnd() const;
+  bool isEndOfTerm() const;
 };
 
 } // namespace jqcpp
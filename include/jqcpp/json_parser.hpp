@@ -1,25 +1,55 @@
 #pragma once
 #include "json_tokenizer.hpp"
 #include "json_value.hpp"
+#include <cstddef>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
 namespace jqcpp::json {
+
+/**
+ * @class JSONParser
+ * @brief build a JSONValue from the tokens of JSONTokenizer
+ *
+ * The open containers are kept on an explicit stack instead of the call
+ * stack, so deep nesting costs no recursion. Nesting past max_depth throws
+ * JSONParserError.
+ */
 class JSONParser {
 public:
+  explicit JSONParser(std::size_t max_depth = kDefaultMaxDepth)
+      : max_depth_(max_depth) {}
+
   JSONValue parse(const std::vector<Token> &tokens);
+  // keep numbers as their text, see NumberText
+  void set_lazy_numbers(bool lazy) { lazy_numbers_ = lazy; }
+  // true when the last parse() consumed all the tokens
+  bool finished() const { return it == end; }
 
 private:
+  // an open container, and the key of its next member for an object
+  struct Frame {
+    bool is_array;
+    JSONArray array;
+    JSONObject object;
+    std::string key;
+  };
+
   // parse methods
-  JSONValue parse_value();
-  JSONValue parse_object();
-  JSONValue parse_array();
+  void open_container(bool is_array);
+  // the key and colon of the next member of the innermost object
+  void parse_key();
   void consume(TokenType expected_type);
 
   // iterators
   std::vector<Token>::const_iterator it;
   std::vector<Token>::const_iterator end;
+
+  std::size_t max_depth_;
+  bool lazy_numbers_ = false;
+  // kept across parse() calls, so its memory is reused
+  std::vector<Frame> stack_;
 };
 
 class JSONParserError : public std::runtime_error {
@@ -0,0 +1,184 @@
+#pragma once
+#include "json_value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jqcpp::json {
+
+/**
+ * @class JSONHandler
+ * @brief receives the events of JSONSAXParser
+ *
+ * Override the events of interest, the others are ignored. The string views
+ * passed to on_key and on_string point either into the input or into a
+ * scratch buffer of the parser, they are only valid during the call.
+ *
+ * e.g. {"a": [1, true]} gives
+ *   on_start_object, on_key("a"), on_start_array, on_number_text("1"),
+ *   on_integer(1, "1"),
+ *   on_bool(true), on_end_array, on_end_object
+ */
+class JSONHandler {
+public:
+  virtual ~JSONHandler() = default;
+
+  virtual void on_start_object() {}
+  virtual void on_key(std::string_view /*key*/) {}
+  virtual void on_end_object() {}
+  virtual void on_start_array() {}
+  virtual void on_end_array() {}
+  virtual void on_string(std::string_view /*value*/) {}
+  // a number as written in the input, by default converted and passed on
+  // to on_integer or on_number
+  virtual void on_number_text(std::string_view text);
+  // text is the number as written in the input
+  virtual void on_number(double /*value*/, std::string_view /*text*/) {}
+  // a number written as an integer which fits in 64 bits, passed on as a
+  // double by default
+  virtual void on_integer(std::int64_t value, std::string_view text) {
+    on_number(static_cast<double>(value), text);
+  }
+  virtual void on_bool(bool /*value*/) {}
+  virtual void on_null() {}
+  // a top level value is complete
+  virtual void on_end_document() {}
+};
+
+/**
+ * @class JSONSAXParser
+ * @brief event driven parser working directly on the bytes
+ *
+ * No tokens and no JSONValue are built, strings without escapes are handed
+ * out as views into the input. The grammar is checked with an explicit
+ * stack of the open containers, errors are reported with the same
+ * exceptions as JSONTokenizer and JSONParser. Nesting past the max depth
+ * throws JSONParserError.
+ *
+ * In push mode the input comes in chunks of any size, e.g. from a socket.
+ * The complete tokens of a chunk are handled right away, a token split at
+ * the end of the chunk (even inside a string or an escape) is kept until
+ * the next chunk. Any number of documents may follow each other.
+ *
+ *   JSONSAXParser parser;
+ *   while (read(chunk)) {
+ *     parser.feed(chunk, handler);
+ *   }
+ *   parser.finish(handler);
+ */
+class JSONSAXParser {
+public:
+  // parse exactly one document, only whitespace may follow it
+  void parse(std::string_view text, JSONHandler &handler);
+
+  // push mode, handle the complete tokens of the next chunk
+  void feed(std::string_view chunk, JSONHandler &handler);
+  // end of the pushed input, throws if a document is incomplete
+  void finish(JSONHandler &handler);
+  // forget the pushed input
+  void reset();
+
+  // byte offset where the parser stopped, e.g. the offending byte
+  std::size_t offset() const { return consumed_ + pos_; }
+
+  void set_max_depth(std::size_t depth) { max_depth_ = depth; }
+
+private:
+  enum class State {
+    // any value
+    Value,
+    // a value or ], right after [
+    FirstValue,
+    // a key or }, right after {
+    FirstKey,
+    Key,
+    Colon,
+    // , or the end of the current container
+    CommaOrEnd,
+    // the document is complete
+    Done
+  };
+
+  void step(JSONHandler &handler);
+  void parse_value(JSONHandler &handler);
+  void end_container(JSONHandler &handler);
+  void value_done(JSONHandler &handler);
+  // push mode helpers
+  void scan_available(JSONHandler &handler, bool final);
+  bool token_complete();
+  bool idle() const {
+    return stack_.empty() && (state_ == State::Value || state_ == State::Done);
+  }
+
+  void skip_whitespace();
+  std::string_view scan_string();
+  std::string_view scan_number();
+  void scan_literal(std::string_view literal);
+
+  std::string_view text_;
+  std::size_t pos_ = 0;
+  State state_ = State::Value;
+  // open containers, true for arrays
+  std::vector<bool> stack_;
+  std::size_t max_depth_ = kDefaultMaxDepth;
+  // decoded strings with escapes
+  std::string scratch_;
+
+  // push mode: the unconsumed tail of the previous chunks
+  std::string pending_;
+  // bytes dropped before text_
+  std::size_t consumed_ = 0;
+  // absolute offset up to which a split string was checked
+  std::size_t string_checked_ = 0;
+};
+
+/**
+ * @class JSONValueBuilder
+ * @brief handler building a JSONValue from the events
+ *
+ * With a callback each document is handed over as soon as it is complete,
+ * otherwise the last document is kept for take().
+ */
+class JSONValueBuilder : public JSONHandler {
+public:
+  using DocumentCallback = std::function<void(JSONValue)>;
+
+  JSONValueBuilder() = default;
+  explicit JSONValueBuilder(DocumentCallback on_document);
+
+  void on_start_object() override;
+  void on_key(std::string_view key) override;
+  void on_end_object() override;
+  void on_start_array() override;
+  void on_end_array() override;
+  void on_string(std::string_view value) override;
+  void on_number(double value, std::string_view text) override;
+  void on_integer(std::int64_t value, std::string_view text) override;
+  void on_number_text(std::string_view text) override;
+  void on_bool(bool value) override;
+  void on_null() override;
+
+  // keep numbers as their text, see NumberText
+  void set_lazy_numbers(bool lazy) { lazy_numbers_ = lazy; }
+
+  // true once a whole document was built
+  bool has_value() const { return has_value_; }
+  // hand over the document and get ready for the next one
+  JSONValue take();
+
+private:
+  void add(JSONValue value);
+  void end_container();
+
+  DocumentCallback on_document_;
+  std::vector<JSONValue> stack_;
+  std::vector<std::string> keys_;
+  JSONValue value_;
+  bool has_value_ = false;
+  bool lazy_numbers_ = false;
+};
+
+} // namespace jqcpp::json
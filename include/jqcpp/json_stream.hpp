@@ -0,0 +1,161 @@
+#pragma once
+#include "json_parser.hpp"
+#include "json_sax.hpp"
+#include "json_tokenizer.hpp"
+#include "json_value.hpp"
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace jqcpp::json {
+
+/**
+ * @class JSONArrayStream
+ * @brief read the elements of a top level array one at a time
+ *
+ * The input is read in chunks and only the text of the current element is
+ * kept, so peak memory is one element instead of the whole array.
+ *
+ * e.g.
+ *   JSONArrayStream stream(std::cin);
+ *   if (stream.open()) {
+ *     JSONValue element;
+ *     while (stream.next(element)) { ... }
+ *   }
+ */
+class JSONArrayStream {
+public:
+  // max_depth counts the top level array, as for ParallelJSONParser
+  explicit JSONArrayStream(std::istream &input,
+                           std::size_t chunk_size = 64 * 1024,
+                           std::size_t max_depth = kDefaultMaxDepth);
+
+  // skip the leading whitespace, true if the input is an array
+  bool open();
+  // parse the next element, false after the end of the array. Anything
+  // but whitespace after the closing bracket throws JSONParserError.
+  bool next(JSONValue &element);
+  // the unread input, for documents which are not arrays
+  std::string remaining();
+  // keep numbers as their text, see NumberText
+  void set_lazy_numbers(bool lazy) { parser_.set_lazy_numbers(lazy); }
+
+private:
+  bool fill();
+  JSONValue parse_element();
+  void check_end();
+
+  std::istream &input_;
+  std::size_t chunk_size_;
+  std::string buffer_;
+  std::size_t pos_ = 0;
+  // text of the element being scanned
+  std::string element_;
+
+  // scanner state, kept across chunks
+  std::size_t depth_ = 0;
+  bool in_string_ = false;
+  bool escaped_ = false;
+  bool finished_ = false;
+  std::size_t count_ = 0;
+
+  JSONTokenizer tokenizer_;
+  JSONParser parser_;
+};
+
+/**
+ * @class StreamEventBuilder
+ * @brief turn a document into jq --stream events
+ *
+ * Each leaf gives a [path, leaf] event and each non empty container is
+ * closed by a [path] event holding the path of its last child, e.g.
+ * {"a":[1,2]} gives [["a",0],1], [["a",1],2], [["a",1]], [["a"]].
+ * Empty containers are leaves.
+ *
+ * The events can be driven by the tokens of the JSON tokenizer or by a
+ * JSONSAXParser, so no DOM is built for the input, or by walking an
+ * existing value (tostream).
+ */
+class StreamEventBuilder : public JSONHandler {
+public:
+  using EventCallback = std::function<void(JSONValue)>;
+
+  explicit StreamEventBuilder(EventCallback on_event);
+
+  // feed the next token of the input
+  void on_token(const Token &token);
+
+  // JSONHandler events
+  void on_start_object() override { start_container(false); }
+  void on_key(std::string_view key) override;
+  void on_end_object() override { end_container(false); }
+  void on_start_array() override { start_container(true); }
+  void on_end_array() override { end_container(true); }
+  void on_string(std::string_view value) override {
+    leaf(JSONValue(std::string(value)));
+  }
+  void on_number(double value, std::string_view) override {
+    leaf(JSONValue(value));
+  }
+  void on_integer(std::int64_t value, std::string_view) override {
+    leaf(JSONValue(value));
+  }
+  void on_bool(bool value) override { leaf(JSONValue(value)); }
+  void on_null() override { leaf(JSONValue(nullptr)); }
+
+  // emit the events of a whole value
+  void on_value(const JSONValue &value);
+  // true when no container is open
+  bool complete() const { return frames_.empty(); }
+
+private:
+  struct Frame {
+    bool is_array;
+    // index of the current element of an array
+    std::size_t index = 0;
+    // current key of an object
+    std::string key;
+    bool has_items = false;
+    bool expect_key = false;
+  };
+
+  void start_container(bool is_array);
+  void end_container(bool is_array);
+  void leaf(JSONValue value);
+  void value_done();
+  JSONArray current_path() const;
+
+  EventCallback on_event_;
+  std::vector<Frame> frames_;
+};
+
+/**
+ * @class StreamValueBuilder
+ * @brief rebuild values from jq --stream events (fromstream)
+ *
+ * A value is complete at a [[], leaf] event or at a closing event of
+ * length 1, same as jq's fromstream.
+ */
+class StreamValueBuilder {
+public:
+  // feed the next event, returns true and sets value when a top level
+  // value is complete
+  bool add(const JSONValue &event, JSONValue &value);
+
+private:
+  JSONValue current_;
+  bool has_current_ = false;
+};
+
+// true if value looks like one event: [path, leaf] or [path]
+bool is_stream_event(const JSONValue &value);
+
+/**
+ * @brief drop the first depth path components of the events, events at
+ * or above that depth are removed (truncate_stream)
+ */
+JSONArray truncate_stream_events(const JSONArray &events, std::size_t depth);
+
+} // namespace jqcpp::json
@@ -1,6 +1,8 @@
 #pragma once
+#include <functional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 namespace jqcpp::json {
 
@@ -27,11 +29,16 @@ struct Token {
 
 class JSONTokenizer {
 public:
-  std::vector<Token> tokenize(const std::string &json_string);
+  using TokenCallback = std::function<void(const Token &)>;
+
+  std::vector<Token> tokenize(std::string_view json_string);
+  // SAX style: hand each token to the callback as soon as it is scanned,
+  // nothing is collected
+  void tokenize(std::string_view json_string, const TokenCallback &on_token);
 
 private:
-  std::string::const_iterator it;
-  std::string::const_iterator end;
+  std::string_view::const_iterator it;
+  std::string_view::const_iterator end;
 
   Token next_token();
   Token parse_string();
@@ -43,9 +50,6 @@ private:
   char peek() const { return (it != end) ? *it : '\0'; }
   char get() { return (it != end) ? *it++ : '\0'; }
   bool is_digit(char c) const { return c >= '0' && c <= '9'; }
-  bool is_hex_digit(char c) const {
-    return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
-  }
 };
 
 class JSONTokenizerError : public std::runtime_error {
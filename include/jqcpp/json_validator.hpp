@@ -0,0 +1,36 @@
+#pragma once
+#include "json_value.hpp"
+#include <cstddef>
+#include <string_view>
+
+namespace jqcpp::json {
+
+// outcome of validate_json
+struct ValidationResult {
+  bool valid = true;
+  // byte offset of the first error, the size of the input when valid
+  std::size_t offset = 0;
+  // what is wrong at offset, a static string, nullptr when valid
+  const char *message = nullptr;
+  // top level values in the input
+  std::size_t documents = 0;
+};
+
+/**
+ * @brief check that text is a sequence of JSON values, as read by jqcpp,
+ * without building them
+ *
+ * Structure, numbers and escapes follow RFC 8259: strings must not hold
+ * control characters and must be valid UTF-8, values nested deeper than
+ * max_depth are rejected. Nothing is allocated unless max_depth is larger
+ * than the default, strings are scanned with find_escape_char and the
+ * text checked with is_utf8. Top level values may follow each other, like
+ * the input of the CLI; check documents == 1 to accept exactly one. A top
+ * level number or literal must be followed by whitespace, so 01 or 1true
+ * are rejected instead of read as two values, while [1][2] or "a"1 are
+ * two. An empty text is valid with no documents.
+ */
+ValidationResult validate_json(std::string_view text,
+                               std::size_t max_depth = kDefaultMaxDepth);
+
+} // namespace jqcpp::json
@@ -1,6 +1,10 @@
 #pragma once
+#include "number_format.hpp"
 #include <algorithm>
+#include <charconv>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -18,17 +22,30 @@ using JSONObject = std::vector<std::pair<std::string, JSONValue>>;
 inline void jsonObjectInsert(JSONObject &obj, const std::string &key,
                              JSONValue v);
 
+// the deepest nesting of arrays and objects the parsers accept by default
+constexpr std::size_t kDefaultMaxDepth = 10000;
+
+// a number kept as written in the input, it is only converted when its value
+// is needed and printed back unchanged
+struct NumberText {
+  std::string text;
+};
+
 struct JSONValue {
-  std::variant<std::string, double, bool, std::nullptr_t,
-               std::unique_ptr<JSONArray>, std::unique_ptr<JSONObject>>
+  // integers which fit in 64 bits are kept exact, other numbers are doubles
+  std::variant<std::string, double, std::int64_t, bool, std::nullptr_t,
+               std::unique_ptr<JSONArray>, std::unique_ptr<JSONObject>,
+               NumberText>
       value;
 
   // constructors
   JSONValue() : value(nullptr) {}
   JSONValue(std::string v) : value(std::move(v)) {}
   JSONValue(double v) : value(v) {}
+  JSONValue(std::int64_t v) : value(v) {}
+  JSONValue(NumberText v) : value(std::move(v)) {}
   JSONValue(bool v) : value(v) {}
-  JSONValue(std::nullptr_t v) : value(nullptr) {}
+  JSONValue(std::nullptr_t) : value(nullptr) {}
   JSONValue(JSONArray v) : value(std::make_unique<JSONArray>(std::move(v))) {}
   JSONValue(JSONObject v) : value(std::make_unique<JSONObject>(std::move(v))) {}
 
@@ -40,11 +57,23 @@ struct JSONValue {
   JSONValue(JSONValue &&other) noexcept = default;
   JSONValue &operator=(JSONValue &&) = default;
 
+  ~JSONValue();
+
   // helper functions for type checker
   // these functions are helpful in testing
   bool is_bool() const { return std::holds_alternative<bool>(value); }
-  // all the numbers are converted to double
-  bool is_number() const { return std::holds_alternative<double>(value); }
+  // a double, an integer or a number kept as text
+  bool is_number() const {
+    return std::holds_alternative<double>(value) ||
+           std::holds_alternative<std::int64_t>(value) ||
+           std::holds_alternative<NumberText>(value);
+  }
+  bool is_integer() const {
+    return std::holds_alternative<std::int64_t>(value);
+  }
+  bool is_number_text() const {
+    return std::holds_alternative<NumberText>(value);
+  }
   bool is_string() const { return std::holds_alternative<std::string>(value); }
   // null
   bool is_null() const { return std::holds_alternative<std::nullptr_t>(value); }
@@ -60,7 +89,42 @@ struct JSONValue {
   // array
   // getters
   bool get_bool() const { return std::get<bool>(value); }
-  double get_number() const { return std::get<double>(value); }
+  // integers and numbers kept as text are converted
+  double get_number() const {
+    if (const auto *integer = std::get_if<std::int64_t>(&value)) {
+      return static_cast<double>(*integer);
+    }
+    if (const auto *number = std::get_if<NumberText>(&value)) {
+      const std::string &text = number->text;
+      double result = 0;
+      auto [ptr, ec] =
+          std::from_chars(text.data(), text.data() + text.size(), result);
+      if (ec != std::errc()) {
+        throw std::runtime_error("Number out of range");
+      }
+      return result;
+    }
+    return std::get<double>(value);
+  }
+  std::int64_t get_integer() const { return std::get<std::int64_t>(value); }
+  const std::string &get_number_text() const {
+    return std::get<NumberText>(value).text;
+  }
+  // the number as an integer or a double, numbers kept as text are
+  // converted
+  JSONValue number_value() const {
+    if (is_number_text()) {
+      std::int64_t integer;
+      if (parse_integer(get_number_text(), integer)) {
+        return JSONValue(integer);
+      }
+      return JSONValue(get_number());
+    }
+    if (is_integer()) {
+      return JSONValue(get_integer());
+    }
+    return JSONValue(get_number());
+  }
   const std::string &get_string() const { return std::get<std::string>(value); }
   const JSONObject &get_object() const {
     if (!is_object()) {
@@ -79,24 +143,18 @@ struct JSONValue {
   JSONValue deepCopy() const {
     if (is_string()) {
       return JSONValue(get_string());
+    } else if (is_integer()) {
+      return JSONValue(get_integer());
+    } else if (is_number_text()) {
+      return JSONValue(NumberText{get_number_text()});
     } else if (is_number()) {
       return JSONValue(get_number());
     } else if (is_bool()) {
       return JSONValue(get_bool());
     } else if (is_null()) {
       return JSONValue();
-    } else if (is_array()) {
-      JSONArray new_array;
-      for (const auto &elem : get_array()) {
-        new_array.push_back(elem.deepCopy());
-      }
-      return JSONValue(std::move(new_array));
-    } else if (is_object()) {
-      JSONObject new_object;
-      for (const auto &[key, value] : get_object()) {
-        jsonObjectInsert(new_object, key, value.deepCopy());
-      }
-      return JSONValue(std::move(new_object));
+    } else if (is_array() || is_object()) {
+      return copy_container();
     }
     throw std::runtime_error("Unknown JSONValue type in deepCopy");
   }
@@ -104,8 +162,94 @@ struct JSONValue {
   // override operations
   const JSONValue &operator[](std::size_t index) const;
   const JSONValue &operator[](const std::string &index) const;
+
+private:
+  JSONValue copy_container() const;
 };
 
+// move the arrays and objects among the children of value to pending
+inline void detach_containers(JSONValue &value,
+                              std::vector<JSONValue> &pending) {
+  auto detach = [&pending](JSONValue &child) {
+    if (child.is_array() || child.is_object()) {
+      pending.push_back(std::move(child));
+      child.value = nullptr;
+    }
+  };
+  if (auto *array = std::get_if<std::unique_ptr<JSONArray>>(&value.value)) {
+    if (*array) {
+      for (auto &child : **array) {
+        detach(child);
+      }
+    }
+  } else if (auto *object =
+                 std::get_if<std::unique_ptr<JSONObject>>(&value.value)) {
+    if (*object) {
+      for (auto &member : **object) {
+        detach(member.second);
+      }
+    }
+  }
+}
+
+// deep values are taken apart level by level with a stack, destroying them
+// recursively could overflow the call stack
+inline JSONValue::~JSONValue() {
+  std::vector<JSONValue> pending;
+  detach_containers(*this, pending);
+  while (!pending.empty()) {
+    JSONValue next = std::move(pending.back());
+    pending.pop_back();
+    detach_containers(next, pending);
+  }
+}
+
+// the copy of an array or object, built with a stack like the destructor
+inline JSONValue JSONValue::copy_container() const {
+  auto copy_child = [](const JSONValue &child) {
+    if (child.is_array()) {
+      return JSONValue(JSONArray());
+    }
+    if (child.is_object()) {
+      return JSONValue(JSONObject());
+    }
+    return child.deepCopy();
+  };
+  JSONValue root = copy_child(*this);
+  // containers whose children are not copied yet, and their copy
+  std::vector<std::pair<const JSONValue *, JSONValue *>> pending = {
+      {this, &root}};
+  while (!pending.empty()) {
+    auto [source, copy] = pending.back();
+    pending.pop_back();
+    // the copies are reserved up front, so the pointers to their children
+    // stay valid
+    if (source->is_array()) {
+      const auto &from = source->get_array();
+      auto &to = *std::get<std::unique_ptr<JSONArray>>(copy->value);
+      to.reserve(from.size());
+      for (const auto &child : from) {
+        to.push_back(copy_child(child));
+        if (child.is_array() || child.is_object()) {
+          pending.emplace_back(&child, &to.back());
+        }
+      }
+    } else {
+      const auto &from = source->get_object();
+      auto &to = *std::get<std::unique_ptr<JSONObject>>(copy->value);
+      to.reserve(from.size());
+      // the keys of an object are unique already
+      for (const auto &[key, child] : from) {
+        to.emplace_back(key, copy_child(child));
+        if (child.is_array() || child.is_object()) {
+          pending.emplace_back(&child, &to.back().second);
+        }
+      }
+    }
+  }
+  return root;
+}
+
 inline void jsonObjectInsert(JSONObject &obj, const std::string &key,
                              JSONValue v) {
   auto it = std::find_if(obj.begin(), obj.end(), [&key](const auto &pair) {
@@ -119,10 +263,52 @@ inline void jsonObjectInsert(JSONObject &obj, const std::string &key,
   }
 }
 
+// an unsigned integer, a double past the range of int64
+inline JSONValue unsigned_number(std::uint64_t value) {
+  if (value <= static_cast<std::uint64_t>(
+                   std::numeric_limits<std::int64_t>::max())) {
+    return JSONValue(static_cast<std::int64_t>(value));
+  }
+  return JSONValue(static_cast<double>(value));
+}
+
+// the sum of two numbers, exact for integers unless it overflows 64 bits,
+// then it is a double like any other mix
+inline JSONValue add_numbers(const JSONValue &lhs, const JSONValue &rhs) {
+  if (lhs.is_number_text() || rhs.is_number_text()) {
+    return add_numbers(lhs.number_value(), rhs.number_value());
+  }
+  if (lhs.is_integer() && rhs.is_integer()) {
+    std::int64_t a = lhs.get_integer();
+    std::int64_t b = rhs.get_integer();
+    if (b >= 0 ? a <= std::numeric_limits<std::int64_t>::max() - b
+               : a >= std::numeric_limits<std::int64_t>::min() - b) {
+      return JSONValue(a + b);
+    }
+  }
+  return JSONValue(lhs.get_number() + rhs.get_number());
+}
+
+// the difference of two numbers, see add_numbers
+inline JSONValue subtract_numbers(const JSONValue &lhs, const JSONValue &rhs) {
+  if (lhs.is_number_text() || rhs.is_number_text()) {
+    return subtract_numbers(lhs.number_value(), rhs.number_value());
+  }
+  if (lhs.is_integer() && rhs.is_integer()) {
+    std::int64_t a = lhs.get_integer();
+    std::int64_t b = rhs.get_integer();
+    if (b >= 0 ? a >= std::numeric_limits<std::int64_t>::min() + b
+               : a <= std::numeric_limits<std::int64_t>::max() + b) {
+      return JSONValue(a - b);
+    }
+  }
+  return JSONValue(lhs.get_number() - rhs.get_number());
+}
+
 // Addition Operator
 inline JSONValue operator+(const JSONValue &lhs, const JSONValue &rhs) {
   if (lhs.is_number() && rhs.is_number()) {
-    return JSONValue(lhs.get_number() + rhs.get_number());
+    return add_numbers(lhs, rhs);
   }
   if (lhs.is_string() && rhs.is_string()) {
     return JSONValue(lhs.get_string() + rhs.get_string());
@@ -133,7 +319,7 @@ inline JSONValue operator+(const JSONValue &lhs, const JSONValue &rhs) {
 // Subtraction Operator
 inline JSONValue operator-(const JSONValue &lhs, const JSONValue &rhs) {
   if (lhs.is_number() && rhs.is_number()) {
-    return JSONValue(lhs.get_number() - rhs.get_number());
+    return subtract_numbers(lhs, rhs);
   }
   if (lhs.is_string() && rhs.is_string()) {
     const std::string &lhs_str = lhs.get_string();
@@ -174,7 +360,7 @@ inline JSONArray keys(const JSONValue &json) {
   }
   if (json.is_array()) {
     for (std::size_t i = 0; i < json.get_array().size(); ++i) {
-      result.push_back(JSONValue(static_cast<double>(i)));
+      result.push_back(JSONValue(static_cast<std::int64_t>(i)));
     }
     return result;
   }
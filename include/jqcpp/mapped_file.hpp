@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jqcpp {
+
+/**
+ * @class MappedFile
+ * @brief the bytes of a file, mapped read only where mmap is available
+ *
+ * Mapping takes the same time whatever the size of the file and its pages
+ * are only read when they are touched. Without mmap the file is read into
+ * memory. The data is 8 byte aligned either way.
+ */
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return data_; }
+  std::size_t size() const { return size_; }
+  std::string_view view() const { return {data_, size_}; }
+
+private:
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+  void *mapping_ = nullptr;
+  std::vector<std::uint64_t> buffer_;
+};
+
+} // namespace jqcpp
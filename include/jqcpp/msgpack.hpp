@@ -0,0 +1,89 @@
+#pragma once
+#include "json_value.hpp"
+#include "output_buffer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jqcpp::json {
+
+class MsgPackError : public std::runtime_error {
+public:
+  MsgPackError(const std::string &message) : std::runtime_error(message) {}
+};
+
+/**
+ * @class MsgPackReader
+ * @brief decode MessagePack into JSONValue
+ *
+ * Integers and floats become numbers, str and bin become strings (bin keeps
+ * its raw bytes), the timestamp extension becomes seconds since the epoch.
+ * Map keys must be strings or integers, integers are written in decimal.
+ * Other extension types are rejected. The open arrays and maps are kept on
+ * an explicit stack, nesting past max_depth throws MsgPackError.
+ */
+class MsgPackReader {
+public:
+  explicit MsgPackReader(std::size_t max_depth = kDefaultMaxDepth)
+      : max_depth_(max_depth) {}
+
+  // decode the value at offset, offset moves past it
+  JSONValue read(std::string_view data, std::size_t &offset);
+  // the end of the value at offset without decoding it, npos if the data
+  // ends inside the value
+  static std::size_t find_end(std::string_view data, std::size_t offset);
+
+private:
+  // an open array or map, its items left and the key of its next member
+  struct Frame {
+    bool is_map;
+    std::size_t left;
+    JSONArray array;
+    JSONObject object;
+    std::string key;
+  };
+
+  JSONValue read_value();
+  // true with the item count if tag starts an array or map
+  bool read_container(std::uint8_t tag, bool &is_map, std::size_t &count);
+  JSONValue read_scalar(std::uint8_t tag);
+  std::string_view take(std::size_t size);
+  std::uint64_t read_uint(std::size_t size);
+  std::string read_key();
+
+  std::string_view data_;
+  std::size_t pos_ = 0;
+  std::size_t max_depth_;
+  // kept across read() calls, so its memory is reused
+  std::vector<Frame> stack_;
+};
+
+/**
+ * @class MsgPackWriter
+ * @brief encode JSONValue as MessagePack, each value in its smallest form
+ *
+ * Integral numbers which fit in 64 bits are written as integers, the other
+ * numbers as float 64. Containers are walked with an explicit stack, so
+ * any depth can be written.
+ */
+class MsgPackWriter {
+public:
+  void write(const JSONValue &value, OutputBuffer &out);
+
+private:
+  void write_scalar(const JSONValue &value, OutputBuffer &out);
+  void write_header(std::uint8_t tag, std::uint64_t value, std::size_t size,
+                    OutputBuffer &out);
+  void write_length(std::size_t length, std::uint8_t fix_tag,
+                    std::size_t fix_limit, std::uint8_t tag8,
+                    std::uint8_t tag16, std::uint8_t tag32, OutputBuffer &out);
+  void write_string(std::string_view value, OutputBuffer &out);
+  void write_unsigned(std::uint64_t value, OutputBuffer &out);
+  void write_integer(std::int64_t value, OutputBuffer &out);
+  void write_number(double value, OutputBuffer &out);
+};
+
+} // namespace jqcpp::json
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace jqcpp::json {
+
+// large enough for any output of format_number
+constexpr std::size_t kNumberBufferSize = 32;
+
+/**
+ * @brief format a number as the shortest text that reads back to the same
+ * double
+ *
+ * Integral values below 1e17 take an integer fast path and are printed
+ * without exponent. NaN is printed as null and infinities are clamped to
+ * the largest finite double, like jq does.
+ *
+ * @param value
+ * @param buffer at least kNumberBufferSize chars
+ * @return the number of chars written
+ */
+std::size_t format_number(double value, char *buffer);
+
+/**
+ * @brief read a JSON number which is written as an integer, e.g. 42 or -7
+ *
+ * False for fractions, exponents, -0 and integers past the range of int64,
+ * those are read as doubles.
+ */
+bool parse_integer(std::string_view text, std::int64_t &value);
+
+} // namespace jqcpp::json
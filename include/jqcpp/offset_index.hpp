@@ -0,0 +1,62 @@
+#pragma once
+#include "json_value.hpp"
+#include "mapped_file.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace jqcpp::json {
+
+// the sidecar index of a JSON file, next to it
+std::string offset_index_path(const std::string &source);
+
+/**
+ * @brief index the elements of the top level array, or the members of the
+ * top level object, of a JSON text
+ *
+ * The whole text is validated first, without building any values, so no
+ * index is written for invalid JSON. source_time is stored to notice later
+ * changes of the source.
+ */
+void build_offset_index(std::string_view text, std::int64_t source_time,
+                        std::ostream &out,
+                        std::size_t max_depth = kDefaultMaxDepth);
+
+/**
+ * @class OffsetIndex
+ * @brief a mapped sidecar index: the byte range of each top level element
+ * or member of a JSON file, and the key of each member
+ */
+class OffsetIndex {
+public:
+  explicit OffsetIndex(const std::string &path);
+
+  // false if the source changed since the index was built
+  bool matches(std::uint64_t source_size, std::int64_t source_time) const;
+
+  bool is_array() const { return is_array_; }
+  std::size_t size() const { return count_; }
+  // the text of element or member i within the source text
+  std::string_view value(std::string_view source, std::size_t i) const;
+  std::string_view key(std::size_t i) const;
+  // the last member named key
+  std::optional<std::size_t> find(std::string_view key) const;
+
+private:
+  std::uint64_t entry(std::size_t i, std::size_t field) const;
+
+  MappedFile file_;
+  bool is_array_ = true;
+  std::size_t count_ = 0;
+  std::uint64_t source_size_ = 0;
+  std::int64_t source_time_ = 0;
+  // start and end offsets, for members also the key offset and length
+  const std::uint64_t *entries_ = nullptr;
+  std::size_t entry_words_ = 2;
+  std::string_view keys_;
+};
+
+} // namespace jqcpp::json
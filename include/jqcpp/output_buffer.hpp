@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace jqcpp::json {
+
+/**
+ * @class OutputBuffer
+ * @brief a growable byte buffer the printers append into
+ *
+ * Without a sink the buffer just accumulates the whole output. When bound to
+ * a stream, the printers call maybe_flush() at value boundaries and the
+ * buffer is handed to the stream in large chunks once it passes the chunk
+ * size, so the stream never sees small writes.
+ */
+class OutputBuffer {
+public:
+  static constexpr std::size_t kDefaultChunkSize = 64 * 1024;
+
+  OutputBuffer() = default;
+  explicit OutputBuffer(std::ostream &sink,
+                        std::size_t chunk_size = kDefaultChunkSize);
+  ~OutputBuffer();
+
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+  void append(char c) { buffer_.push_back(c); }
+  void append(std::string_view s) { buffer_.append(s.data(), s.size()); }
+  void append(std::size_t count, char c) { buffer_.append(count, c); }
+
+  // write the pending bytes out once a full chunk is buffered
+  void maybe_flush() {
+    if (sink_ != nullptr && buffer_.size() >= chunk_size_) {
+      flush();
+    }
+  }
+  // write all the pending bytes to the sink (if any)
+  void flush();
+
+  std::size_t size() const { return buffer_.size(); }
+  const std::string &str() const { return buffer_; }
+  // hand over the accumulated bytes and reset the buffer
+  std::string take();
+  // drop the accumulated bytes, keeping the capacity
+  void clear() { buffer_.clear(); }
+
+private:
+  std::ostream *sink_ = nullptr;
+  std::size_t chunk_size_ = kDefaultChunkSize;
+  std::string buffer_;
+};
+
+} // namespace jqcpp::json
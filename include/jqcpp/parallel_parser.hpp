@@ -0,0 +1,61 @@
+#pragma once
+#include "json_value.hpp"
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace jqcpp::json {
+
+/**
+ * @brief byte range [begin, end) of one element of a top level array
+ */
+struct ElementSpan {
+  std::size_t begin;
+  std::size_t end;
+};
+
+/**
+ * @brief bracket and quote aware pre-scan of a top level array
+ *
+ * Finds the element boundaries at depth 1 without tokenizing anything.
+ * Returns nothing if the text is not a single, well balanced top level
+ * array, the caller should then use the regular parser which reports the
+ * precise error.
+ */
+std::optional<std::vector<ElementSpan>>
+find_array_elements(std::string_view text);
+
+/**
+ * @class ParallelJSONParser
+ * @brief parse a huge top level array on several threads
+ *
+ * The elements found by find_array_elements are split into contiguous
+ * chunks of about the same byte size, each chunk is tokenized and parsed on
+ * its own thread and the results are moved into the final JSONArray in
+ * order. Anything else than a top level array, and small inputs, go through
+ * the serial JSONParser. Nesting past the depth limit throws
+ * JSONParserError either way, the top level array counts as one level.
+ */
+class ParallelJSONParser {
+public:
+  // threads == 0 uses one thread per hardware core
+  explicit ParallelJSONParser(unsigned threads = 0,
+                              std::size_t min_parallel_bytes = 1 << 20);
+
+  JSONValue parse(std::string_view text);
+  void set_max_depth(std::size_t max_depth) { max_depth_ = max_depth; }
+  // keep numbers as their text, see NumberText
+  void set_lazy_numbers(bool lazy) { lazy_numbers_ = lazy; }
+
+private:
+  JSONValue parse_serial(std::string_view text);
+
+  unsigned threads_;
+  // inputs below this size are not worth starting threads for
+  std::size_t min_parallel_bytes_;
+  std::size_t max_depth_ = kDefaultMaxDepth;
+  bool lazy_numbers_ = false;
+};
+
+} // namespace jqcpp::json
@@ -1,23 +1,92 @@
 #pragma once
 #include "json_value.hpp"
+#include "output_buffer.hpp"
+#include "tape.hpp"
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace jqcpp::json {
 
+/**
+ * @brief output layout of the printer
+ */
+struct PrintOptions {
+  // spaces per nesting level, 0 gives compact output (like jq --indent 0)
+  int indent_width = 2;
+  // one tab per nesting level, takes precedence over indent_width
+  bool use_tab = false;
+  // single line output without any whitespace
+  bool compact = false;
+};
+
 /**
  * @class JSONPrinter
  * @brief pretty print a json object
  *
+ * All the output is appended into a single OutputBuffer, nested values are
+ * never built as separate strings. Compact output goes through its own
+ * instance of the serializer which carries no indentation logic at all.
+ * Nested containers are walked with an explicit stack, so deep values do not
+ * recurse.
  */
 class JSONPrinter {
 public:
+  JSONPrinter() = default;
+  explicit JSONPrinter(const PrintOptions &options);
+
   std::string print(const JSONValue &value, int indent = 0);
+  void print(const JSONValue &value, OutputBuffer &out, int indent = 0);
+  // print a value straight from a tape, no JSONValue is built
+  void print(const TapeRef &value, OutputBuffer &out, int indent = 0);
+  // print the values of an object on a tape as an array, what .[] gives
+  void print_values(const TapeRef &object, OutputBuffer &out, int indent = 0);
+
+  bool is_compact() const { return compact_; }
 
 private:
-  std::string indent_string(int indent);
-  std::string print_object(const JSONObject &obj, int indent);
-  std::string print_array(const JSONArray &arr, int indent);
+  // an open container and the index of its next child
+  struct ValueFrame {
+    const JSONValue *value;
+    std::size_t next;
+  };
+  // an open container on a tape, next and last are tape indexes
+  struct TapeFrame {
+    std::size_t next;
+    std::size_t last;
+    bool is_array;
+    bool first;
+    // an object printed as the array of its values
+    bool values;
+  };
+
+  template <bool Pretty>
+  void print_value(const JSONValue &value, OutputBuffer &out, int indent);
+  template <bool Pretty>
+  void print_value(const TapeRef &value, OutputBuffer &out, int indent,
+                   bool values = false);
+  // the comma, newline and indent before a child
+  template <bool Pretty>
+  void write_separator(bool first, int indent, OutputBuffer &out);
+  // the newline, indent and bracket closing a container
+  template <bool Pretty>
+  void write_close(char bracket, int indent, OutputBuffer &out);
+  void print_scalar(const JSONValue &value, OutputBuffer &out);
+  void print_scalar(const TapeRef &value, OutputBuffer &out);
+  void write_indent(OutputBuffer &out, int indent);
+  void print_number(double number, OutputBuffer &out);
+  void print_integer(std::int64_t number, OutputBuffer &out);
+
+  bool compact_ = false;
+  char indent_char_ = ' ';
+  std::size_t indent_width_ = 2;
+  // indentation for the deepest level seen so far, sliced for each line
+  std::string indent_cache_;
+  // kept across calls, so their memory is reused
+  std::vector<ValueFrame> value_stack_;
+  std::vector<TapeFrame> tape_stack_;
 };
 
 } // namespace jqcpp::json
@@ -0,0 +1,56 @@
+#pragma once
+#include "mapped_file.hpp"
+#include "tape.hpp"
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace jqcpp::json {
+
+/**
+ * @brief write a tape as a snapshot file
+ *
+ * The file is a 32 byte header (magic, byte order mark, number of words and
+ * of string bytes), the words and the string bytes, in host byte order, so
+ * a later run maps it and reads the tape in place without any parsing.
+ */
+void save_snapshot(const TapeView &tape, std::ostream &out);
+
+// true if the bytes start like a snapshot file of any version
+bool is_snapshot(std::string_view prefix);
+// the bytes is_snapshot() needs
+constexpr std::size_t kSnapshotMagicSize = 8;
+
+/**
+ * @class Snapshot
+ * @brief a snapshot file opened for reading
+ *
+ * A file is mapped (MappedFile), so opening takes the same time whatever
+ * the size and the pages are read as the tape is visited. A stream is read
+ * into memory. The header is checked against the size of the file, the
+ * tape itself is checked as it is read (TapeRef).
+ */
+class Snapshot {
+public:
+  explicit Snapshot(const std::string &path);
+  explicit Snapshot(std::istream &in);
+  ~Snapshot();
+
+  Snapshot(const Snapshot &) = delete;
+  Snapshot &operator=(const Snapshot &) = delete;
+
+  const TapeView &tape() const { return tape_; }
+
+private:
+  void load(const char *data, std::size_t size);
+
+  std::unique_ptr<MappedFile> file_;
+  // the bytes read from a stream, 8 byte aligned for the words
+  std::vector<std::uint64_t> buffer_;
+  TapeView tape_;
+};
+
+} // namespace jqcpp::json
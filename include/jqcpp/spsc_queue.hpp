@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace jqcpp {
+
+/**
+ * @class SPSCQueue
+ * @brief bounded lock-free queue between one producer and one consumer
+ *
+ * A ring of slots indexed by two counters, each written by one side only.
+ * push() waits while the ring is full, which is the backpressure on the
+ * producer, and pop() waits while it is empty. Waiting spins briefly and
+ * then sleeps a little longer each round, so an idle stage does not burn a
+ * core.
+ *
+ * close() is called by the producer after its last push, pop() then
+ * returns false once the ring is drained. The consumer may close too, to
+ * make the producer stop: push() returns false on a closed queue.
+ */
+template <typename T> class SPSCQueue {
+public:
+  // the capacity is rounded up to a power of two
+  explicit SPSCQueue(std::size_t capacity) {
+    std::size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+
+  SPSCQueue(const SPSCQueue &) = delete;
+  SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+  // producer side
+  bool push(T value) {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    for (unsigned round = 0;
+         tail - head_.load(std::memory_order_acquire) > mask_; ++round) {
+      if (closed_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      wait(round);
+    }
+    if (closed_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side
+  bool pop(T &value) {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    for (unsigned round = 0; head == tail_.load(std::memory_order_acquire);
+         ++round) {
+      if (closed_.load(std::memory_order_acquire)) {
+        // the last pushes may have landed before the close
+        if (head == tail_.load(std::memory_order_acquire)) {
+          return false;
+        }
+        break;
+      }
+      wait(round);
+    }
+    value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side, true if pop() would wait
+  bool empty() const {
+    return head_.load(std::memory_order_relaxed) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  void close() { closed_.store(true, std::memory_order_release); }
+
+private:
+  static void wait(unsigned round) {
+    if (round < 64) {
+      std::this_thread::yield();
+    } else {
+      auto micros = std::min<unsigned>(1000, 10u << std::min(round - 64, 7u));
+      std::this_thread::sleep_for(std::chrono::microseconds(micros));
+    }
+  }
+
+  std::vector<T> slots_;
+  std::size_t mask_ = 0;
+  // next slot to pop, written by the consumer
+  alignas(64) std::atomic<std::size_t> head_{0};
+  // next slot to push, written by the producer
+  alignas(64) std::atomic<std::size_t> tail_{0};
+  alignas(64) std::atomic<bool> closed_{false};
+};
+
+} // namespace jqcpp
@@ -0,0 +1,46 @@
+#pragma once
+#include "output_buffer.hpp"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace jqcpp::json {
+
+/**
+ * @brief index of the first char of s which must be escaped in a JSON
+ * string literal (", \, control chars and DEL), or s.size() if none
+ *
+ * Scans 16, 32 or 64 bytes per step with the SSE2, AVX2 or AVX-512 kernel
+ * picked at run time (see cpu_dispatch.hpp).
+ */
+std::size_t find_escape_char(std::string_view s);
+
+/**
+ * @brief append s as a quoted and escaped JSON string literal
+ *
+ * Runs without anything to escape are copied in bulk, only the chars found
+ * by find_escape_char are rewritten.
+ */
+void write_escaped_string(std::string_view s, OutputBuffer &out);
+
+/**
+ * @brief index of the first ", \ or control character (below 0x20) in s,
+ * or s.size() if none
+ *
+ * ascii is cleared when a byte before it is not ASCII, so that plain runs
+ * need no UTF-8 check. Scans 16 or 32 bytes per step like find_escape_char.
+ */
+std::size_t find_string_end(std::string_view s, bool &ascii);
+
+/**
+ * @brief decode the string literal whose body starts at text[pos] into out
+ *
+ * Escapes are decoded, \u surrogate pairs combined and lone surrogates
+ * replaced by U+FFFD, and so are bytes which are not valid UTF-8. pos moves
+ * past the closing quote. Throws JSONTokenizerError on a malformed literal,
+ * e.g. one holding a raw control character.
+ */
+void unescape_string(std::string_view text, std::size_t &pos,
+                     std::string &out);
+
+} // namespace jqcpp::json
@@ -0,0 +1,269 @@
+#pragma once
+#include "json_sax.hpp"
+#include "json_value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace jqcpp::json {
+
+class TapeError : public std::runtime_error {
+public:
+  TapeError(const std::string &message) : std::runtime_error(message) {}
+};
+
+// the tag in the top byte of a tape word
+enum class TapeTag : std::uint8_t {
+  Null = 'n',
+  True = 't',
+  False = 'f',
+  Number = 'd',
+  Integer = 'i',
+  String = 's',
+  StartArray = '[',
+  EndArray = ']',
+  StartObject = '{',
+  EndObject = '}',
+};
+
+/**
+ * @brief a parsed document as one array of tagged 64 bit words
+ *
+ * Each word holds its tag in the top byte and a 56 bit payload. A number
+ * takes a second word with the bits of its double, an integer a second word
+ * with the bits of its int64. A string takes a second word with its length,
+ * the payload being its offset in the string buffer. A container start
+ * holds the index just past its end, so a container is skipped in one step,
+ * and the end word holds the number of elements and whether an object
+ * repeats a key. Object members are a string key followed by the value,
+ * equal keys share their bytes. Several documents follow each other.
+ *
+ * The view does not own the words, they may live in a Tape or in a mapped
+ * snapshot file.
+ */
+struct TapeView {
+  const std::uint64_t *words = nullptr;
+  std::size_t size = 0;
+  std::string_view strings;
+};
+
+// the words and string bytes of a tape built in memory
+struct Tape {
+  std::vector<std::uint64_t> words;
+  std::string strings;
+
+  TapeView view() const { return {words.data(), words.size(), strings}; }
+};
+
+template <typename Item> class TapeRange;
+struct TapeMember;
+
+/**
+ * @class TapeRef
+ * @brief a value on a tape
+ *
+ * Reads are bounds checked, so a damaged tape throws TapeError instead of
+ * reading past its end.
+ */
+class TapeRef {
+public:
+  TapeRef(const TapeView &tape, std::size_t index);
+  // a ref keeps a pointer to the view, which must outlive it
+  TapeRef(TapeView &&, std::size_t) = delete;
+
+  const TapeView &tape() const { return *tape_; }
+  TapeTag tag() const { return tag_; }
+  std::size_t index() const { return index_; }
+  // the index just past the value
+  std::size_t end() const;
+
+  bool is_null() const { return tag_ == TapeTag::Null; }
+  bool is_bool() const {
+    return tag_ == TapeTag::True || tag_ == TapeTag::False;
+  }
+  bool is_number() const {
+    return tag_ == TapeTag::Number || tag_ == TapeTag::Integer;
+  }
+  bool is_integer() const { return tag_ == TapeTag::Integer; }
+  bool is_string() const { return tag_ == TapeTag::String; }
+  bool is_array() const { return tag_ == TapeTag::StartArray; }
+  bool is_object() const { return tag_ == TapeTag::StartObject; }
+
+  bool get_bool() const { return tag_ == TapeTag::True; }
+  // integers are converted
+  double get_number() const;
+  std::int64_t get_integer() const;
+  std::string_view get_string() const;
+
+  // the elements of an array or the members of an object, repeated keys
+  // included
+  std::size_t size() const;
+  // false if an object repeats a key, its JSONValue keeps only the last
+  bool unique_keys() const;
+  // walk the elements of an array or the members of an object in order,
+  // straight on the tape
+  TapeRange<TapeRef> elements() const;
+  TapeRange<TapeMember> members() const;
+  // the element at index of an array, nothing past its end
+  std::optional<TapeRef> at(std::size_t index) const;
+  // the value of the last member named key of an object
+  std::optional<TapeRef> find(std::string_view key) const;
+
+  // build the value as a JSONValue, deep ones too as containers are kept
+  // on an explicit stack
+  JSONValue to_value() const;
+  // build the elements start to end of an array, both clamped to its size
+  JSONValue slice(std::size_t start, std::size_t end) const;
+
+private:
+  std::uint64_t word(std::size_t index) const;
+  // the end word of a container
+  std::uint64_t close_word() const;
+
+  const TapeView *tape_;
+  std::size_t index_;
+  TapeTag tag_;
+};
+
+// a member of an object on a tape
+struct TapeMember {
+  std::string_view key;
+  TapeRef value;
+};
+
+/**
+ * @class TapeIterator
+ * @brief forward iterator over the values of a container, or over its
+ * members with Item = TapeMember. Containers are skipped in one step.
+ */
+template <typename Item> class TapeIterator {
+public:
+  TapeIterator(const TapeView &tape, std::size_t index)
+      : tape_(&tape), index_(index) {}
+
+  Item operator*() const {
+    if constexpr (std::is_same_v<Item, TapeMember>) {
+      TapeRef key(*tape_, index_);
+      return {key.get_string(), TapeRef(*tape_, key.end())};
+    } else {
+      return TapeRef(*tape_, index_);
+    }
+  }
+  TapeIterator &operator++() {
+    index_ = TapeRef(*tape_, index_).end();
+    if constexpr (std::is_same_v<Item, TapeMember>) {
+      index_ = TapeRef(*tape_, index_).end();
+    }
+    return *this;
+  }
+  bool operator==(const TapeIterator &other) const {
+    return index_ == other.index_;
+  }
+  bool operator!=(const TapeIterator &other) const {
+    return index_ != other.index_;
+  }
+
+private:
+  const TapeView *tape_;
+  std::size_t index_;
+};
+
+// the children of a container, for range for loops
+template <typename Item> class TapeRange {
+public:
+  TapeRange(const TapeView &tape, std::size_t first, std::size_t last)
+      : first_(tape, first), last_(tape, last) {}
+
+  TapeIterator<Item> begin() const { return first_; }
+  TapeIterator<Item> end() const { return last_; }
+
+private:
+  TapeIterator<Item> first_;
+  TapeIterator<Item> last_;
+};
+
+/**
+ * @class TapeBuilder
+ * @brief handler writing the events of a parser onto a tape
+ *
+ * With a Spill the tape is built in pieces: once the words and strings in
+ * memory reach the budget, they are handed over and the builder goes on
+ * with empty buffers, indexes and offsets still counting from the start of
+ * the whole tape. Only finished top level values or members are spilled,
+ * so a single one of them is still built in memory.
+ */
+class TapeBuilder : public JSONHandler {
+public:
+  // takes the pieces of a tape too large for memory
+  class Spill {
+  public:
+    virtual ~Spill() = default;
+    // the next words and strings of the tape
+    virtual void write(const Tape &piece) = 0;
+    // rewrite a word already written, the start of a container
+    virtual void patch(std::size_t index, std::uint64_t word) = 0;
+  };
+
+  void on_start_object() override { start(TapeTag::StartObject); }
+  void on_key(std::string_view key) override;
+  void on_end_object() override { end(TapeTag::EndObject); }
+  void on_start_array() override { start(TapeTag::StartArray); }
+  void on_end_array() override { end(TapeTag::EndArray); }
+  void on_string(std::string_view value) override;
+  void on_number(double value, std::string_view text) override;
+  void on_integer(std::int64_t value, std::string_view text) override;
+  void on_bool(bool value) override;
+  void on_null() override;
+
+  // append a whole value
+  void on_value(const JSONValue &value);
+
+  // spill the tape to spill whenever it holds budget bytes
+  void spill_to(Spill &spill, std::size_t budget);
+
+  // the tape so far, only its last piece with a Spill, all containers must
+  // be closed
+  const Tape &tape() const { return tape_; }
+  Tape take();
+
+private:
+  void add(TapeTag tag, std::uint64_t payload);
+  void add_string(std::string_view value);
+  void start(TapeTag tag);
+  void end(TapeTag tag);
+  void value_done();
+  // whether the object starting at start repeats a key
+  bool repeats_key(std::size_t start, std::size_t count);
+  // the index in memory just past the value at index i in memory
+  std::size_t next_value(std::size_t i) const;
+  std::string_view key_text(std::uint64_t offset, std::uint64_t length) const;
+  void spill();
+
+  Tape tape_;
+  // the offset of each key in the string buffer, keys repeat a lot
+  std::unordered_map<std::string, std::uint64_t> keys_;
+  // the start index and element count of each open container
+  std::vector<std::pair<std::size_t, std::size_t>> open_;
+  std::unordered_set<std::string_view> seen_keys_;
+
+  Spill *spill_ = nullptr;
+  std::size_t budget_ = 0;
+  // the words and string bytes already spilled
+  std::size_t words_base_ = 0;
+  std::size_t strings_base_ = 0;
+  // the shared keys by offset, their bytes may be spilled already
+  std::unordered_map<std::uint64_t, std::string_view> spilled_keys_;
+  // the hashes of the keys of a top level object, which may be spilled
+  // while it is built
+  std::vector<std::size_t> top_keys_;
+};
+
+} // namespace jqcpp::json
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace jqcpp::json {
+
+/**
+ * @brief whether s is valid UTF-8: no overlong forms, surrogates, code
+ * points past U+10FFFF or cut sequences
+ *
+ * From SSSE3 on 16 or 32 bytes are checked per step with the lookup tables
+ * of Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per
+ * Byte". Below that the sequences are checked one by one. The kernel is
+ * picked at run time, see cpu_dispatch.hpp.
+ */
+bool is_utf8(std::string_view s);
+
+// index of the first byte of s which does not start a valid UTF-8
+// sequence, or s.size() if none
+std::size_t find_invalid_utf8(std::string_view s);
+
+// index of the first byte of s which is not ASCII, or s.size() if none
+std::size_t find_non_ascii(std::string_view s);
+
+// number of code points of the UTF-8 text s, what jq's length gives
+std::size_t count_code_points(std::string_view s);
+
+// append the code point code, at most U+10FFFF, as UTF-8
+void append_utf8(std::string &out, std::uint32_t code);
+
+// append s with each byte which does not start a valid UTF-8 sequence
+// replaced by U+FFFD, like jq
+void append_utf8_lossy(std::string_view s, std::string &out);
+
+} // namespace jqcpp::json
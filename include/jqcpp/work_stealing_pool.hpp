@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+namespace jqcpp {
+
+/**
+ * @class WorkStealingPool
+ * @brief run a batch of independent tasks on a fixed set of workers
+ *
+ * Each worker starts with its own contiguous range of task indexes and
+ * takes them from the front. A worker that runs out steals from the back of
+ * the busiest other worker, so a few slow tasks do not leave the other
+ * workers idle. The calling thread is worker 0.
+ *
+ * The worker number passed to the task lets callers keep per worker state
+ * (compiled filter, buffers) that is reused across tasks without locking.
+ */
+class WorkStealingPool {
+public:
+  using Task = std::function<void(unsigned worker, std::size_t index)>;
+  using Write = std::function<void(std::size_t index)>;
+
+  // workers == 0 uses one worker per hardware core
+  explicit WorkStealingPool(unsigned workers = 0);
+
+  unsigned workers() const { return workers_; }
+  // run task for every index in [0, count) and wait for all of them, the
+  // first exception thrown by a task is rethrown
+  void run(std::size_t count, const Task &task);
+  // run task for every index in [0, count) on the workers, taking the
+  // indexes in order, and call write for each index in order on the calling
+  // thread once its task is done. At most max_pending tasks are done and
+  // not written yet, a worker waits before taking an index past that. The
+  // first exception thrown by a task or by write stops the run and is
+  // rethrown here once the workers are idle.
+  void run_ordered(std::size_t count, const Task &task, const Write &write,
+                   std::size_t max_pending);
+
+private:
+  unsigned workers_;
+};
+
+} // namespace jqcpp
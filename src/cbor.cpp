@@ -0,0 +1,529 @@
+#include "jqcpp/cbor.hpp"
+#include "jqcpp/utf8.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace jqcpp::json {
+
+namespace {
+
+constexpr std::uint64_t kIndefinite =
+    std::numeric_limits<std::uint64_t>::max();
+
+// unsigned integer of size bytes, big or little endian
+std::uint64_t load_uint(const char *bytes, std::size_t size, bool little) {
+  std::uint64_t value = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    std::size_t index = little ? size - 1 - i : i;
+    value = (value << 8) | static_cast<unsigned char>(bytes[index]);
+  }
+  return value;
+}
+
+double half_to_double(std::uint16_t bits) {
+  int exponent = (bits >> 10) & 0x1f;
+  int mantissa = bits & 0x3ff;
+  double value;
+  if (exponent == 0) {
+    value = std::ldexp(mantissa, -24);
+  } else if (exponent == 31) {
+    value = mantissa == 0 ? std::numeric_limits<double>::infinity()
+                          : std::numeric_limits<double>::quiet_NaN();
+  } else {
+    value = std::ldexp(mantissa + 1024, exponent - 25);
+  }
+  return (bits & 0x8000) != 0 ? -value : value;
+}
+
+double float_bits(std::uint64_t bits, std::size_t size) {
+  if (size == 2) {
+    return half_to_double(static_cast<std::uint16_t>(bits));
+  }
+  if (size == 4) {
+    auto bits32 = static_cast<std::uint32_t>(bits);
+    float value;
+    std::memcpy(&value, &bits32, sizeof(value));
+    return value;
+  }
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+} // namespace
+
+bool CBORReader::read_head(std::string_view data, std::size_t &offset,
+                           Head &head) {
+  if (offset >= data.size()) {
+    return false;
+  }
+  auto initial = static_cast<unsigned char>(data[offset]);
+  head.major = initial >> 5;
+  head.info = initial & 0x1f;
+  head.argument = head.info;
+  head.indefinite = false;
+  if (head.info < 24) {
+    ++offset;
+    return true;
+  }
+  if (head.info == 31) {
+    // only strings, containers and the break have no argument
+    if (head.major < 2 || head.major == 6) {
+      throw CBORError("Invalid CBOR indefinite length item");
+    }
+    head.indefinite = true;
+    ++offset;
+    return true;
+  }
+  if (head.info > 27) {
+    throw CBORError("Invalid CBOR additional information " +
+                    std::to_string(head.info));
+  }
+  std::size_t size = std::size_t{1} << (head.info - 24);
+  if (data.size() - offset - 1 < size) {
+    return false;
+  }
+  head.argument = load_uint(data.data() + offset + 1, size, false);
+  offset += 1 + size;
+  return true;
+}
+
+std::size_t CBORReader::find_end(std::string_view data, std::size_t offset) {
+  constexpr std::size_t npos = std::string_view::npos;
+  std::size_t pos = offset;
+  // the items left in each open container, kIndefinite until its break
+  std::vector<std::uint64_t> open;
+  while (true) {
+    Head head;
+    if (!read_head(data, pos, head)) {
+      return npos;
+    }
+    bool complete = true;
+    if (head.major == 7 && head.indefinite) {
+      if (open.empty() || open.back() != kIndefinite) {
+        throw CBORError("Unexpected CBOR break");
+      }
+      open.pop_back();
+    } else if (head.major == 2 || head.major == 3) {
+      if (head.indefinite) {
+        open.push_back(kIndefinite);
+        complete = false;
+      } else if (head.argument > data.size() - pos) {
+        return npos;
+      } else {
+        pos += head.argument;
+      }
+    } else if (head.major == 4 || head.major == 5) {
+      if (head.indefinite) {
+        open.push_back(kIndefinite);
+        complete = false;
+      } else if (head.argument > data.size() - pos) {
+        // every item takes at least a byte
+        return npos;
+      } else if (head.argument > 0) {
+        open.push_back(head.major == 5 ? 2 * head.argument : head.argument);
+        complete = false;
+      }
+    } else if (head.major == 6) {
+      // the tagged item follows
+      complete = false;
+    }
+    if (!complete) {
+      continue;
+    }
+    // count the item in its container, a full container is an item too
+    while (true) {
+      if (open.empty()) {
+        return pos;
+      }
+      if (open.back() == kIndefinite || --open.back() > 0) {
+        break;
+      }
+      open.pop_back();
+    }
+  }
+}
+
+JSONValue CBORReader::read(std::string_view data, std::size_t &offset) {
+  data_ = data;
+  pos_ = offset;
+  JSONValue value = read_value();
+  offset = pos_;
+  return value;
+}
+
+std::string_view CBORReader::take(std::size_t size) {
+  if (pos_ > data_.size() || data_.size() - pos_ < size) {
+    throw CBORError("Truncated CBOR data");
+  }
+  auto bytes = data_.substr(pos_, size);
+  pos_ += size;
+  return bytes;
+}
+
+CBORReader::Head CBORReader::head() {
+  Head head;
+  if (!read_head(data_, pos_, head)) {
+    throw CBORError("Truncated CBOR data");
+  }
+  return head;
+}
+
+// true and past the break code if the next byte is a break
+bool CBORReader::at_break() {
+  if (pos_ >= data_.size()) {
+    throw CBORError("Truncated CBOR data");
+  }
+  if (static_cast<unsigned char>(data_[pos_]) == 0xff) {
+    ++pos_;
+    return true;
+  }
+  return false;
+}
+
+std::string_view CBORReader::read_bytes(const Head &head,
+                                        std::string &joined) {
+  if (!head.indefinite) {
+    return take(head.argument);
+  }
+  // the chunks are definite strings of the same type
+  while (!at_break()) {
+    Head chunk = this->head();
+    if (chunk.major != head.major || chunk.indefinite) {
+      throw CBORError("Invalid CBOR string chunk");
+    }
+    joined.append(take(chunk.argument));
+  }
+  return joined;
+}
+
+// map keys are strings, integers are accepted and written in decimal
+std::string CBORReader::read_key() {
+  JSONValue key;
+  Head head;
+  if (!read_item(key, head)) {
+    throw CBORError("CBOR map keys should be strings");
+  }
+  if (key.is_string()) {
+    return key.get_string();
+  }
+  if (key.is_integer()) {
+    return std::to_string(key.get_integer());
+  }
+  if (key.is_number() && std::trunc(key.get_number()) == key.get_number()) {
+    return std::to_string(static_cast<long long>(key.get_number()));
+  }
+  throw CBORError("CBOR map keys should be strings");
+}
+
+JSONValue CBORReader::read_value() {
+  // left over from a read that threw
+  stack_.clear();
+  while (true) {
+    JSONValue value;
+    Head head;
+    if (!read_item(value, head)) {
+      if (stack_.size() >= max_depth_) {
+        throw CBORError("Exceeds depth limit for parsing");
+      }
+      bool is_map = head.major == 5;
+      if (head.indefinite ? !at_break() : head.argument > 0) {
+        Frame &frame = stack_.emplace_back();
+        frame.is_map = is_map;
+        frame.indefinite = head.indefinite;
+        frame.left = head.argument;
+        if (!head.indefinite) {
+          // a bogus count must not reserve more than the data can hold
+          auto room =
+              std::min<std::uint64_t>(head.argument, data_.size() - pos_);
+          if (is_map) {
+            frame.object.reserve(room);
+          } else {
+            frame.array.reserve(room);
+          }
+        }
+        if (is_map) {
+          frame.key = read_key();
+        }
+        // on to its first item
+        continue;
+      }
+      value = is_map ? JSONValue(JSONObject()) : JSONValue(JSONArray());
+    }
+
+    // add the value to its container, closing the containers it completes
+    while (true) {
+      if (stack_.empty()) {
+        return value;
+      }
+      Frame &top = stack_.back();
+      if (top.is_map) {
+        jsonObjectInsert(top.object, top.key, std::move(value));
+      } else {
+        top.array.push_back(std::move(value));
+      }
+      if (top.indefinite ? !at_break() : --top.left > 0) {
+        if (top.is_map) {
+          top.key = read_key();
+        }
+        break;
+      }
+      value = top.is_map ? JSONValue(std::move(top.object))
+                         : JSONValue(std::move(top.array));
+      stack_.pop_back();
+    }
+  }
+}
+
+bool CBORReader::read_item(JSONValue &value, Head &head) {
+  head = this->head();
+  while (head.major == 6) {
+    std::uint64_t tag = head.argument;
+    if (tag == 2 || tag == 3 || (tag >= 64 && tag <= 87)) {
+      value = read_tagged(tag);
+      return true;
+    }
+    // dates, URIs, self describe and the like: the content is enough
+    head = this->head();
+  }
+  if (head.major == 4 || head.major == 5) {
+    return false;
+  }
+  value = read_scalar(head);
+  return true;
+}
+
+JSONValue CBORReader::read_scalar(const Head &head) {
+  switch (head.major) {
+  case 0:
+    return unsigned_number(head.argument);
+  case 1:
+    if (head.argument <= static_cast<std::uint64_t>(
+                             std::numeric_limits<std::int64_t>::max())) {
+      return JSONValue(-1 - static_cast<std::int64_t>(head.argument));
+    }
+    return JSONValue(-1.0 - static_cast<double>(head.argument));
+  case 2:
+  case 3: {
+    std::string joined;
+    return JSONValue(std::string(read_bytes(head, joined)));
+  }
+  default:
+    break;
+  }
+
+  // floats and simple values
+  switch (head.info) {
+  case 20:
+    return JSONValue(false);
+  case 21:
+    return JSONValue(true);
+  case 22:
+  case 23:
+    // null and undefined
+    return JSONValue(nullptr);
+  case 25:
+    return JSONValue(float_bits(head.argument, 2));
+  case 26:
+    return JSONValue(float_bits(head.argument, 4));
+  case 27:
+    return JSONValue(float_bits(head.argument, 8));
+  case 31:
+    throw CBORError("Unexpected CBOR break");
+  default:
+    throw CBORError("Unsupported CBOR simple value " +
+                    std::to_string(head.argument));
+  }
+}
+
+// bignums and typed arrays, read_item drops the other tags
+JSONValue CBORReader::read_tagged(std::uint64_t tag) {
+  if (tag >= 64 && tag <= 87) {
+    return read_typed_array(tag);
+  }
+  // bignums
+  Head content = head();
+  if (content.major != 2) {
+    throw CBORError("Invalid CBOR bignum");
+  }
+  std::string joined;
+  double value = 0;
+  for (char byte : read_bytes(content, joined)) {
+    value = value * 256 + static_cast<unsigned char>(byte);
+  }
+  return JSONValue(tag == 2 ? value : -1 - value);
+}
+
+// RFC 8746: the tag is 0b010fsell, f float, s signed, e little endian and
+// ll the element size. The elements are read straight from the bytes.
+JSONValue CBORReader::read_typed_array(std::uint64_t tag) {
+  bool is_float = (tag & 0x10) != 0;
+  bool is_signed = (tag & 0x08) != 0;
+  bool little = (tag & 0x04) != 0;
+  std::size_t size = std::size_t{1} << ((tag & 0x03) + (is_float ? 1 : 0));
+  if (is_float && size == 16) {
+    throw CBORError("Unsupported CBOR typed array of float 128");
+  }
+  Head content = head();
+  if (content.major != 2) {
+    throw CBORError("Invalid CBOR typed array");
+  }
+  std::string joined;
+  std::string_view bytes = read_bytes(content, joined);
+  if (bytes.size() % size != 0) {
+    throw CBORError("Invalid CBOR typed array length");
+  }
+  JSONArray array;
+  array.reserve(bytes.size() / size);
+  unsigned shift = static_cast<unsigned>(64 - 8 * size);
+  for (std::size_t i = 0; i < bytes.size(); i += size) {
+    std::uint64_t bits = load_uint(bytes.data() + i, size, little);
+    if (is_float) {
+      array.emplace_back(float_bits(bits, size));
+    } else if (is_signed) {
+      // sign extend
+      array.emplace_back(static_cast<std::int64_t>(bits << shift) >> shift);
+    } else {
+      array.push_back(unsigned_number(bits));
+    }
+  }
+  return JSONValue(std::move(array));
+}
+
+void CBORWriter::write_head(std::uint8_t major, std::uint64_t argument,
+                            OutputBuffer &out) {
+  auto initial = static_cast<std::uint8_t>(major << 5);
+  std::size_t size;
+  if (argument < 24) {
+    out.append(static_cast<char>(initial | argument));
+    return;
+  } else if (argument <= 0xff) {
+    out.append(static_cast<char>(initial | 24));
+    size = 1;
+  } else if (argument <= 0xffff) {
+    out.append(static_cast<char>(initial | 25));
+    size = 2;
+  } else if (argument <= 0xffffffffULL) {
+    out.append(static_cast<char>(initial | 26));
+    size = 4;
+  } else {
+    out.append(static_cast<char>(initial | 27));
+    size = 8;
+  }
+  for (std::size_t i = size; i-- > 0;) {
+    out.append(static_cast<char>((argument >> (i * 8)) & 0xff));
+  }
+}
+
+void CBORWriter::write_integer(std::int64_t value, OutputBuffer &out) {
+  if (value >= 0) {
+    write_head(0, static_cast<std::uint64_t>(value), out);
+  } else {
+    write_head(1, static_cast<std::uint64_t>(-(value + 1)), out);
+  }
+}
+
+void CBORWriter::write_number(double value, OutputBuffer &out) {
+  // -0 keeps its sign as a float
+  bool integral =
+      std::trunc(value) == value && !(value == 0 && std::signbit(value));
+  if (integral && value >= 0 && value < 18446744073709551616.0) {
+    write_head(0, static_cast<std::uint64_t>(value), out);
+    return;
+  }
+  if (integral && value < 0 && value > -18446744073709551616.0) {
+    write_head(1, static_cast<std::uint64_t>(-value) - 1, out);
+    return;
+  }
+  if (std::isnan(value)) {
+    // the canonical NaN, a half float
+    out.append(std::string_view("\xf9\x7e\x00", 3));
+    return;
+  }
+  if (std::isinf(value) ||
+      std::fabs(value) <= std::numeric_limits<float>::max()) {
+    auto single = static_cast<float>(value);
+    if (static_cast<double>(single) == value) {
+      std::uint32_t bits;
+      std::memcpy(&bits, &single, sizeof(bits));
+      out.append(static_cast<char>(0xfa));
+      for (int i = 3; i >= 0; --i) {
+        out.append(static_cast<char>((bits >> (i * 8)) & 0xff));
+      }
+      return;
+    }
+  }
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  out.append(static_cast<char>(0xfb));
+  for (int i = 7; i >= 0; --i) {
+    out.append(static_cast<char>((bits >> (i * 8)) & 0xff));
+  }
+}
+
+void CBORWriter::write(const JSONValue &root, OutputBuffer &out) {
+  // the open containers and the index of their next child
+  std::vector<std::pair<const JSONValue *, std::size_t>> stack;
+  const JSONValue *value = &root;
+  while (value) {
+    if (value->is_array()) {
+      write_head(4, value->get_array().size(), out);
+      stack.emplace_back(value, 0);
+    } else if (value->is_object()) {
+      write_head(5, value->get_object().size(), out);
+      stack.emplace_back(value, 0);
+    } else {
+      write_scalar(*value, out);
+    }
+
+    value = nullptr;
+    while (!stack.empty()) {
+      auto &[container, next] = stack.back();
+      if (container->is_array()) {
+        const auto &array = container->get_array();
+        if (next < array.size()) {
+          value = &array[next++];
+          break;
+        }
+      } else {
+        const auto &object = container->get_object();
+        if (next < object.size()) {
+          const auto &[key, member] = object[next++];
+          write_text(key, out);
+          value = &member;
+          break;
+        }
+      }
+      stack.pop_back();
+      out.maybe_flush();
+    }
+  }
+}
+
+void CBORWriter::write_scalar(const JSONValue &value, OutputBuffer &out) {
+  if (value.is_null()) {
+    out.append(static_cast<char>(0xf6));
+  } else if (value.is_bool()) {
+    out.append(static_cast<char>(value.get_bool() ? 0xf5 : 0xf4));
+  } else if (value.is_integer()) {
+    write_integer(value.get_integer(), out);
+  } else if (value.is_number_text()) {
+    write_scalar(value.number_value(), out);
+  } else if (value.is_number()) {
+    write_number(value.get_number(), out);
+  } else if (value.is_string()) {
+    write_text(value.get_string(), out);
+  }
+}
+
+// a text string, or a byte string if it is not valid UTF-8
+void CBORWriter::write_text(std::string_view text, OutputBuffer &out) {
+  write_head(is_utf8(text) ? 3 : 2, text.size(), out);
+  out.append(text);
+}
+
+} // namespace jqcpp::json
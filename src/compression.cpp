@@ -0,0 +1,425 @@
+#include "jqcpp/compression.hpp"
+#include "jqcpp/spsc_queue.hpp"
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+#include <utility>
+
+#ifdef JQCPP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef JQCPP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace jqcpp {
+
+namespace {
+
+constexpr std::size_t kChunkSize = 64 * 1024;
+
+const char *compression_name(Compression format) {
+  switch (format) {
+  case Compression::Gzip:
+    return "gzip";
+  case Compression::Zstd:
+    return "zstd";
+  default:
+    return "none";
+  }
+}
+
+// hands a full chunk of decoded bytes on, false if the reader has stopped
+using ChunkSink = std::function<bool(std::string)>;
+
+// read the next raw chunk of source into in, false at the end
+bool read_raw(std::istream &source, std::string &in) {
+  in.resize(kChunkSize);
+  source.read(in.data(), static_cast<std::streamsize>(in.size()));
+  in.resize(static_cast<std::size_t>(source.gcount()));
+  return !in.empty();
+}
+
+#ifdef JQCPP_HAVE_ZLIB
+void decode_gzip(std::istream &source, const ChunkSink &emit) {
+  z_stream zs{};
+  // 15 + 32: any window size, gzip or zlib header
+  if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+    throw std::runtime_error("Cannot start the gzip decoder");
+  }
+  struct Guard {
+    z_stream &zs;
+    ~Guard() { inflateEnd(&zs); }
+  } guard{zs};
+
+  std::string in;
+  std::string out(kChunkSize, '\0');
+  std::size_t used = 0;
+  bool ended = false;
+  while (true) {
+    if (zs.avail_in == 0) {
+      if (!read_raw(source, in)) {
+        break;
+      }
+      zs.next_in = reinterpret_cast<Bytef *>(in.data());
+      zs.avail_in = static_cast<uInt>(in.size());
+    }
+    zs.next_out = reinterpret_cast<Bytef *>(out.data() + used);
+    zs.avail_out = static_cast<uInt>(kChunkSize - used);
+    int ret = inflate(&zs, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      // concatenated members, e.g. from cat a.gz b.gz
+      ended = true;
+      inflateReset(&zs);
+    } else if (ret == Z_OK) {
+      ended = false;
+    } else if (ret != Z_BUF_ERROR) {
+      throw std::runtime_error("Invalid gzip data");
+    }
+    used = kChunkSize - zs.avail_out;
+    if (used == kChunkSize) {
+      if (!emit(std::move(out))) {
+        return;
+      }
+      out.assign(kChunkSize, '\0');
+      used = 0;
+    }
+  }
+  if (!ended) {
+    throw std::runtime_error("Truncated gzip data");
+  }
+  out.resize(used);
+  if (!out.empty()) {
+    emit(std::move(out));
+  }
+}
+#endif
+
+#ifdef JQCPP_HAVE_ZSTD
+void decode_zstd(std::istream &source, const ChunkSink &emit) {
+  ZSTD_DStream *stream = ZSTD_createDStream();
+  if (stream == nullptr) {
+    throw std::runtime_error("Cannot start the zstd decoder");
+  }
+  struct Guard {
+    ZSTD_DStream *stream;
+    ~Guard() { ZSTD_freeDStream(stream); }
+  } guard{stream};
+  ZSTD_initDStream(stream);
+
+  std::string in;
+  std::string out(kChunkSize, '\0');
+  std::size_t used = 0;
+  // 0 once a frame is complete
+  std::size_t hint = 0;
+  bool started = false;
+  while (read_raw(source, in)) {
+    started = true;
+    ZSTD_inBuffer input{in.data(), in.size(), 0};
+    bool out_full = false;
+    // a full output buffer may hide more decoded bytes
+    while (input.pos < input.size || out_full) {
+      ZSTD_outBuffer output{out.data(), kChunkSize, used};
+      hint = ZSTD_decompressStream(stream, &output, &input);
+      if (ZSTD_isError(hint)) {
+        throw std::runtime_error(std::string("Invalid zstd data: ") +
+                                 ZSTD_getErrorName(hint));
+      }
+      used = output.pos;
+      out_full = used == kChunkSize;
+      if (out_full) {
+        if (!emit(std::move(out))) {
+          return;
+        }
+        out.assign(kChunkSize, '\0');
+        used = 0;
+      }
+    }
+  }
+  if (!started || hint != 0) {
+    throw std::runtime_error("Truncated zstd data");
+  }
+  out.resize(used);
+  if (!out.empty()) {
+    emit(std::move(out));
+  }
+}
+#endif
+
+/**
+ * @brief the decoded bytes of a compressed stream
+ *
+ * The decoder thread fills chunks into a small queue, underflow() takes
+ * them one by one as the get area.
+ */
+class DecodingBuf : public std::streambuf {
+public:
+  DecodingBuf(std::istream &source, Compression format) : chunks_(8) {
+    decoder_ = std::thread([this, &source, format] { run(source, format); });
+  }
+
+  ~DecodingBuf() override {
+    // stops the decoder if the reader gives up early
+    chunks_.close();
+    decoder_.join();
+  }
+
+protected:
+  int_type underflow() override {
+    while (gptr() == egptr()) {
+      if (!chunks_.pop(current_)) {
+        if (error_) {
+          std::rethrow_exception(error_);
+        }
+        return traits_type::eof();
+      }
+      setg(current_.data(), current_.data(),
+           current_.data() + current_.size());
+    }
+    return traits_type::to_int_type(*gptr());
+  }
+
+private:
+  void run(std::istream &source, Compression format) {
+    try {
+      ChunkSink emit = [this](std::string chunk) {
+        return chunks_.push(std::move(chunk));
+      };
+#ifdef JQCPP_HAVE_ZLIB
+      if (format == Compression::Gzip) {
+        decode_gzip(source, emit);
+      }
+#endif
+#ifdef JQCPP_HAVE_ZSTD
+      if (format == Compression::Zstd) {
+        decode_zstd(source, emit);
+      }
+#endif
+    } catch (...) {
+      error_ = std::current_exception();
+    }
+    chunks_.close();
+  }
+
+  SPSCQueue<std::string> chunks_;
+  std::string current_;
+  std::exception_ptr error_;
+  std::thread decoder_;
+};
+
+class DecodedInput : public std::istream {
+public:
+  DecodedInput(std::istream &source, Compression format)
+      : std::istream(nullptr), buf_(source, format) {
+    rdbuf(&buf_);
+    // decoding errors are rethrown instead of looking like the end
+    exceptions(std::ios::badbit);
+  }
+
+private:
+  DecodingBuf buf_;
+};
+
+} // namespace
+
+Compression parse_compression(const std::string &name) {
+  if (name == "none") {
+    return Compression::None;
+  }
+  if (name == "gzip") {
+    return Compression::Gzip;
+  }
+  if (name == "zstd") {
+    return Compression::Zstd;
+  }
+  throw std::invalid_argument("Unknown compression " + name);
+}
+
+bool compression_supported(Compression format) {
+  switch (format) {
+  case Compression::None:
+    return true;
+  case Compression::Gzip:
+#ifdef JQCPP_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+  case Compression::Zstd:
+#ifdef JQCPP_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+Compression detect_compression(std::istream &in) {
+  auto first = in.peek();
+  if (first == 0x1f) {
+    return Compression::Gzip;
+  }
+  if (first == 0x28) {
+    return Compression::Zstd;
+  }
+  return Compression::None;
+}
+
+std::unique_ptr<std::istream> open_decompressed(std::istream &in) {
+  Compression format = detect_compression(in);
+  if (format == Compression::None) {
+    return nullptr;
+  }
+  if (!compression_supported(format)) {
+    throw std::runtime_error(std::string(compression_name(format)) +
+                             " input is not supported by this build");
+  }
+  return std::make_unique<DecodedInput>(in, format);
+}
+
+/**
+ * @brief the put area collects a chunk, which is then compressed into the
+ * sink
+ */
+class CompressingOutput::Encoder : public std::streambuf {
+public:
+  Encoder(std::ostream &sink, Compression format)
+      : sink_(sink), format_(format), in_(kChunkSize, '\0'),
+        out_(kChunkSize, '\0') {
+    if (!compression_supported(format)) {
+      throw std::runtime_error(std::string(compression_name(format)) +
+                               " output is not supported by this build");
+    }
+#ifdef JQCPP_HAVE_ZLIB
+    // 15 + 16: gzip header and trailer
+    if (format == Compression::Gzip &&
+        deflateInit2(&zs_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      throw std::runtime_error("Cannot start the gzip encoder");
+    }
+#endif
+#ifdef JQCPP_HAVE_ZSTD
+    if (format == Compression::Zstd) {
+      zstd_ = ZSTD_createCStream();
+      if (zstd_ == nullptr) {
+        throw std::runtime_error("Cannot start the zstd encoder");
+      }
+    }
+#endif
+    setp(in_.data(), in_.data() + in_.size());
+  }
+
+  ~Encoder() override {
+#ifdef JQCPP_HAVE_ZLIB
+    if (format_ == Compression::Gzip) {
+      deflateEnd(&zs_);
+    }
+#endif
+#ifdef JQCPP_HAVE_ZSTD
+    ZSTD_freeCStream(zstd_);
+#endif
+  }
+
+  void finish() {
+    if (finished_) {
+      return;
+    }
+    finished_ = true;
+    compress(true);
+    sink_.flush();
+  }
+
+protected:
+  int_type overflow(int_type c) override {
+    compress(false);
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int sync() override {
+    if (!finished_) {
+      compress(false);
+    }
+    sink_.flush();
+    return 0;
+  }
+
+private:
+  // compress the put area, with end also the end of the stream
+  void compress(bool end) {
+    std::size_t size = static_cast<std::size_t>(pptr() - pbase());
+#ifdef JQCPP_HAVE_ZLIB
+    if (format_ == Compression::Gzip) {
+      zs_.next_in = reinterpret_cast<Bytef *>(pbase());
+      zs_.avail_in = static_cast<uInt>(size);
+      do {
+        zs_.next_out = reinterpret_cast<Bytef *>(out_.data());
+        zs_.avail_out = static_cast<uInt>(out_.size());
+        if (deflate(&zs_, end ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR) {
+          throw std::runtime_error("gzip compression failed");
+        }
+        sink_.write(out_.data(), static_cast<std::streamsize>(
+                                     out_.size() - zs_.avail_out));
+      } while (zs_.avail_out == 0);
+    }
+#endif
+#ifdef JQCPP_HAVE_ZSTD
+    if (format_ == Compression::Zstd) {
+      ZSTD_inBuffer input{pbase(), size, 0};
+      bool done = false;
+      while (!done) {
+        ZSTD_outBuffer output{out_.data(), out_.size(), 0};
+        std::size_t left = ZSTD_compressStream2(
+            zstd_, &output, &input, end ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(left)) {
+          throw std::runtime_error(std::string("zstd compression failed: ") +
+                                   ZSTD_getErrorName(left));
+        }
+        sink_.write(out_.data(), static_cast<std::streamsize>(output.pos));
+        done = end ? left == 0 : input.pos == input.size;
+      }
+    }
+#endif
+    (void)size;
+    setp(in_.data(), in_.data() + in_.size());
+  }
+
+  std::ostream &sink_;
+  Compression format_;
+  std::string in_;
+  std::string out_;
+  bool finished_ = false;
+#ifdef JQCPP_HAVE_ZLIB
+  z_stream zs_{};
+#endif
+#ifdef JQCPP_HAVE_ZSTD
+  ZSTD_CStream *zstd_ = nullptr;
+#endif
+};
+
+CompressingOutput::CompressingOutput(std::ostream &sink, Compression format)
+    : std::ostream(nullptr),
+      encoder_(std::make_unique<Encoder>(sink, format)) {
+  rdbuf(encoder_.get());
+}
+
+CompressingOutput::~CompressingOutput() {
+  try {
+    finish();
+  } catch (...) {
+    // nothing sensible to do in a destructor
+  }
+}
+
+void CompressingOutput::finish() {
+  std::ostream::flush();
+  encoder_->finish();
+}
+
+} // namespace jqcpp
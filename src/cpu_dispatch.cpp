@@ -0,0 +1,129 @@
+#include "jqcpp/cpu_dispatch.hpp"
+#include <mutex>
+#include <stdexcept>
+
+namespace jqcpp::json {
+
+namespace {
+
+constexpr int kLevels = static_cast<int>(SimdLevel::Avx512) + 1;
+
+const char *const kLevelNames[kLevels] = {"scalar", "sse2", "ssse3", "avx2",
+                                          "avx512"};
+
+detail::SimdKernels tables[kLevels];
+std::once_flag tables_filled;
+
+// fill the tables of the supported levels and bind the best one
+const detail::SimdKernels &bind_detected() {
+  std::call_once(tables_filled, [] {
+    int best = static_cast<int>(detected_simd_level());
+    for (int level = 0; level <= best; ++level) {
+      detail::bind_string_kernels(static_cast<SimdLevel>(level),
+                                  tables[level]);
+      detail::bind_utf8_kernels(static_cast<SimdLevel>(level), tables[level]);
+    }
+    detail::active_kernels.store(&tables[best], std::memory_order_release);
+  });
+  return detail::kernels();
+}
+
+std::size_t resolve_find_escape_char(std::string_view s) {
+  return bind_detected().find_escape_char(s);
+}
+
+std::size_t resolve_find_string_end(std::string_view s, bool &ascii) {
+  return bind_detected().find_string_end(s, ascii);
+}
+
+std::size_t resolve_find_non_ascii(std::string_view s) {
+  return bind_detected().find_non_ascii(s);
+}
+
+bool resolve_is_utf8(std::string_view s) { return bind_detected().is_utf8(s); }
+
+constexpr detail::SimdKernels resolvers = {
+    resolve_find_escape_char, resolve_find_string_end,
+    resolve_find_non_ascii, resolve_is_utf8};
+
+} // namespace
+
+namespace detail {
+std::atomic<const SimdKernels *> active_kernels{&resolvers};
+} // namespace detail
+
+SimdLevel detected_simd_level() {
+#if defined(JQCPP_X86_DISPATCH)
+  static const SimdLevel level = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512bw")) {
+      return SimdLevel::Avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      return SimdLevel::Avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+      return SimdLevel::Ssse3;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+      return SimdLevel::Sse2;
+    }
+    return SimdLevel::Scalar;
+  }();
+  return level;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel simd_level() {
+  const detail::SimdKernels *active = &bind_detected();
+  return static_cast<SimdLevel>(active - tables);
+}
+
+void set_simd_level(SimdLevel level) {
+  if (level > detected_simd_level()) {
+    throw std::invalid_argument(std::string("This CPU does not support ") +
+                                simd_level_name(level));
+  }
+  bind_detected();
+  detail::active_kernels.store(&tables[static_cast<int>(level)],
+                               std::memory_order_release);
+}
+
+const char *simd_level_name(SimdLevel level) {
+  return kLevelNames[static_cast<int>(level)];
+}
+
+bool parse_simd_level(const std::string &name, SimdLevel &level) {
+  for (int i = 0; i < kLevels; ++i) {
+    if (name == kLevelNames[i]) {
+      level = static_cast<SimdLevel>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string cpu_feature_names() {
+  std::string names;
+#if defined(JQCPP_X86_DISPATCH)
+  __builtin_cpu_init();
+  auto add = [&names](const char *name, bool supported) {
+    if (supported) {
+      names += names.empty() ? "" : " ";
+      names += name;
+    }
+  };
+  add("sse2", __builtin_cpu_supports("sse2"));
+  add("ssse3", __builtin_cpu_supports("ssse3"));
+  add("sse4.2", __builtin_cpu_supports("sse4.2"));
+  add("avx2", __builtin_cpu_supports("avx2"));
+  add("avx512f", __builtin_cpu_supports("avx512f"));
+  add("avx512bw", __builtin_cpu_supports("avx512bw"));
+#endif
+  return names;
+}
+
+} // namespace jqcpp::json
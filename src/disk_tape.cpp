@@ -0,0 +1,84 @@
+#include "jqcpp/disk_tape.hpp"
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+
+namespace jqcpp::json {
+
+namespace {
+
+// a new name in the temporary directory
+std::string temporary_path(const std::string &suffix) {
+  std::random_device random;
+  auto dir = std::filesystem::temp_directory_path();
+  while (true) {
+    auto path = dir / ("jqcpp-" + std::to_string(random()) + suffix);
+    if (!std::filesystem::exists(path)) {
+      return path.string();
+    }
+  }
+}
+
+} // namespace
+
+DiskTape::DiskTape(std::size_t budget)
+    : words_path_(temporary_path(".words")),
+      strings_path_(temporary_path(".strings")) {
+  words_.open(words_path_, std::ios::binary | std::ios::trunc);
+  strings_.open(strings_path_, std::ios::binary | std::ios::trunc);
+  if (!words_ || !strings_) {
+    std::error_code ignored;
+    std::filesystem::remove(words_path_, ignored);
+    std::filesystem::remove(strings_path_, ignored);
+    throw std::runtime_error("Cannot create the tape files in " +
+                             std::filesystem::temp_directory_path().string());
+  }
+  builder_.spill_to(*this, budget);
+}
+
+DiskTape::~DiskTape() {
+  words_file_.reset();
+  strings_file_.reset();
+  words_.close();
+  strings_.close();
+  std::error_code ignored;
+  std::filesystem::remove(words_path_, ignored);
+  std::filesystem::remove(strings_path_, ignored);
+}
+
+void DiskTape::write(const Tape &piece) {
+  words_.write(reinterpret_cast<const char *>(piece.words.data()),
+               static_cast<std::streamsize>(piece.words.size() *
+                                            sizeof(std::uint64_t)));
+  strings_.write(piece.strings.data(),
+                 static_cast<std::streamsize>(piece.strings.size()));
+  if (!words_ || !strings_) {
+    throw std::runtime_error("Cannot write the tape files, is the disk full?");
+  }
+}
+
+void DiskTape::patch(std::size_t index, std::uint64_t word) {
+  words_.seekp(static_cast<std::streamoff>(index * sizeof(word)));
+  words_.write(reinterpret_cast<const char *>(&word), sizeof(word));
+  words_.seekp(0, std::ios::end);
+  if (!words_) {
+    throw std::runtime_error("Cannot write the tape files");
+  }
+}
+
+const TapeView &DiskTape::finish() {
+  write(builder_.take());
+  words_.close();
+  strings_.close();
+  if (!words_ || !strings_) {
+    throw std::runtime_error("Cannot write the tape files, is the disk full?");
+  }
+  words_file_ = std::make_unique<MappedFile>(words_path_);
+  strings_file_ = std::make_unique<MappedFile>(strings_path_);
+  tape_.words = reinterpret_cast<const std::uint64_t *>(words_file_->data());
+  tape_.size = words_file_->size() / sizeof(std::uint64_t);
+  tape_.strings = strings_file_->view();
+  return tape_;
+}
+
+} // namespace jqcpp::json
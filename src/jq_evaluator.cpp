@@ -1,9 +1,25 @@
 // jq_evaluator.cpp
 #include "jqcpp/jq_evaluator.hpp"
 #include "jqcpp/jq_ast_node.hpp"
+#include "jqcpp/json_stream.hpp"
+#include "jqcpp/number_format.hpp"
+#include "jqcpp/utf8.hpp"
 
 namespace jqcpp {
 
+namespace {
+
+// integers are kept exact, like the numbers of the input
+json::JSONValue number_literal(const std::string &text) {
+  std::int64_t integer;
+  if (json::parse_integer(text, integer)) {
+    return json::JSONValue(integer);
+  }
+  return json::JSONValue(std::stod(text));
+}
+
+} // namespace
+
 json::JSONValue JQEvaluator::evaluate(const ASTNode &node,
                                       const json::JSONValue &input) {
   contextStack.push(&input);
@@ -118,7 +134,7 @@ json::JSONValue JQEvaluator::visitAddition(const AdditionNode &node) {
   auto left = node.left->accept(*this);
   auto right = node.right->accept(*this);
   if (left.is_number() && right.is_number()) {
-    return json::JSONValue(left.get_number() + right.get_number());
+    return json::add_numbers(left, right);
   }
   throw std::runtime_error("Addition is only supported for numbers");
 }
@@ -127,7 +143,7 @@ json::JSONValue JQEvaluator::visitSubtraction(const SubtractionNode &node) {
   auto left = node.left->accept(*this);
   auto right = node.right->accept(*this);
   if (left.is_number() && right.is_number()) {
-    return json::JSONValue(left.get_number() - right.get_number());
+    return json::subtract_numbers(left, right);
   }
   throw std::runtime_error("Subtraction is only supported for numbers");
 }
@@ -135,13 +151,13 @@ json::JSONValue JQEvaluator::visitSubtraction(const SubtractionNode &node) {
 json::JSONValue JQEvaluator::visitLength(const LengthNode &node) {
   if (currentContext().is_array()) {
     return json::JSONValue(
-        static_cast<double>(currentContext().get_array().size()));
+        static_cast<std::int64_t>(currentContext().get_array().size()));
   } else if (currentContext().is_string()) {
-    return json::JSONValue(
-        static_cast<double>(currentContext().get_string().length()));
+    return json::JSONValue(static_cast<std::int64_t>(
+        json::count_code_points(currentContext().get_string())));
   } else if (currentContext().is_object()) {
     return json::JSONValue(
-        static_cast<double>(currentContext().get_object().size()));
+        static_cast<std::int64_t>(currentContext().get_object().size()));
   }
   throw std::runtime_error(
       "Length is only supported for arrays, strings, and objects");
@@ -152,7 +168,7 @@ json::JSONValue JQEvaluator::visitKeys(const KeysNode &node) {
     const auto &arr = currentContext().get_array();
     json::JSONArray keys;
     for (std::size_t i = 0; i < arr.size(); ++i) {
-      keys.push_back(json::JSONValue(static_cast<double>(i)));
+      keys.push_back(json::JSONValue(static_cast<std::int64_t>(i)));
     }
     return json::JSONValue(std::move(keys));
 
@@ -177,11 +193,57 @@ json::JSONValue JQEvaluator::visitPipe(const PipeNode &node) {
 }
 
 json::JSONValue JQEvaluator::visitLiteral(const LiteralNode &node) {
-  return json::JSONValue(std::stod(node.value));
+  return number_literal(node.value);
 }
 
 json::JSONValue JQEvaluator::visitNumberLiteral(const NumberLiteralNode &node) {
-  return json::JSONValue(std::move(node.value));
+  return number_literal(node.value);
+}
+
+json::JSONValue JQEvaluator::visitToStream(const ToStreamNode &) {
+  json::JSONArray events;
+  json::StreamEventBuilder builder(
+      [&events](json::JSONValue event) { events.push_back(std::move(event)); });
+  builder.on_value(currentContext());
+  return json::JSONValue(std::move(events));
+}
+
+json::JSONValue JQEvaluator::visitFromStream(const FromStreamNode &node) {
+  auto events = node.left->accept(*this);
+  if (!events.is_array()) {
+    throw std::runtime_error("fromstream expects an array of events");
+  }
+  // every completed value is an output, collected like .[]
+  json::JSONArray values;
+  json::StreamValueBuilder builder;
+  json::JSONValue value;
+  for (const auto &event : events.get_array()) {
+    if (builder.add(event, value)) {
+      values.push_back(std::move(value));
+    }
+  }
+  return json::JSONValue(std::move(values));
+}
+
+json::JSONValue
+JQEvaluator::visitTruncateStream(const TruncateStreamNode &node) {
+  auto depth = node.left->accept(*this);
+  if (!depth.is_number() || depth.get_number() < 0) {
+    throw std::runtime_error("truncate_stream depth must be a number");
+  }
+  const auto &input = currentContext();
+  if (!input.is_array()) {
+    throw std::runtime_error("truncate_stream expects stream events");
+  }
+  auto depth_value = static_cast<std::size_t>(depth.get_number());
+  if (json::is_stream_event(input)) {
+    // a single event, e.g. one input of --stream
+    json::JSONArray events;
+    events.push_back(input.deepCopy());
+    return json::JSONValue(json::truncate_stream_events(events, depth_value));
+  }
+  return json::JSONValue(
+      json::truncate_stream_events(input.get_array(), depth_value));
 }
 
 } // namespace jqcpp
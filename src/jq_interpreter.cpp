@@ -1,11 +1,36 @@
 // jq_interpreter.cpp
 #include "jqcpp/jq_interpreter.hpp"
+#include "jqcpp/cbor.hpp"
+#include "jqcpp/disk_tape.hpp"
+#include "jqcpp/compression.hpp"
+#include "jqcpp/cpu_dispatch.hpp"
 #include "jqcpp/jq_lex.hpp"
 #include "jqcpp/json_parser.hpp"
+#include "jqcpp/json_sax.hpp"
+#include "jqcpp/json_stream.hpp"
 #include "jqcpp/json_tokenizer.hpp"
+#include "jqcpp/json_validator.hpp"
+#include "jqcpp/mapped_file.hpp"
+#include "jqcpp/msgpack.hpp"
+#include "jqcpp/offset_index.hpp"
+#include "jqcpp/output_buffer.hpp"
+#include "jqcpp/parallel_parser.hpp"
 #include "jqcpp/pretty_printer.hpp"
+#include "jqcpp/snapshot.hpp"
+#include "jqcpp/spsc_queue.hpp"
+#include "jqcpp/utf8.hpp"
+#include "jqcpp/work_stealing_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 namespace jqcpp {
 
@@ -17,6 +42,150 @@ json::JSONValue JQInterpreter::execute(const std::string &jqExpression,
   return evaluator.evaluate(*ast, input);
 }
 
+json::JSONValue JQInterpreter::execute(const json::JSONValue &input) {
+  return evaluator.evaluate(compiled(), input);
+}
+
+const ASTNode &JQInterpreter::compiled() {
+  if (!ast_) {
+    JQLexer lexer;
+    ast_ = parser.parse(lexer.tokenize(expr_));
+  }
+  return *ast_;
+}
+
+namespace {
+
+// if ast starts with .[] over its input, replace that iterator by .
+bool strip_iterator(std::unique_ptr<ASTNode> &ast) {
+  // follow the nodes whose other operands do not read the original input,
+  // the first node evaluated is at the bottom of that chain
+  std::unique_ptr<ASTNode> *slot = &ast;
+  std::unique_ptr<ASTNode> *parent = nullptr;
+  while (true) {
+    ASTNode &node = **slot;
+    std::unique_ptr<ASTNode> *next = nullptr;
+    if (node.type == ASTNodeType::ArraySlice) {
+      next = &static_cast<ArraySliceNode &>(node).array;
+    } else if (node.type == ASTNodeType::Pipe ||
+               node.type == ASTNodeType::ObjectAccess ||
+               node.type == ASTNodeType::ArrayIndex ||
+               node.type == ASTNodeType::ObjectIterator) {
+      next = &node.left;
+    }
+    if (next == nullptr || !*next) {
+      break;
+    }
+    parent = slot;
+    slot = next;
+  }
+  if (parent == nullptr || (*slot)->type != ASTNodeType::Identity ||
+      (*parent)->type != ASTNodeType::ObjectIterator) {
+    return false;
+  }
+  // .[] becomes ., the rest of the filter is unchanged
+  *parent = std::make_unique<IdentityNode>();
+  return true;
+}
+
+} // namespace
+
+bool JQInterpreter::strip_root_iterator() {
+  compiled();
+  if (!root_iterates_) {
+    root_iterates_ = strip_iterator(ast_);
+  }
+  return *root_iterates_;
+}
+
+bool JQInterpreter::iterates_after_path() {
+  split_root_path();
+  if (!rest_iterates_) {
+    rest_iterates_ = strip_iterator(rest_ast_);
+  }
+  return *rest_iterates_;
+}
+
+const std::vector<PathStep> &JQInterpreter::root_path() {
+  split_root_path();
+  return root_path_;
+}
+
+json::JSONValue
+JQInterpreter::execute_after_path(const json::JSONValue &selected) {
+  split_root_path();
+  return evaluator.evaluate(*rest_ast_, selected);
+}
+
+const ASTNode &JQInterpreter::after_path() {
+  split_root_path();
+  return *rest_ast_;
+}
+
+void JQInterpreter::split_root_path() {
+  if (rest_ast_) {
+    return;
+  }
+  JQLexer lexer;
+  rest_ast_ = parser.parse(lexer.tokenize(expr_));
+  // the chain of nodes evaluated first, as in strip_root_iterator()
+  std::vector<std::unique_ptr<ASTNode> *> chain = {&rest_ast_};
+  while (true) {
+    ASTNode &node = **chain.back();
+    std::unique_ptr<ASTNode> *next = nullptr;
+    if (node.type == ASTNodeType::ArraySlice) {
+      next = &static_cast<ArraySliceNode &>(node).array;
+    } else if (node.type == ASTNodeType::Pipe ||
+               node.type == ASTNodeType::ObjectAccess ||
+               node.type == ASTNodeType::ArrayIndex ||
+               node.type == ASTNodeType::ObjectIterator) {
+      next = &node.left;
+    }
+    if (next == nullptr || !*next) {
+      break;
+    }
+    chain.push_back(next);
+  }
+  if ((*chain.back())->type != ASTNodeType::Identity) {
+    return;
+  }
+  // the steps right above the identity, in the order they are evaluated
+  std::size_t top = chain.size() - 1;
+  while (top > 0) {
+    const ASTNode &node = **chain[top - 1];
+    if (node.type == ASTNodeType::ObjectAccess && node.right &&
+        node.right->type == ASTNodeType::Field) {
+      root_path_.push_back(
+          {PathStep::Kind::Key, node.right->value, std::nullopt, std::nullopt});
+    } else if (node.type == ASTNodeType::ArrayIndex && node.right &&
+               node.right->type == ASTNodeType::Literal) {
+      root_path_.push_back(
+          {PathStep::Kind::Index, "", std::stod(node.right->value),
+           std::nullopt});
+    } else if (node.type == ASTNodeType::ArraySlice) {
+      const auto &slice = static_cast<const ArraySliceNode &>(node);
+      auto bound = [](const std::unique_ptr<ASTNode> &literal) {
+        return literal ? std::optional<double>(std::stod(literal->value))
+                       : std::nullopt;
+      };
+      if ((slice.start && slice.start->type != ASTNodeType::Literal) ||
+          (slice.end && slice.end->type != ASTNodeType::Literal)) {
+        break;
+      }
+      root_path_.push_back(
+          {PathStep::Kind::Slice, "", bound(slice.start), bound(slice.end)});
+      --top;
+      break;
+    } else {
+      break;
+    }
+    --top;
+  }
+  if (top < chain.size() - 1) {
+    *chain[top] = std::make_unique<IdentityNode>();
+  }
+}
+
 std::string read_json_input(std::istream &input) {
   std::string line;
   std::string json;
@@ -28,16 +197,92 @@ std::string read_json_input(std::istream &input) {
 
 void print_version(std::ostream &output) { output << "jqcpp version 1.0.0\n"; }
 
+void print_cpu_features(std::ostream &output) {
+  std::string features = json::cpu_feature_names();
+  output << "cpu features: " << (features.empty() ? "none" : features)
+         << "\nbest level: "
+         << json::simd_level_name(json::detected_simd_level())
+         << "\nkernels: " << json::simd_level_name(json::simd_level())
+         << "\n";
+}
+
 void print_help(std::ostream &output) {
   output
       << "Usage: jqcpp [options] <expression> [input-file]\n"
       << "\nOptions:\n"
       << "  -h, --help     Display this help information\n"
       << "  -v, --version  Show version information\n"
+      << "  -c, --compact-output\n"
+      << "                 Print each result on a single line\n"
+      << "  -r, --raw-output\n"
+      << "                 Write string results without quotes and escapes\n"
+      << "  -j, --join-output\n"
+      << "                 Like -r, and no newline after each result\n"
+      << "  --indent N     Indent nested values by N spaces (0-7, default 2)\n"
+      << "  --tab          Indent nested values with one tab per level\n"
+      << "  --stream       Run the filter on each [path, leaf] event of the\n"
+      << "                 input instead of the whole document\n"
+      << "  --stream-array Run a filter starting with .[] on each element of\n"
+      << "                 the top level array while it is read, one result\n"
+      << "                 per element\n"
+      << "  --parallel-parse\n"
+      << "                 Parse a large top level array on several threads\n"
+      << "  --threads N    Number of worker threads (default: one per core)\n"
+      << "  --pipeline     Read, parse, evaluate and write on separate "
+         "threads\n"
+      << "  --compress FORMAT\n"
+      << "                 Compress the output with gzip or zstd, compressed "
+         "input is\n"
+      << "                 always detected and decoded\n"
+      << "  --files-from FILE\n"
+      << "                 Also read the input files listed in FILE, one per "
+         "line (- for stdin)\n"
+      << "  --unordered    With several input files, write the results of "
+         "each file\n"
+      << "                 as soon as it is done instead of in argument "
+         "order\n"
+      << "  --save-snapshot FILE\n"
+      << "                 Also save the parsed input to FILE, later runs "
+         "map it\n"
+      << "                 instead of parsing the JSON again\n"
+      << "  --build-index  Write an offset index of the input file to "
+         "FILE.jqidx, later\n"
+      << "                 runs of a filter starting with .key, .[n] or "
+         ".[a:b] only\n"
+      << "                 parse the selected values of the file\n"
+      << "  --memory-budget SIZE\n"
+      << "                 Keep at most about SIZE bytes (K, M or G) of the "
+         "parsed input\n"
+      << "                 in memory and the rest in temporary files\n"
+      << "  --max-depth N  Reject input nested deeper than N arrays and "
+         "objects\n"
+      << "                 (default 10000)\n"
+      << "  --lazy-numbers Keep numbers as written in the input, they are "
+         "printed\n"
+      << "                 unchanged and only converted for arithmetic\n"
+      << "  --validate     Only check that the input files (or stdin) are "
+         "valid JSON,\n"
+      << "                 no filter is given. The first error of each "
+         "invalid input\n"
+      << "                 is reported with its byte offset\n"
+      << "  --cpu-features Show the CPU features found and the instruction "
+         "set the\n"
+      << "                 vectorized kernels use, then exit\n"
+      << "  --simd-level LEVEL\n"
+      << "                 Use the scalar, sse2, ssse3, avx2 or avx512 "
+         "kernels instead\n"
+      << "                 of the best ones this CPU supports\n"
+      << "  --input-format FORMAT\n"
+      << "                 Read the input as json (default), msgpack or "
+         "cbor\n"
+      << "  --output-format FORMAT\n"
+      << "                 Write the results as json (default), msgpack or "
+         "cbor\n"
       << "\nInput Methods:\n"
       << "  1. Piping JSON data:    echo '{\"key\": \"value\"}' | jqcpp "
          "'<expression>'\n"
       << "  2. Reading from file:   jqcpp '<expression>' input.json\n"
+      << "     Several files:       jqcpp '<expression>' a.json b.json ...\n"
       << "  3. Interactive mode:    jqcpp '<expression>' (then type JSON and "
          "press Ctrl+D)\n"
       << "\nExpression Syntax:\n"
@@ -55,6 +300,10 @@ void print_help(std::ostream &output) {
       << "                   Example: echo '[10, 20, 30, 40]' | jqcpp "
          "'.[1:3]'\n"
       << "\n"
+      << "  a | b            Pipe (run b on the output of a)\n"
+      << "                   Example: echo '{\"user\": {\"name\": \"Alice\"}}' "
+         "| jqcpp '.user | .name'\n"
+      << "\n"
       << "  + -              Arithmetic Operations\n"
       << "                   Example: echo '{\"x\": 10, \"y\": 5}' | jqcpp '.x "
          "+ .y'\n"
@@ -64,59 +313,1469 @@ void print_help(std::ostream &output) {
       << "  keys             Returns an array of an object's keys\n"
       << "                   Example: echo '{\"a\": 1, \"b\": 2}' | jqcpp "
          "'keys'\n"
+      << "  tostream         Returns the [path, leaf] events of the input\n"
+      << "  fromstream(f)    Returns the values rebuilt from the events of f\n"
+      << "  truncate_stream(depth)\n"
+      << "                   Removes depth path components from the input "
+         "events\n"
+      << "                   Example: echo '{\"a\": [1]}' | jqcpp "
+         "'tostream | truncate_stream(1)'\n"
       << "\nFor more information and examples, visit: "
          "https://github.com/yourusername/jqcpp\n";
 }
 
+// encoding of the input or of the results
+enum class DataFormat { Json, MsgPack, Cbor };
+
+// "json", "msgpack" or "cbor", false for anything else
+bool parse_data_format(const std::string &name, DataFormat &format) {
+  if (name == "json") {
+    format = DataFormat::Json;
+  } else if (name == "msgpack") {
+    format = DataFormat::MsgPack;
+  } else if (name == "cbor") {
+    format = DataFormat::Cbor;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// a number of bytes with an optional K, M or G suffix, false for anything
+// else or 0
+bool parse_size(const std::string &text, std::size_t &size) {
+  std::size_t digits = text.find_first_not_of("0123456789");
+  if (text.empty() || digits == 0 || text.size() > 10) {
+    return false;
+  }
+  std::size_t unit = 1;
+  if (digits != std::string::npos) {
+    if (digits + 1 != text.size()) {
+      return false;
+    }
+    switch (text[digits]) {
+    case 'K':
+      unit = std::size_t{1} << 10;
+      break;
+    case 'M':
+      unit = std::size_t{1} << 20;
+      break;
+    case 'G':
+      unit = std::size_t{1} << 30;
+      break;
+    default:
+      return false;
+    }
+  }
+  size = std::stoull(text.substr(0, digits)) * unit;
+  return size != 0;
+}
+
+// options collected from the command line
+struct CommandLineOptions {
+  std::string expression;
+  std::vector<std::string> input_files;
+  // file with more input paths, one per line, - for stdin
+  std::string files_from;
+  // write the results of several files as they finish
+  bool unordered = false;
+  // compression of the output
+  Compression compress = Compression::None;
+  // write the parsed input to this snapshot file
+  std::string save_snapshot;
+  // write the offset index of the input file first
+  bool build_index = false;
+  // bytes of the parsed input kept in memory, the rest goes to temporary
+  // files, 0 keeps it all in memory
+  std::size_t memory_budget = 0;
+  DataFormat input_format = DataFormat::Json;
+  DataFormat output_format = DataFormat::Json;
+  json::PrintOptions print;
+  // strings are written without quotes and escapes
+  bool raw_output = false;
+  // like raw_output, and no newline after each result
+  bool join_output = false;
+  // split a top level array across worker threads
+  bool parallel_parse = false;
+  // worker threads, 0 means one per core
+  unsigned threads = 0;
+  // run a filter starting with .[] on one array element at a time
+  bool stream_array = false;
+  // run the filter on the [path, leaf] events of the input
+  bool stream_events = false;
+  // JSON numbers are kept as their text until their value is needed
+  bool lazy_numbers = false;
+  // the deepest nesting of arrays and objects accepted in JSON input
+  std::size_t max_depth = json::kDefaultMaxDepth;
+  // read, parse, evaluate and write on separate threads
+  bool pipeline = false;
+  // only check that the inputs are valid JSON, there is no filter
+  bool validate = false;
+  // print the CPU features and the bound kernels, then exit
+  bool cpu_features = false;
+};
+
+// parse the command line, returns -1 when jqcpp should go on running,
+// otherwise the exit code
+int parse_arguments(int argc, char *argv[], std::ostream &output,
+                    CommandLineOptions &options) {
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      print_help(output);
+      return 0;
+    }
+    if (arg == "-v" || arg == "--version") {
+      print_version(output);
+      return 0;
+    }
+    if (arg == "-c" || arg == "--compact-output") {
+      options.print.compact = true;
+    } else if (arg == "-r" || arg == "--raw-output") {
+      options.raw_output = true;
+    } else if (arg == "-j" || arg == "--join-output") {
+      options.raw_output = true;
+      options.join_output = true;
+    } else if (arg == "--stream") {
+      options.stream_events = true;
+    } else if (arg == "--stream-array") {
+      options.stream_array = true;
+    } else if (arg == "--files-from") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --files-from takes a file name\n";
+        return 1;
+      }
+      options.files_from = argv[++i];
+    } else if (arg == "--save-snapshot") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --save-snapshot takes a file name\n";
+        return 1;
+      }
+      options.save_snapshot = argv[++i];
+    } else if (arg == "--max-depth") {
+      std::string depth = i + 1 < argc ? argv[++i] : "";
+      if (depth.empty() || depth.size() > 9 ||
+          depth.find_first_not_of("0123456789") != std::string::npos ||
+          std::stoul(depth) == 0) {
+        std::cerr << "Error: --max-depth takes a positive number\n";
+        return 1;
+      }
+      options.max_depth = std::stoul(depth);
+    } else if (arg == "--lazy-numbers") {
+      options.lazy_numbers = true;
+    } else if (arg == "--validate") {
+      options.validate = true;
+    } else if (arg == "--cpu-features") {
+      options.cpu_features = true;
+    } else if (arg == "--simd-level") {
+      json::SimdLevel level;
+      if (i + 1 >= argc || !json::parse_simd_level(argv[++i], level)) {
+        std::cerr << "Error: --simd-level takes scalar, sse2, ssse3, avx2 or "
+                     "avx512\n";
+        return 1;
+      }
+      try {
+        json::set_simd_level(level);
+      } catch (const std::invalid_argument &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+      }
+    } else if (arg == "--build-index") {
+      options.build_index = true;
+    } else if (arg == "--memory-budget") {
+      if (i + 1 >= argc || !parse_size(argv[++i], options.memory_budget)) {
+        std::cerr << "Error: --memory-budget takes a size like 512M\n";
+        return 1;
+      }
+    } else if (arg == "--compress") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --compress takes gzip or zstd\n";
+        return 1;
+      }
+      std::string format = argv[++i];
+      if (format != "gzip" && format != "zstd") {
+        std::cerr << "Error: --compress takes gzip or zstd\n";
+        return 1;
+      }
+      options.compress = parse_compression(format);
+      if (!compression_supported(options.compress)) {
+        std::cerr << "Error: " << format
+                  << " output is not supported by this build\n";
+        return 1;
+      }
+    } else if (arg == "--input-format" || arg == "--output-format") {
+      DataFormat &format = arg == "--input-format" ? options.input_format
+                                                   : options.output_format;
+      if (i + 1 >= argc || !parse_data_format(argv[++i], format)) {
+        std::cerr << "Error: " << arg << " takes json, msgpack or cbor\n";
+        return 1;
+      }
+    } else if (arg == "--unordered") {
+      options.unordered = true;
+    } else if (arg == "--pipeline") {
+      options.pipeline = true;
+    } else if (arg == "--parallel-parse") {
+      options.parallel_parse = true;
+    } else if (arg == "--threads") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --threads takes a number\n";
+        return 1;
+      }
+      std::string count = argv[++i];
+      if (count.empty() || count.size() > 4 ||
+          count.find_first_not_of("0123456789") != std::string::npos) {
+        std::cerr << "Error: --threads takes a number\n";
+        return 1;
+      }
+      options.threads = static_cast<unsigned>(std::stoul(count));
+    } else if (arg == "--tab") {
+      options.print.use_tab = true;
+    } else if (arg == "--indent") {
+      if (i + 1 >= argc) {
+        std::cerr << "Error: --indent takes a number\n";
+        return 1;
+      }
+      std::string width = argv[++i];
+      if (width.empty() ||
+          width.find_first_not_of("0123456789") != std::string::npos ||
+          width.size() > 1 || width[0] > '7') {
+        std::cerr << "Error: --indent takes a number between 0 and 7\n";
+        return 1;
+      }
+      options.print.indent_width = width[0] - '0';
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      std::cerr << "Error: Unknown option " << arg << "\n";
+      return 1;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+
+  if (options.cpu_features) {
+    print_cpu_features(output);
+    return 0;
+  }
+  if (options.validate) {
+    // every argument is an input file
+    options.input_files = positional;
+    return -1;
+  }
+  if (positional.empty()) {
+    print_help(std::cerr);
+    return 1;
+  }
+  options.expression = positional[0];
+  options.input_files.assign(positional.begin() + 1, positional.end());
+  return -1;
+}
+
+// write one result of the filter followed by its separator
+void write_result(const json::JSONValue &result, json::JSONPrinter &printer,
+                  json::OutputBuffer &out, const CommandLineOptions &options) {
+  if (options.output_format == DataFormat::MsgPack) {
+    // values are self delimiting, no separator
+    json::MsgPackWriter().write(result, out);
+    return;
+  }
+  if (options.output_format == DataFormat::Cbor) {
+    json::CBORWriter().write(result, out);
+    return;
+  }
+  if (options.raw_output && result.is_string()) {
+    // decoded bytes go straight to the buffer
+    out.append(result.get_string());
+  } else {
+    printer.print(result, out);
+  }
+  if (!options.join_output) {
+    out.append('\n');
+  }
+}
+
+// --stream-array: the filter has its leading .[] stripped and runs on each
+// element of the top level array as soon as that element is parsed
+void run_stream_array(std::istream &in, JQInterpreter &interpreter,
+                      json::JSONPrinter &printer, json::OutputBuffer &out,
+                      const CommandLineOptions &options) {
+  json::JSONArrayStream stream(in, 64 * 1024, options.max_depth);
+  stream.set_lazy_numbers(options.lazy_numbers);
+  if (stream.open()) {
+    json::JSONValue element;
+    while (stream.next(element)) {
+      write_result(interpreter.execute(element), printer, out, options);
+      out.maybe_flush();
+    }
+    return;
+  }
+  // not an array, iterate over the values of the whole document
+  json::JSONTokenizer lexer;
+  json::JSONParser parser(options.max_depth);
+  parser.set_lazy_numbers(options.lazy_numbers);
+  auto tokens = lexer.tokenize(stream.remaining());
+  auto document = parser.parse(tokens);
+  if (!parser.finished()) {
+    throw json::JSONParserError("Unexpected data after the end of object");
+  }
+  if (!document.is_object()) {
+    throw std::runtime_error(
+        "Cannot iterate over non-object or non-array value");
+  }
+  for (const auto &[key, value] : document.get_object()) {
+    write_result(interpreter.execute(value), printer, out, options);
+    out.maybe_flush();
+  }
+}
+
+// read the next block of the input into chunk, false at the end. Only the
+// first byte waits for the producer, the rest of the block is what is
+// already buffered, so neither a slow producer nor a long line holds the
+// parser back
+bool read_chunk(std::istream &in, std::string &chunk) {
+  constexpr std::size_t kInputChunkSize = 64 * 1024;
+  chunk.resize(kInputChunkSize);
+  in.read(chunk.data(), 1);
+  auto got = static_cast<std::size_t>(in.gcount());
+  if (got > 0) {
+    got += static_cast<std::size_t>(in.readsome(
+        chunk.data() + 1, static_cast<std::streamsize>(kInputChunkSize - 1)));
+  }
+  chunk.resize(got);
+  return got > 0;
+}
+
+// push the input to the parser as it is read, so the documents of a slow
+// producer are handled as soon as they are complete. The output is written
+// out whenever the next read may block.
+void push_input(std::istream &in, json::JSONHandler &handler,
+                json::OutputBuffer &out, const CommandLineOptions &options) {
+  json::JSONSAXParser parser;
+  parser.set_max_depth(options.max_depth);
+  std::string chunk;
+  while (true) {
+    if (in.rdbuf()->in_avail() <= 0) {
+      out.flush();
+    }
+    if (!read_chunk(in, chunk)) {
+      break;
+    }
+    parser.feed(chunk, handler);
+  }
+  parser.finish(handler);
+}
+
+// thrown inside a pipeline stage when the next stage has stopped
+struct StageStopped {};
+
+// --pipeline: the input is read, parsed, evaluated and written by four
+// stages joined by bounded SPSC queues, the writer runs on the calling
+// thread. Each stage closes its output queue when it is done, and its input
+// queue when it fails so the stages before it stop too. The first error in
+// stage order is reported, after the results of the documents before it.
+void run_pipeline(std::istream &in, JQInterpreter &interpreter,
+                  json::JSONPrinter &printer, json::OutputBuffer &out,
+                  const CommandLineOptions &options) {
+  SPSCQueue<std::string> chunks(16);
+  SPSCQueue<json::JSONValue> documents(256);
+  SPSCQueue<json::JSONValue> results(256);
+  std::exception_ptr errors[4];
+
+  std::thread reader([&] {
+    try {
+      std::string chunk;
+      while (read_chunk(in, chunk) && chunks.push(std::move(chunk))) {
+      }
+    } catch (...) {
+      errors[0] = std::current_exception();
+    }
+    chunks.close();
+  });
+
+  std::thread parser([&] {
+    try {
+      auto emit = [&documents](json::JSONValue value) {
+        if (!documents.push(std::move(value))) {
+          throw StageStopped();
+        }
+      };
+      std::unique_ptr<json::JSONHandler> handler;
+      if (options.stream_events) {
+        handler = std::make_unique<json::StreamEventBuilder>(emit);
+      } else {
+        auto builder = std::make_unique<json::JSONValueBuilder>(emit);
+        builder->set_lazy_numbers(options.lazy_numbers);
+        handler = std::move(builder);
+      }
+      json::JSONSAXParser sax;
+      sax.set_max_depth(options.max_depth);
+      std::string chunk;
+      while (chunks.pop(chunk)) {
+        sax.feed(chunk, *handler);
+      }
+      if (!errors[0]) {
+        sax.finish(*handler);
+      }
+    } catch (const StageStopped &) {
+    } catch (...) {
+      errors[1] = std::current_exception();
+    }
+    chunks.close();
+    documents.close();
+  });
+
+  std::thread evaluator([&] {
+    try {
+      json::JSONValue document;
+      while (documents.pop(document) &&
+             results.push(interpreter.execute(document))) {
+      }
+    } catch (...) {
+      errors[2] = std::current_exception();
+    }
+    documents.close();
+    results.close();
+  });
+
+  try {
+    json::JSONValue result;
+    while (true) {
+      // write out before waiting on the other stages
+      if (results.empty()) {
+        out.flush();
+      }
+      if (!results.pop(result)) {
+        break;
+      }
+      write_result(result, printer, out, options);
+      out.maybe_flush();
+    }
+  } catch (...) {
+    errors[3] = std::current_exception();
+    results.close();
+  }
+
+  reader.join();
+  parser.join();
+  evaluator.join();
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+// --stream: the filter runs on each [path, leaf] event of the input, the
+// events are built straight from the parser so no DOM is built
+void run_stream_events(std::istream &in, JQInterpreter &interpreter,
+                       json::JSONPrinter &printer, json::OutputBuffer &out,
+                       const CommandLineOptions &options) {
+  json::StreamEventBuilder builder([&](json::JSONValue event) {
+    write_result(interpreter.execute(event), printer, out, options);
+    out.maybe_flush();
+  });
+  push_input(in, builder, out, options);
+}
+
+// the filter runs on each document of the input as soon as it is parsed
+void run_documents(std::istream &in, JQInterpreter &interpreter,
+                   json::JSONPrinter &printer, json::OutputBuffer &out,
+                   const CommandLineOptions &options) {
+  json::JSONValueBuilder builder([&](json::JSONValue document) {
+    write_result(interpreter.execute(document), printer, out, options);
+    out.maybe_flush();
+  });
+  builder.set_lazy_numbers(options.lazy_numbers);
+  push_input(in, builder, out, options);
+}
+
+// append at least one more byte of binary input to buffer, false at the end.
+// Small reads take what is buffered after the first byte, so the values of
+// a slow producer are not held back. Once an incomplete value is large, as
+// much again is read, so it is rescanned a logarithmic number of times.
+bool read_binary(std::istream &in, std::string &buffer) {
+  constexpr std::size_t kBinaryChunkSize = 64 * 1024;
+  std::size_t used = buffer.size();
+  std::size_t want = std::max(kBinaryChunkSize, used);
+  buffer.resize(used + want);
+  std::size_t got = 0;
+  if (used < kBinaryChunkSize) {
+    in.read(buffer.data() + used, 1);
+    got = static_cast<std::size_t>(in.gcount());
+    if (got > 0) {
+      got += static_cast<std::size_t>(in.readsome(
+          buffer.data() + used + 1, static_cast<std::streamsize>(want - 1)));
+    }
+  } else {
+    in.read(buffer.data() + used, static_cast<std::streamsize>(want));
+    got = static_cast<std::size_t>(in.gcount());
+  }
+  buffer.resize(used + got);
+  return got > 0;
+}
+
+// feed binary input to step as it is read: step(data, pos) handles what it
+// can from pos on and returns false once the next item is incomplete. The
+// output is written out whenever the next read may block, bytes left at the
+// end of the input throw truncated.
+template <typename Step>
+void read_binary_items(std::istream &in, json::OutputBuffer &out,
+                       const char *truncated, Step step) {
+  std::string buffer;
+  std::size_t pos = 0;
+  while (true) {
+    if (step(std::string_view(buffer), pos)) {
+      continue;
+    }
+    buffer.erase(0, pos);
+    pos = 0;
+    if (in.rdbuf()->in_avail() <= 0) {
+      out.flush();
+    }
+    if (!read_binary(in, buffer)) {
+      break;
+    }
+  }
+  if (!buffer.empty()) {
+    throw std::runtime_error(truncated);
+  }
+}
+
+// --input-format msgpack: the input is a sequence of MessagePack values, the
+// filter runs on each one as soon as all its bytes are read
+void run_msgpack(std::istream &in, JQInterpreter &interpreter,
+                 json::JSONPrinter &printer, json::OutputBuffer &out,
+                 const CommandLineOptions &options) {
+  auto handle = [&](json::JSONValue value) {
+    write_result(interpreter.execute(value), printer, out, options);
+    out.maybe_flush();
+  };
+  json::StreamEventBuilder events(handle);
+  json::MsgPackReader reader(options.max_depth);
+  read_binary_items(in, out, "Truncated MessagePack data",
+                    [&](std::string_view data, std::size_t &pos) {
+    if (json::MsgPackReader::find_end(data, pos) == std::string::npos) {
+      return false;
+    }
+    json::JSONValue value = reader.read(data, pos);
+    if (options.stream_events) {
+      events.on_value(value);
+    } else {
+      handle(std::move(value));
+    }
+    return true;
+  });
+}
+
+// --input-format cbor: the input is a CBOR sequence, the filter runs on each
+// item as soon as all its bytes are read. With elements (--stream-array) it
+// runs on each element of the top level arrays instead, which are read one
+// element at a time, so an endless indefinite length array can be filtered.
+void run_cbor(std::istream &in, JQInterpreter &interpreter,
+              json::JSONPrinter &printer, json::OutputBuffer &out,
+              const CommandLineOptions &options, bool elements) {
+  auto handle = [&](json::JSONValue value) {
+    write_result(interpreter.execute(value), printer, out, options);
+    out.maybe_flush();
+  };
+  json::StreamEventBuilder events(handle);
+  json::CBORReader reader(options.max_depth);
+  // with elements: inside a top level array, and its elements left
+  bool in_array = false;
+  bool indefinite = false;
+  std::uint64_t left = 0;
+  read_binary_items(in, out, "Truncated CBOR data",
+                    [&](std::string_view data, std::size_t &pos) {
+    if (in_array) {
+      if (indefinite && pos < data.size() &&
+          static_cast<unsigned char>(data[pos]) == 0xff) {
+        ++pos;
+        in_array = false;
+        return true;
+      }
+      if (!indefinite && left == 0) {
+        in_array = false;
+        return true;
+      }
+    } else if (elements) {
+      std::size_t start = pos;
+      json::CBORReader::Head head;
+      if (!json::CBORReader::read_head(data, start, head)) {
+        return false;
+      }
+      if (head.major == 4) {
+        pos = start;
+        in_array = true;
+        indefinite = head.indefinite;
+        left = head.argument;
+        return true;
+      }
+    }
+    if (json::CBORReader::find_end(data, pos) == std::string::npos) {
+      return false;
+    }
+    json::JSONValue value = reader.read(data, pos);
+    if (in_array) {
+      --left;
+      handle(std::move(value));
+    } else if (elements) {
+      // not an array, iterate over the values of the object
+      if (!value.is_object()) {
+        throw std::runtime_error(
+            "Cannot iterate over non-object or non-array value");
+      }
+      for (const auto &[key, member] : value.get_object()) {
+        write_result(interpreter.execute(member), printer, out, options);
+        out.maybe_flush();
+      }
+    } else if (options.stream_events) {
+      events.on_value(value);
+    } else {
+      handle(std::move(value));
+    }
+    return true;
+  });
+  if (in_array) {
+    throw json::CBORError("Truncated CBOR data");
+  }
+}
+
+// the offset a path step gives, nothing for what the evaluator casts in
+// its own way, e.g. negative or fractional numbers
+std::optional<std::size_t> path_offset(double value) {
+  if (value < 0 || value >= 9007199254740992.0 || std::trunc(value) != value) {
+    return std::nullopt;
+  }
+  return static_cast<std::size_t>(value);
+}
+
+// a JSONValue with the interface of json::TapeRef, for select_path
+class ValueRef {
+public:
+  explicit ValueRef(const json::JSONValue &value) : value_(&value) {}
+
+  bool is_array() const { return value_->is_array(); }
+  bool is_object() const { return value_->is_object(); }
+  std::size_t size() const { return value_->get_array().size(); }
+
+  std::optional<ValueRef> at(std::size_t index) const {
+    const auto &array = value_->get_array();
+    if (index >= array.size()) {
+      return std::nullopt;
+    }
+    return ValueRef(array[index]);
+  }
+  std::optional<ValueRef> find(std::string_view key) const {
+    for (const auto &[name, member] : value_->get_object()) {
+      if (name == key) {
+        return ValueRef(member);
+      }
+    }
+    return std::nullopt;
+  }
+  json::JSONValue slice(std::size_t start, std::size_t end) const {
+    const auto &array = value_->get_array();
+    json::JSONArray elements;
+    for (std::size_t i = start; i < std::min(end, array.size()); ++i) {
+      elements.push_back(array[i].deepCopy());
+    }
+    return json::JSONValue(std::move(elements));
+  }
+  json::JSONValue to_value() const { return value_->deepCopy(); }
+
+private:
+  const json::JSONValue *value_;
+};
+
+// a json::TapeRef for select_path which refuses to build a value whose
+// words alone take more than budget bytes, no limit for a budget of 0
+class BudgetRef {
+public:
+  BudgetRef(json::TapeRef ref, std::size_t budget)
+      : ref_(ref), budget_(budget) {}
+
+  bool is_array() const { return ref_.is_array(); }
+  bool is_object() const { return ref_.is_object(); }
+
+  std::optional<BudgetRef> at(std::size_t index) const {
+    auto element = ref_.at(index);
+    if (!element) {
+      return std::nullopt;
+    }
+    return BudgetRef(*element, budget_);
+  }
+  std::optional<BudgetRef> find(std::string_view key) const {
+    auto member = ref_.find(key);
+    if (!member) {
+      return std::nullopt;
+    }
+    return BudgetRef(*member, budget_);
+  }
+  json::JSONValue slice(std::size_t start, std::size_t end) const {
+    std::size_t words = 0;
+    std::size_t n = 0;
+    for (json::TapeRef element : ref_.elements()) {
+      if (n >= end) {
+        break;
+      }
+      if (n++ >= start) {
+        words += element.end() - element.index();
+      }
+    }
+    check(words);
+    return ref_.slice(start, end);
+  }
+  json::JSONValue to_value() const {
+    check(ref_.end() - ref_.index());
+    return ref_.to_value();
+  }
+
+private:
+  void check(std::size_t words) const {
+    if (budget_ != 0 && words > budget_ / sizeof(std::uint64_t)) {
+      throw std::runtime_error(
+          "The filter needs a value larger than --memory-budget in memory, "
+          "only paths, .[], ., length and keys run on the spilled input");
+    }
+  }
+
+  json::TapeRef ref_;
+  std::size_t budget_;
+};
+
+// select the steps of a root path from first on, on a json::TapeRef, a
+// BudgetRef or a ValueRef. Nothing when the evaluator has to see the whole
+// document to report a missing key or a type error.
+template <typename Node>
+std::optional<json::JSONValue> select_path(Node node,
+                                           const std::vector<PathStep> &steps,
+                                           std::size_t first = 0) {
+  for (std::size_t i = first; i < steps.size(); ++i) {
+    const auto &step = steps[i];
+    if (step.kind == PathStep::Kind::Key) {
+      if (!node.is_object()) {
+        return std::nullopt;
+      }
+      auto member = node.find(step.key);
+      if (!member) {
+        return std::nullopt;
+      }
+      node = *member;
+      continue;
+    }
+    if (!node.is_array()) {
+      return std::nullopt;
+    }
+    if (step.kind == PathStep::Kind::Slice) {
+      std::optional<std::size_t> start = 0;
+      std::optional<std::size_t> end = std::numeric_limits<std::size_t>::max();
+      if (step.index) {
+        start = path_offset(*step.index);
+      }
+      if (step.end) {
+        end = path_offset(*step.end);
+      }
+      if (!start || !end) {
+        return std::nullopt;
+      }
+      return node.slice(*start, *end);
+    }
+    auto index = path_offset(*step.index);
+    if (!index) {
+      return std::nullopt;
+    }
+    auto element = node.at(*index);
+    if (!element) {
+      // past the end is null, a step after it is an error
+      if (i + 1 == steps.size()) {
+        return json::JSONValue(nullptr);
+      }
+      return std::nullopt;
+    }
+    node = *element;
+  }
+  return node.to_value();
+}
+
+// the value the key and index steps of a root path select on the tape,
+// nothing when a step fails, runs past the end or is a slice
+std::optional<json::TapeRef> find_path(json::TapeRef node,
+                                       const std::vector<PathStep> &steps) {
+  for (const auto &step : steps) {
+    std::optional<json::TapeRef> next;
+    if (step.kind == PathStep::Kind::Key && node.is_object()) {
+      next = node.find(step.key);
+    } else if (step.kind == PathStep::Kind::Index && node.is_array()) {
+      if (auto index = path_offset(*step.index)) {
+        next = node.at(*index);
+      }
+    }
+    if (!next) {
+      return std::nullopt;
+    }
+    node = *next;
+  }
+  return node;
+}
+
+// run the rest of the filter straight on the tape when it is ., length or
+// keys, maybe after a .[], false when it needs a JSONValue
+bool run_on_tape(json::TapeRef value, JQInterpreter &interpreter,
+                 json::JSONPrinter &printer, json::OutputBuffer &out,
+                 const CommandLineOptions &options) {
+  if (options.output_format != DataFormat::Json) {
+    return false;
+  }
+  // . | length is length. .[] gives the values of an object as an array,
+  // and an array as it is.
+  bool values = false;
+  const ASTNode *last = nullptr;
+  for (const ASTNode *rest = &interpreter.after_path(); rest;) {
+    bool pipe = rest->type == ASTNodeType::Pipe;
+    const ASTNode *first = pipe ? rest->left.get() : rest;
+    rest = pipe ? rest->right.get() : nullptr;
+    if (first->type == ASTNodeType::Identity) {
+      continue;
+    }
+    if (!values && first->type == ASTNodeType::ObjectIterator &&
+        first->left && first->left->type == ASTNodeType::Identity) {
+      values = true;
+    } else if (!rest && (first->type == ASTNodeType::Length ||
+                         first->type == ASTNodeType::Keys)) {
+      last = first;
+    } else {
+      return false;
+    }
+  }
+  bool container =
+      value.is_array() || (value.is_object() && value.unique_keys());
+  if (values && !value.is_array() && !value.is_object()) {
+    // the evaluator reports the error
+    return false;
+  }
+  if (last == nullptr) {
+    if (values && value.is_object()) {
+      printer.print_values(value, out);
+    } else if (options.raw_output && value.is_string()) {
+      out.append(value.get_string());
+    } else {
+      printer.print(value, out);
+    }
+    if (!options.join_output) {
+      out.append('\n');
+    }
+  } else if (last->type == ASTNodeType::Length &&
+             (container || value.is_string())) {
+    std::size_t length = value.is_string()
+                             ? json::count_code_points(value.get_string())
+                             : value.size();
+    write_result(json::JSONValue(static_cast<std::int64_t>(length)), printer,
+                 out, options);
+  } else if (last->type == ASTNodeType::Keys && container) {
+    json::JSONArray keys;
+    keys.reserve(value.size());
+    if (value.is_array() || values) {
+      for (std::size_t i = 0; i < value.size(); ++i) {
+        keys.push_back(json::JSONValue(static_cast<std::int64_t>(i)));
+      }
+    } else {
+      for (const auto &member : value.members()) {
+        keys.push_back(json::JSONValue(std::string(member.key)));
+      }
+    }
+    write_result(json::JSONValue(std::move(keys)), printer, out, options);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// run the rest of the filter after its root path on each element of an
+// array or each value of an object, as .[] does
+void iterate_after_path(const json::JSONValue &value,
+                        JQInterpreter &interpreter, json::JSONPrinter &printer,
+                        json::OutputBuffer &out,
+                        const CommandLineOptions &options) {
+  auto run = [&](const json::JSONValue &element) {
+    write_result(interpreter.execute_after_path(element), printer, out,
+                 options);
+    out.maybe_flush();
+  };
+  if (value.is_array()) {
+    for (const auto &element : value.get_array()) {
+      run(element);
+    }
+  } else if (value.is_object()) {
+    for (const auto &[key, member] : value.get_object()) {
+      run(member);
+    }
+  } else {
+    throw std::runtime_error(
+        "Cannot iterate over non-object or non-array value");
+  }
+}
+
+// a snapshot or a spilled tape: the filter runs on each document of the
+// tape. Printing, length and keys read the tape in place, otherwise only
+// the part the root path selects is built as a JSONValue. With
+// --stream-array the rest of a filter starting with .[] runs on one element
+// at a time. With --memory-budget a value too large for the budget is never
+// built, the filter fails instead.
+void run_snapshot(const json::TapeView &tape, JQInterpreter &interpreter,
+                  json::JSONPrinter &printer, json::OutputBuffer &out,
+                  const CommandLineOptions &options) {
+  auto handle = [&](const json::JSONValue &value) {
+    write_result(interpreter.execute(value), printer, out, options);
+    out.maybe_flush();
+  };
+  json::StreamEventBuilder events(handle);
+  const auto &steps = interpreter.root_path();
+  bool iterate = options.stream_array && !options.stream_events &&
+                 steps.empty() && interpreter.iterates_after_path();
+  auto build = [&](json::TapeRef value) {
+    return BudgetRef(value, options.memory_budget).to_value();
+  };
+  for (std::size_t index = 0; index < tape.size;) {
+    json::TapeRef document(tape, index);
+    index = document.end();
+    if (options.stream_events) {
+      events.on_value(build(document));
+      continue;
+    }
+    auto found = find_path(document, steps);
+    if (found && !iterate &&
+        run_on_tape(*found, interpreter, printer, out, options)) {
+      out.maybe_flush();
+      continue;
+    }
+    if (found && iterate &&
+        (found->is_array() || (found->is_object() && found->unique_keys()))) {
+      auto run = [&](json::TapeRef element) {
+        if (!run_on_tape(element, interpreter, printer, out, options)) {
+          write_result(interpreter.execute_after_path(build(element)),
+                       printer, out, options);
+        }
+        out.maybe_flush();
+      };
+      if (found->is_array()) {
+        for (json::TapeRef element : found->elements()) {
+          run(element);
+        }
+      } else {
+        for (const auto &member : found->members()) {
+          run(member.value);
+        }
+      }
+      continue;
+    }
+    auto selected =
+        select_path(BudgetRef(document, options.memory_budget), steps);
+    if (selected && iterate) {
+      iterate_after_path(*selected, interpreter, printer, out, options);
+    } else if (selected) {
+      write_result(interpreter.execute_after_path(*selected), printer, out,
+                   options);
+      out.maybe_flush();
+    } else {
+      handle(build(document));
+    }
+  }
+}
+
+void save_snapshot_file(const std::string &path, const json::TapeView &tape) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Cannot open file " + path);
+  }
+  json::save_snapshot(tape, file);
+}
+
+// snapshot files start with a J, which cannot start a JSON text
+bool is_snapshot_input(std::istream &in, const CommandLineOptions &options) {
+  return options.input_format == DataFormat::Json && in.peek() == 'J';
+}
+
+// the size and modification time an offset index is checked against
+std::pair<std::uint64_t, std::int64_t> file_stamp(const std::string &path) {
+  auto time = std::filesystem::last_write_time(path);
+  return {std::filesystem::file_size(path),
+          static_cast<std::int64_t>(time.time_since_epoch().count())};
+}
+
+// write the offset index of a JSON file next to it, a failed build leaves
+// no index behind
+void build_index_file(const std::string &path, std::size_t max_depth) {
+  MappedFile source(path);
+  std::string index_path = json::offset_index_path(path);
+  std::string partial = index_path + ".tmp";
+  try {
+    std::ofstream file(partial, std::ios::binary);
+    if (!file) {
+      throw std::runtime_error("Cannot open file " + partial);
+    }
+    json::build_offset_index(source.view(), file_stamp(path).second, file,
+                             max_depth);
+  } catch (...) {
+    std::filesystem::remove(partial);
+    throw;
+  }
+  std::filesystem::rename(partial, index_path);
+}
+
+// the offset index of a JSON file, nullptr without an index or when it is
+// out of date or damaged
+std::unique_ptr<json::OffsetIndex> load_index_file(const std::string &path) {
+  std::string index_path = json::offset_index_path(path);
+  if (!std::filesystem::exists(index_path)) {
+    return nullptr;
+  }
+  try {
+    auto index = std::make_unique<json::OffsetIndex>(index_path);
+    auto [size, time] = file_stamp(path);
+    if (index->matches(size, time)) {
+      return index;
+    }
+    std::cerr << "Warning: " << index_path
+              << " is out of date, reading the whole input\n";
+  } catch (const std::exception &e) {
+    std::cerr << "Warning: " << e.what() << ", reading the whole input\n";
+  }
+  return nullptr;
+}
+
+// a JSON file with an offset index: only the top level values the root path
+// of the filter selects are parsed. False when the filter needs the whole
+// document, nothing was written then.
+bool run_indexed(const json::OffsetIndex &index, std::string_view text,
+                 JQInterpreter &interpreter, json::JSONPrinter &printer,
+                 json::OutputBuffer &out, const CommandLineOptions &options) {
+  const auto &steps = interpreter.root_path();
+  if (steps.empty()) {
+    return false;
+  }
+  auto parse = [&](std::size_t i) {
+    json::JSONValueBuilder builder;
+    builder.set_lazy_numbers(options.lazy_numbers);
+    json::JSONSAXParser parser;
+    parser.set_max_depth(options.max_depth);
+    parser.parse(index.value(text, i), builder);
+    return builder.take();
+  };
+  const auto &step = steps[0];
+  std::optional<json::JSONValue> selected;
+  if (step.kind == PathStep::Kind::Key) {
+    auto member = index.is_array() ? std::nullopt : index.find(step.key);
+    if (!member) {
+      return false;
+    }
+    auto value = parse(*member);
+    selected = select_path(ValueRef(value), steps, 1);
+  } else if (step.kind == PathStep::Kind::Index) {
+    auto element = path_offset(*step.index);
+    if (!index.is_array() || !element) {
+      return false;
+    }
+    if (*element < index.size()) {
+      auto value = parse(*element);
+      selected = select_path(ValueRef(value), steps, 1);
+    } else if (steps.size() == 1) {
+      selected = json::JSONValue(nullptr);
+    }
+  } else {
+    std::optional<std::size_t> start = 0;
+    std::optional<std::size_t> end = index.size();
+    if (step.index) {
+      start = path_offset(*step.index);
+    }
+    if (step.end) {
+      end = path_offset(*step.end);
+    }
+    if (!index.is_array() || !start || !end) {
+      return false;
+    }
+    json::JSONArray elements;
+    for (std::size_t i = *start; i < std::min(*end, index.size()); ++i) {
+      elements.push_back(parse(i));
+    }
+    selected = json::JSONValue(std::move(elements));
+  }
+  if (!selected) {
+    return false;
+  }
+  write_result(interpreter.execute_after_path(*selected), printer, out,
+               options);
+  return true;
+}
+
+// the decoder of compressed input, nullptr for plain input. The magic bytes
+// of gzip and zstd cannot start a JSON text, but they are valid MessagePack
+// and CBOR items, so binary input is always read as it is.
+std::unique_ptr<std::istream> open_input(std::istream &in,
+                                         const CommandLineOptions &options) {
+  if (options.input_format != DataFormat::Json) {
+    return nullptr;
+  }
+  return open_decompressed(in);
+}
+
+// the filter runs on each value of the input in its input format
+void run_input(std::istream &in, JQInterpreter &interpreter,
+               json::JSONPrinter &printer, json::OutputBuffer &out,
+               const CommandLineOptions &options) {
+  if (options.input_format == DataFormat::MsgPack) {
+    run_msgpack(in, interpreter, printer, out, options);
+  } else if (options.input_format == DataFormat::Cbor) {
+    run_cbor(in, interpreter, printer, out, options, false);
+  } else if (options.stream_events) {
+    run_stream_events(in, interpreter, printer, out, options);
+  } else {
+    run_documents(in, interpreter, printer, out, options);
+  }
+}
+
+// the paths of --files-from, one per line, blank lines are skipped
+std::vector<std::string> read_file_list(std::istream &in) {
+  std::vector<std::string> files;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (!line.empty()) {
+      files.push_back(line);
+    }
+  }
+  return files;
+}
+
+// one input, a file or stdin when input_file is empty: the snapshot, index,
+// memory budget, pipeline, --stream-array and parallel parser paths are
+// picked here for a single input and for each file of a batch alike
+void run_source(std::istream &raw_in, const std::string &input_file,
+                JQInterpreter &interpreter, json::JSONPrinter &printer,
+                json::OutputBuffer &out, const CommandLineOptions &options) {
+  if (is_snapshot_input(raw_in, options)) {
+    // files are mapped, stdin is read into memory
+    auto snapshot = input_file.empty()
+                        ? std::make_unique<json::Snapshot>(raw_in)
+                        : std::make_unique<json::Snapshot>(input_file);
+    run_snapshot(snapshot->tape(), interpreter, printer, out, options);
+    return;
+  }
+
+  if (options.build_index) {
+    build_index_file(input_file, options.max_depth);
+  }
+  // an indexed file is mapped and only the values the filter selects are
+  // parsed
+  if (!input_file.empty() && options.input_format == DataFormat::Json &&
+      options.save_snapshot.empty() && options.memory_budget == 0 &&
+      !options.stream_events && !options.stream_array) {
+    if (auto index = load_index_file(input_file)) {
+      MappedFile source(input_file);
+      if (run_indexed(*index, source.view(), interpreter, printer, out,
+                      options)) {
+        return;
+      }
+    }
+  }
+
+  // gzip or zstd input is decoded on its own thread
+  auto decoded = open_input(raw_in, options);
+  std::istream &in = decoded ? *decoded : raw_in;
+
+  if (options.memory_budget != 0) {
+    json::DiskTape disk(options.memory_budget);
+    if (!decoded && !input_file.empty()) {
+      // the text is mapped too, its pages are read once and can be dropped
+      MappedFile text(input_file);
+      json::JSONSAXParser parser;
+      parser.set_max_depth(options.max_depth);
+      parser.feed(text.view(), disk.handler());
+      parser.finish(disk.handler());
+    } else {
+      push_input(in, disk.handler(), out, options);
+    }
+    const json::TapeView &tape = disk.finish();
+    if (!options.save_snapshot.empty()) {
+      save_snapshot_file(options.save_snapshot, tape);
+    }
+    run_snapshot(tape, interpreter, printer, out, options);
+    return;
+  }
+
+  if (!options.save_snapshot.empty()) {
+    json::TapeBuilder builder;
+    push_input(in, builder, out, options);
+    json::Tape tape = builder.take();
+    json::TapeView view = tape.view();
+    save_snapshot_file(options.save_snapshot, view);
+    run_snapshot(view, interpreter, printer, out, options);
+    return;
+  }
+
+  // the pipeline and the parallel parser read JSON text, --stream-array
+  // JSON text or CBOR
+  bool json_input = options.input_format == DataFormat::Json;
+  if (json_input && options.pipeline && !options.stream_array &&
+      !options.parallel_parse) {
+    run_pipeline(in, interpreter, printer, out, options);
+    return;
+  }
+  bool cbor_input = options.input_format == DataFormat::Cbor;
+  if ((json_input || cbor_input) && options.stream_array &&
+      !options.stream_events && interpreter.strip_root_iterator()) {
+    if (cbor_input) {
+      run_cbor(in, interpreter, printer, out, options, true);
+    } else {
+      run_stream_array(in, interpreter, printer, out, options);
+    }
+    return;
+  }
+
+  if (!json_input || options.stream_events || !options.parallel_parse) {
+    run_input(in, interpreter, printer, out, options);
+    return;
+  }
+
+  // the parallel parser needs the whole text
+  json::ParallelJSONParser parser(options.threads);
+  parser.set_max_depth(options.max_depth);
+  parser.set_lazy_numbers(options.lazy_numbers);
+  auto result = interpreter.execute(parser.parse(read_json_input(in)));
+  write_result(result, printer, out, options);
+}
+
+// the state a batch worker keeps across files
+struct BatchWorker {
+  explicit BatchWorker(const CommandLineOptions &options)
+      : interpreter(options.expression), printer(options.print) {
+    interpreter.compile();
+  }
+
+  JQInterpreter interpreter;
+  json::JSONPrinter printer;
+  // the results of the current file
+  json::OutputBuffer out;
+};
+
+// several input files: every file is a task of a work stealing pool, the
+// workers reuse their compiled filter, printer and output buffer. The
+// results are written in argument order, or as each file is done with
+// --unordered. A file which fails is reported and the others go on.
+int run_files(const std::vector<std::string> &files,
+              const CommandLineOptions &options, std::ostream &output) {
+  WorkStealingPool pool(options.threads);
+  std::vector<std::unique_ptr<BatchWorker>> workers;
+  for (unsigned w = 0; w < pool.workers(); ++w) {
+    workers.push_back(std::make_unique<BatchWorker>(options));
+  }
+  json::OutputBuffer out(output);
+  bool failed = false;
+  auto report = [&](const std::string &error) {
+    out.flush();
+    std::cerr << "Error: " << error << std::endl;
+    failed = true;
+  };
+
+  // run the filter on one file into the output buffer of the worker
+  auto process = [&](BatchWorker &worker, std::size_t index) {
+    std::ifstream file(files[index]);
+    if (!file) {
+      return "Cannot open file " + files[index];
+    }
+    try {
+      run_source(file, files[index], worker.interpreter, worker.printer,
+                 worker.out, options);
+    } catch (const std::exception &e) {
+      return files[index] + ": " + e.what();
+    }
+    return std::string();
+  };
+
+  if (options.unordered) {
+    std::mutex output_mutex;
+    pool.run(files.size(), [&](unsigned w, std::size_t index) {
+      auto &worker = *workers[w];
+      std::string error = process(worker, index);
+      std::lock_guard<std::mutex> lock(output_mutex);
+      out.append(worker.out.str());
+      worker.out.clear();
+      if (!error.empty()) {
+        report(error);
+      }
+      out.maybe_flush();
+    });
+    out.flush();
+    return failed ? 1 : 0;
+  }
+
+  // argument order: this thread writes the results of each file once the
+  // ones before it are written. Behind a slow file at most two finished
+  // files per worker are kept, then the workers wait for it too.
+  struct FileResult {
+    std::string output;
+    std::string error;
+  };
+  std::vector<FileResult> results(files.size());
+  pool.run_ordered(
+      files.size(),
+      [&](unsigned w, std::size_t index) {
+        auto &worker = *workers[w];
+        std::string error = process(worker, index);
+        results[index] = {worker.out.take(), std::move(error)};
+      },
+      [&](std::size_t index) {
+        FileResult ready = std::move(results[index]);
+        out.append(ready.output);
+        if (!ready.error.empty()) {
+          report(ready.error);
+        }
+        out.maybe_flush();
+      },
+      2 * std::size_t{pool.workers()});
+  out.flush();
+  return failed ? 1 : 0;
+}
+
+// check one JSON input, files are mapped and compressed input or stdin is
+// read into memory first
+json::ValidationResult validate_input(std::istream &in, const std::string &path,
+                                      const CommandLineOptions &options) {
+  if (!path.empty() && detect_compression(in) == Compression::None) {
+    MappedFile file(path);
+    return json::validate_json(file.view(), options.max_depth);
+  }
+  auto decoded = open_decompressed(in);
+  std::istream &source = decoded ? *decoded : in;
+  std::string text;
+  char buffer[1 << 16];
+  while (source.read(buffer, sizeof(buffer)) || source.gcount() > 0) {
+    text.append(buffer, static_cast<std::size_t>(source.gcount()));
+  }
+  return json::validate_json(text, options.max_depth);
+}
+
+// --validate: report the first error of each invalid input, nothing is
+// written for valid ones
+int run_validate(std::istream &input, const CommandLineOptions &options) {
+  std::vector<std::string> paths = options.input_files;
+  if (paths.empty()) {
+    paths.push_back("-");
+  }
+  bool failed = false;
+  for (const auto &path : paths) {
+    std::string name = path == "-" ? "<stdin>" : path;
+    try {
+      std::ifstream file;
+      if (path != "-") {
+        file.open(path, std::ios::binary);
+        if (!file) {
+          std::cerr << "Error: Cannot open file " << path << "\n";
+          failed = true;
+          continue;
+        }
+      }
+      auto result = validate_input(path == "-" ? input : file,
+                                   path == "-" ? "" : path, options);
+      if (!result.valid) {
+        std::cerr << "Error: " << name << ": " << result.message
+                  << " at byte " << result.offset << "\n";
+        failed = true;
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << name << ": " << e.what() << "\n";
+      failed = true;
+    }
+  }
+  return failed ? 1 : 0;
+}
+
 int run_jqcpp(int argc, char *argv[], std::istream &input,
               std::ostream &output) {
   if (argc < 2) {
     print_help(std::cerr);
     return 1;
   }
-  std::string arg1 = argv[1];
-  if (arg1 == "-h" || arg1 == "--help") {
-    print_help(output);
-    return 0;
+  CommandLineOptions options;
+  if (int status = parse_arguments(argc, argv, output, options); status >= 0) {
+    return status;
   }
-  if (arg1 == "-v" || arg1 == "--version") {
-    print_version(output);
-    return 0;
+  const std::string &expression = options.expression;
+
+  if (expression.empty() && !options.validate) {
+    std::cerr << "Error: No expression provided\n";
+    print_help(output);
   }
 
-  std::string expression = arg1;
-  std::string input_file;
-  if (argc > 2) {
-    input_file = argv[2];
+  std::unique_ptr<CompressingOutput> compressed;
+  if (options.compress != Compression::None) {
+    compressed = std::make_unique<CompressingOutput>(output, options.compress);
   }
+  std::ostream &sink = compressed ? *compressed : output;
 
-  if (expression.empty()) {
-    std::cerr << "Error: No expression provided\n";
-    print_help(output);
+  if (!options.files_from.empty()) {
+    std::ifstream list_file;
+    if (options.files_from != "-") {
+      list_file.open(options.files_from);
+      if (!list_file) {
+        std::cerr << "Error: Cannot open file " << options.files_from << "\n";
+        return 1;
+      }
+    }
+    auto listed = read_file_list(options.files_from == "-" ? input : list_file);
+    options.input_files.insert(options.input_files.end(), listed.begin(),
+                               listed.end());
+  }
+  if (options.validate) {
+    return run_validate(input, options);
+  }
+  bool many_files =
+      options.input_files.size() > 1 || !options.files_from.empty();
+  if (!options.save_snapshot.empty() &&
+      (many_files || options.input_format != DataFormat::Json)) {
+    std::cerr << "Error: --save-snapshot takes a single JSON input\n";
+    return 1;
+  }
+  if (options.memory_budget != 0 &&
+      (many_files || options.input_format != DataFormat::Json)) {
+    std::cerr << "Error: --memory-budget takes a single JSON input\n";
+    return 1;
+  }
+  if (options.build_index &&
+      (options.input_files.size() != 1 || many_files ||
+       options.input_format != DataFormat::Json)) {
+    std::cerr << "Error: --build-index takes a single JSON input file\n";
+    return 1;
   }
+  if (many_files) {
+    try {
+      return run_files(options.input_files, options, sink);
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+  std::string input_file =
+      options.input_files.empty() ? "" : options.input_files[0];
 
-  std::string json_input;
+  std::ifstream ifs;
   if (!input_file.empty()) {
-    std::ifstream ifs(input_file);
+    ifs.open(input_file);
     if (!ifs) {
       std::cerr << "Error: Cannot open file " << input_file << "\n";
       return 1;
     }
-    json_input = read_json_input(ifs);
-  } else {
-    json_input = read_json_input(input);
   }
+  std::istream &raw_in = input_file.empty() ? input : ifs;
 
   try {
-    // parse json object
-    json::JSONTokenizer lexer;
-    json::JSONParser parser;
-    auto jvalue = parser.parse(lexer.tokenize(json_input));
-
     JQInterpreter interpreter(expression);
-    auto result = interpreter.execute(jvalue);
-    json::JSONPrinter printer;
-    output << printer.print(result) << std::endl;
+    json::JSONPrinter printer(options.print);
+    // a single flush at the end instead of std::endl per result
+    json::OutputBuffer out(sink);
+
+    run_source(raw_in, input_file, interpreter, printer, out, options);
+    out.flush();
     return 0;
   } catch (const std::exception &e) {
     std::cerr << "Error: " << e.what() << std::endl;
@@ -33,10 +33,9 @@ std::unique_ptr<ASTNode> JQParser::parseExpression() {
 
 std::unique_ptr<ASTNode> JQParser::parseTerm() {
   if (match(TokenType::Number)) {
-    return std::make_unique<NumberLiteralNode>(
-        std::stod(std::prev(current)->value));
+    return std::make_unique<NumberLiteralNode>(std::prev(current)->value);
   } else if (match(TokenType::Dot)) {
-    if (isAtEnd() || peek().type == TokenType::Pipe) {
+    if (isEndOfTerm()) {
       return std::make_unique<IdentityNode>();
     }
     return parseFieldAccess(std::make_unique<IdentityNode>());
@@ -44,6 +43,12 @@ std::unique_ptr<ASTNode> JQParser::parseTerm() {
     return parseLength();
   } else if (match(TokenType::Keys)) {
     return parseKeys();
+  } else if (match(TokenType::ToStream)) {
+    return std::make_unique<ToStreamNode>();
+  } else if (match(TokenType::FromStream)) {
+    return std::make_unique<FromStreamNode>(parseCallArgument());
+  } else if (match(TokenType::TruncateStream)) {
+    return std::make_unique<TruncateStreamNode>(parseCallArgument());
   } else if (match(TokenType::Plus) || match(TokenType::Minus)) {
     return parseAddition();
   }
@@ -66,7 +71,7 @@ JQParser::parseFieldAccess(std::unique_ptr<ASTNode> base) {
     return node;
   } else if (match(TokenType::LeftBracket)) {
     return parseArrayAccess(std::move(base));
-  } else if (isAtEnd() || peek().type == TokenType::Pipe) {
+  } else if (isEndOfTerm()) {
     // This handles the case of a bare '.' (identity)
     return base;
   }
@@ -84,7 +89,7 @@ JQParser::parseArrayAccess(std::unique_ptr<ASTNode> base) {
 
   std::unique_ptr<ASTNode> start;
   if (match(TokenType::Number)) {
-    start = std::make_unique<LiteralNode>(std::stod(std::prev(current)->value));
+    start = std::make_unique<LiteralNode>(std::prev(current)->value);
   }
 
   if (match(TokenType::Colon)) {
@@ -104,7 +109,13 @@ JQParser::parseArrayAccess(std::unique_ptr<ASTNode> base) {
       return node;
     } else {
       // 这是一个对象迭代器
-      return std::make_unique<ObjectIteratorNode>(std::move(base));
+      auto node = std::make_unique<ObjectIteratorNode>(std::move(base));
+      if (match(TokenType::Dot)) {
+        return parseFieldAccess(std::move(node));
+      } else if (match(TokenType::LeftBracket)) {
+        return parseArrayAccess(std::move(node));
+      }
+      return node;
     }
   }
 
@@ -117,7 +128,7 @@ std::unique_ptr<ASTNode> JQParser::parseSlice(std::unique_ptr<ASTNode> base,
 
   if (!match(TokenType::RightBracket)) {
     if (match(TokenType::Number)) {
-      end = std::make_unique<LiteralNode>(std::stod(std::prev(current)->value));
+      end = std::make_unique<LiteralNode>(std::prev(current)->value);
     }
     consume(TokenType::RightBracket, "Expected ']' after array slice");
   }
@@ -160,6 +171,14 @@ std::unique_ptr<ASTNode> JQParser::parseKeys() {
   return std::make_unique<KeysNode>();
 }
 
+// the (expression) argument of a builtin function
+std::unique_ptr<ASTNode> JQParser::parseCallArgument() {
+  consume(TokenType::LeftParen, "Expected '(' after function name");
+  auto argument = parseExpression();
+  consume(TokenType::RightParen, "Expected ')' after function argument");
+  return argument;
+}
+
 Token JQParser::peek() const { return *current; }
 
 Token JQParser::advance() { return *current++; }
@@ -183,4 +202,10 @@ void JQParser::consume(TokenType type, const std::string &message) {
 
 bool JQParser::isAtEnd() const { return current->type == TokenType::End; }
 
+// a term ends at the end of the expression, a pipe or a closing ')'
+bool JQParser::isEndOfTerm() const {
+  return isAtEnd() || peek().type == TokenType::Pipe ||
+         peek().type == TokenType::RightParen;
+}
+
 } // namespace jqcpp
@@ -1,8 +1,18 @@
 #include "jqcpp/json_parser.hpp"
 #include "jqcpp/json_tokenizer.hpp"
 #include "jqcpp/json_value.hpp"
+#include "jqcpp/number_format.hpp"
+#include <iterator>
 
 namespace jqcpp::json {
+/**
+ * @brief parse one value from the tokens
+ *
+ * A loop reads a scalar or opens a container, then hands the finished
+ * value to the innermost open container and closes every container whose
+ * last element it was, e.g. [1, {"a": 2}] opens [, adds 1, opens {, reads
+ * the key a, adds 2, closes } and adds it, then closes ].
+ */
 JSONValue JSONParser::parse(const std::vector<Token> &tokens) {
   if (tokens.empty()) {
     throw JSONParserError("Empty tokens");
@@ -10,42 +20,114 @@ JSONValue JSONParser::parse(const std::vector<Token> &tokens) {
 
   it = tokens.begin();
   end = tokens.end();
-  return parse_value();
-}
+  stack_.clear();
+  while (true) {
+    if (it == end) {
+      throw JSONParserError("Unexpected end of tokens");
+    }
 
-JSONValue JSONParser::parse_value() {
-  if (it == end) {
-    throw JSONParserError("Unexpected end of tokens");
-  }
+    // get a new token
+    JSONValue value;
+    switch (it->type) {
+    case TokenType::Null:
+      ++it;
+      break;
+    case TokenType::True:
+      ++it;
+      value = JSONValue(true);
+      break;
+    case TokenType::False:
+      ++it;
+      value = JSONValue(false);
+      break;
+    case TokenType::Number: {
+      std::int64_t integer;
+      if (lazy_numbers_) {
+        value = JSONValue(NumberText{it->value});
+      } else {
+        value = parse_integer(it->value, integer)
+                    ? JSONValue(integer)
+                    : JSONValue(std::stod(it->value));
+      }
+      ++it;
+      break;
+    }
+    case TokenType::String:
+      value = JSONValue(it->value);
+      ++it;
+      break;
+    case TokenType::LeftBrace:
+    case TokenType::LeftBracket: {
+      bool is_array = it->type == TokenType::LeftBracket;
+      open_container(is_array);
+      auto close = is_array ? TokenType::RightBracket : TokenType::RightBrace;
+      if (it == end || it->type != close) {
+        if (!is_array) {
+          parse_key();
+        }
+        // on to its first element
+        continue;
+      }
+      // an empty container is complete right away
+      ++it;
+      value = is_array ? JSONValue(JSONArray()) : JSONValue(JSONObject());
+      stack_.pop_back();
+      break;
+    }
+    default:
+      throw JSONParserError("Unrecognized token type");
+    }
 
-  // get a new token
-  switch (it->type) {
-  case TokenType::Null:
-    consume(TokenType::Null);
-    return JSONValue(nullptr);
-  case TokenType::True:
-    consume(TokenType::True);
-    return JSONValue(true);
-  case TokenType::False:
-    consume(TokenType::False);
-    return JSONValue(false);
-  case TokenType::Number: {
-    double v = std::stod(it->value);
-    consume(TokenType::Number);
-    return JSONValue(v);
+    // add the value to its container, closing the containers it completes
+    while (true) {
+      if (stack_.empty()) {
+        return value;
+      }
+      Frame &top = stack_.back();
+      if (top.is_array) {
+        top.array.push_back(std::move(value));
+      } else {
+        jsonObjectInsert(top.object, top.key, std::move(value));
+      }
+      // the key: value ends when encounter a comma: ,
+      // and then another element starts
+      if (it != end && it->type == TokenType::Comma) {
+        ++it;
+        if (!top.is_array) {
+          parse_key();
+        }
+        break;
+      }
+      if (top.is_array) {
+        consume(TokenType::RightBracket);
+        value = JSONValue(std::move(top.array));
+      } else {
+        consume(TokenType::RightBrace);
+        value = JSONValue(std::move(top.object));
+      }
+      stack_.pop_back();
+    }
   }
-  case TokenType::String: {
-    std::string v = it->value;
-    consume(TokenType::String);
-    return JSONValue(std::move(v));
+}
+
+void JSONParser::open_container(bool is_array) {
+  if (stack_.size() >= max_depth_) {
+    throw JSONParserError("Exceeds depth limit for parsing");
   }
-  case TokenType::LeftBrace:
-    return parse_object();
-  case TokenType::LeftBracket:
-    return parse_array();
-  default:
-    throw JSONParserError("Unrecognized token type");
+  ++it;
+  Frame &frame = stack_.emplace_back();
+  frame.is_array = is_array;
+}
+
+// key: value, the key is a string
+void JSONParser::parse_key() {
+  if (it != end && it->type != TokenType::String) {
+    throw JSONParserError("The key of object should be a string type");
   }
+  consume(TokenType::String);
+  stack_.back().key = std::prev(it)->value;
+  // should be colon :
+  consume(TokenType::Colon);
 }
 
 void JSONParser::consume(TokenType expected_type) {
@@ -58,54 +140,4 @@ void JSONParser::consume(TokenType expected_type) {
   ++it;
 }
 
-JSONValue JSONParser::parse_object() {
-  // object is a map which has a key and a value
-  // a object must start with "{"
-  consume(TokenType::LeftBrace);
-  JSONObject object;
-
-  // a right brace is the end of the object
-  if (it != end && it->type != TokenType::RightBrace) {
-    do {
-      // key: value
-      // key is a string
-      // value can be any other valid type
-      // firstly parse the key
-      if (it->type != TokenType::String) {
-        throw JSONParserError("The key of object should be a string type");
-      }
-      std::string key = std::move(it->value);
-      consume(TokenType::String);
-      // should be colon :
-      consume(TokenType::Colon);
-      // the value
-      jsonObjectInsert(object, key, parse_value());
-      // the key: value ends when encounter a comma: ,
-      // and then another object starts
-    } while (it != end && it->type == TokenType::Comma && (++it, true));
-  }
-  // end of object
-  consume(TokenType::RightBrace);
-  // just move
-  return JSONValue(std::move(object));
-}
-
-// parse a array
-// e.g. [1, 2, 3, 4]
-JSONValue JSONParser::parse_array() {
-  // begin with [
-  consume(TokenType::LeftBracket);
-  // array is a vector of json value
-  JSONArray arr;
-  // the array ends if ] appears
-  if (it != end && it->type != TokenType::RightBracket) {
-    do {
-      arr.push_back(parse_value());
-    } while (it != end && it->type == TokenType::Comma && (++it, true));
-  }
-  // ends with ]
-  consume(TokenType::RightBracket);
-  return JSONValue(std::move(arr));
-}
-
 } // namespace jqcpp::json
@@ -0,0 +1,435 @@
+#include "jqcpp/json_sax.hpp"
+#include "jqcpp/json_parser.hpp"
+#include "jqcpp/json_tokenizer.hpp"
+#include "jqcpp/number_format.hpp"
+#include "jqcpp/string_escape.hpp"
+#include "jqcpp/utf8.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <utility>
+
+namespace jqcpp::json {
+
+namespace {
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+} // namespace
+
+void JSONHandler::on_number_text(std::string_view text) {
+  std::int64_t integer;
+  if (parse_integer(text, integer)) {
+    on_integer(integer, text);
+    return;
+  }
+  double value = 0;
+  auto [ptr, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc()) {
+    throw JSONTokenizerError("Number out of range");
+  }
+  on_number(value, text);
+}
+
+void JSONSAXParser::parse(std::string_view text, JSONHandler &handler) {
+  reset();
+  text_ = text;
+
+  skip_whitespace();
+  if (pos_ == text_.size()) {
+    throw JSONParserError("Empty tokens");
+  }
+  while (state_ != State::Done) {
+    skip_whitespace();
+    if (pos_ == text_.size()) {
+      throw JSONParserError("Unexpected end of tokens");
+    }
+    step(handler);
+  }
+  skip_whitespace();
+  if (pos_ != text_.size()) {
+    throw JSONParserError("Unexpected token type");
+  }
+}
+
+void JSONSAXParser::reset() {
+  text_ = {};
+  pos_ = 0;
+  state_ = State::Value;
+  stack_.clear();
+  pending_.clear();
+  consumed_ = 0;
+  string_checked_ = 0;
+}
+
+void JSONSAXParser::feed(std::string_view chunk, JSONHandler &handler) {
+  if (pending_.empty()) {
+    // nothing carried over, scan the chunk in place
+    text_ = chunk;
+  } else {
+    pending_.append(chunk);
+    text_ = pending_;
+  }
+  pos_ = 0;
+  scan_available(handler, false);
+  // keep the split token for the next chunk
+  if (text_.data() == pending_.data()) {
+    pending_.erase(0, pos_);
+  } else {
+    pending_.assign(text_.substr(pos_));
+  }
+  consumed_ += pos_;
+  pos_ = 0;
+  text_ = pending_;
+}
+
+void JSONSAXParser::finish(JSONHandler &handler) {
+  text_ = pending_;
+  pos_ = 0;
+  scan_available(handler, true);
+  if (!idle()) {
+    throw JSONParserError("Unexpected end of tokens");
+  }
+  pending_.clear();
+  consumed_ += pos_;
+  pos_ = 0;
+  text_ = {};
+}
+
+void JSONSAXParser::scan_available(JSONHandler &handler, bool final) {
+  while (true) {
+    skip_whitespace();
+    if (pos_ == text_.size()) {
+      return;
+    }
+    if (state_ == State::Done) {
+      // the next document
+      state_ = State::Value;
+    }
+    if (!final && !token_complete()) {
+      return;
+    }
+    step(handler);
+  }
+}
+
+// true if the token at pos_ is not cut by the end of the buffered input
+bool JSONSAXParser::token_complete() {
+  char c = text_[pos_];
+  if (c == '"') {
+    // resume the check of a long string where the last chunk ended
+    std::size_t p = pos_ + 1;
+    if (string_checked_ > consumed_) {
+      p = std::max(p, string_checked_ - consumed_);
+    }
+    while (p < text_.size()) {
+      bool ascii = true;
+      p += find_string_end(text_.substr(p), ascii);
+      if (p == text_.size()) {
+        break;
+      }
+      // a control character is an error scan_string() reports
+      if (text_[p] == '"' || static_cast<unsigned char>(text_[p]) < 0x20) {
+        return true;
+      }
+      if (p + 1 == text_.size()) {
+        break;
+      }
+      p += 2;
+    }
+    string_checked_ = consumed_ + p;
+    return false;
+  }
+  if (c == '-' || is_digit(c)) {
+    // a number only ends at the next byte which can't belong to it
+    std::size_t p = pos_;
+    while (p < text_.size() &&
+           (is_digit(text_[p]) || text_[p] == '-' || text_[p] == '+' ||
+            text_[p] == '.' || text_[p] == 'e' || text_[p] == 'E')) {
+      ++p;
+    }
+    return p < text_.size();
+  }
+  std::string_view literal;
+  if (c == 't') {
+    literal = "true";
+  } else if (c == 'f') {
+    literal = "false";
+  } else if (c == 'n') {
+    literal = "null";
+  }
+  std::string_view rest = text_.substr(pos_);
+  // a wrong prefix is reported right away
+  return rest.size() >= literal.size() ||
+         literal.substr(0, rest.size()) != rest;
+}
+
+void JSONSAXParser::value_done(JSONHandler &handler) {
+  if (stack_.empty()) {
+    state_ = State::Done;
+    handler.on_end_document();
+  } else {
+    state_ = State::CommaOrEnd;
+  }
+}
+
+void JSONSAXParser::skip_whitespace() {
+  while (pos_ < text_.size()) {
+    char c = text_[pos_];
+    if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+      break;
+    }
+    ++pos_;
+  }
+}
+
+// consume the next token at pos_ according to the state
+void JSONSAXParser::step(JSONHandler &handler) {
+  char c = text_[pos_];
+  switch (state_) {
+  case State::Colon:
+    if (c != ':') {
+      throw JSONParserError("Unexpected token type");
+    }
+    ++pos_;
+    state_ = State::Value;
+    return;
+  case State::CommaOrEnd:
+    if (c == ',') {
+      ++pos_;
+      state_ = stack_.back() ? State::Value : State::Key;
+      return;
+    }
+    end_container(handler);
+    return;
+  case State::FirstKey:
+    if (c == '}') {
+      end_container(handler);
+      return;
+    }
+    [[fallthrough]];
+  case State::Key:
+    if (c != '"') {
+      throw JSONParserError("The key of object should be a string type");
+    }
+    handler.on_key(scan_string());
+    state_ = State::Colon;
+    return;
+  case State::FirstValue:
+    if (c == ']') {
+      end_container(handler);
+      return;
+    }
+    [[fallthrough]];
+  case State::Value:
+    parse_value(handler);
+    return;
+  case State::Done:
+    break;
+  }
+  throw JSONParserError("Unexpected token type");
+}
+
+void JSONSAXParser::parse_value(JSONHandler &handler) {
+  char c = text_[pos_];
+  if ((c == '{' || c == '[') && stack_.size() >= max_depth_) {
+    throw JSONParserError("Exceeds depth limit for parsing");
+  }
+  switch (c) {
+  case '{':
+    ++pos_;
+    stack_.push_back(false);
+    state_ = State::FirstKey;
+    handler.on_start_object();
+    return;
+  case '[':
+    ++pos_;
+    stack_.push_back(true);
+    state_ = State::FirstValue;
+    handler.on_start_array();
+    return;
+  case '"':
+    handler.on_string(scan_string());
+    break;
+  case 't':
+    scan_literal("true");
+    handler.on_bool(true);
+    break;
+  case 'f':
+    scan_literal("false");
+    handler.on_bool(false);
+    break;
+  case 'n':
+    scan_literal("null");
+    handler.on_null();
+    break;
+  default: {
+    if (c != '-' && !is_digit(c)) {
+      throw JSONTokenizerError("Invalid input");
+    }
+    handler.on_number_text(scan_number());
+    break;
+  }
+  }
+  value_done(handler);
+}
+
+void JSONSAXParser::end_container(JSONHandler &handler) {
+  bool is_array = stack_.back();
+  if (text_[pos_] != (is_array ? ']' : '}')) {
+    throw JSONParserError("Unexpected token type");
+  }
+  ++pos_;
+  stack_.pop_back();
+  if (is_array) {
+    handler.on_end_array();
+  } else {
+    handler.on_end_object();
+  }
+  value_done(handler);
+}
+
+void JSONSAXParser::scan_literal(std::string_view literal) {
+  if (text_.substr(pos_, literal.size()) != literal) {
+    throw JSONTokenizerError("Invalid token: expected '" +
+                             std::string(literal) + "'");
+  }
+  pos_ += literal.size();
+}
+
+// same grammar as JSONTokenizer::parse_number
+std::string_view JSONSAXParser::scan_number() {
+  std::size_t start = pos_;
+  auto digits = [this] {
+    std::size_t first = pos_;
+    while (pos_ < text_.size() && is_digit(text_[pos_])) {
+      ++pos_;
+    }
+    return pos_ - first;
+  };
+  auto next_is = [this](char c) {
+    return pos_ < text_.size() && text_[pos_] == c;
+  };
+
+  if (next_is('-')) {
+    ++pos_;
+  }
+  if (next_is('0')) {
+    ++pos_;
+  } else if (digits() == 0) {
+    throw JSONTokenizerError("Invalid number format");
+  }
+  if (next_is('.')) {
+    ++pos_;
+    if (digits() == 0) {
+      throw JSONTokenizerError(
+          "Invalid number format: digit expected after dot");
+    }
+  }
+  if (next_is('e') || next_is('E')) {
+    ++pos_;
+    if (next_is('+') || next_is('-')) {
+      ++pos_;
+    }
+    if (digits() == 0) {
+      throw JSONTokenizerError("Invalid number format: digit expected");
+    }
+  }
+  return text_.substr(start, pos_ - start);
+}
+
+// strings without escapes or invalid UTF-8 are views into the input, the
+// others are decoded into scratch_
+std::string_view JSONSAXParser::scan_string() {
+  // skip leading "
+  std::size_t start = ++pos_;
+  bool ascii = true;
+  std::size_t run = find_string_end(text_.substr(start), ascii);
+  if (start + run == text_.size()) {
+    throw JSONTokenizerError("Unterminated string");
+  }
+  std::string_view body = text_.substr(start, run);
+  if (text_[start + run] == '"' && (ascii || is_utf8(body))) {
+    pos_ = start + run + 1;
+    return body;
+  }
+  scratch_.clear();
+  unescape_string(text_, pos_, scratch_);
+  return scratch_;
+}
+
+JSONValueBuilder::JSONValueBuilder(DocumentCallback on_document)
+    : on_document_(std::move(on_document)) {}
+
+void JSONValueBuilder::add(JSONValue value) {
+  if (stack_.empty() && on_document_) {
+    on_document_(std::move(value));
+    return;
+  }
+  if (stack_.empty()) {
+    value_ = std::move(value);
+    has_value_ = true;
+    return;
+  }
+  auto &top = stack_.back();
+  if (top.is_array()) {
+    std::get<std::unique_ptr<JSONArray>>(top.value)->push_back(
+        std::move(value));
+  } else {
+    auto &object = *std::get<std::unique_ptr<JSONObject>>(top.value);
+    jsonObjectInsert(object, keys_.back(), std::move(value));
+    keys_.pop_back();
+  }
+}
+
+void JSONValueBuilder::on_start_object() {
+  stack_.emplace_back(JSONObject());
+}
+
+void JSONValueBuilder::on_key(std::string_view key) {
+  keys_.emplace_back(key);
+}
+
+void JSONValueBuilder::end_container() {
+  JSONValue container = std::move(stack_.back());
+  stack_.pop_back();
+  add(std::move(container));
+}
+
+void JSONValueBuilder::on_end_object() { end_container(); }
+
+void JSONValueBuilder::on_start_array() { stack_.emplace_back(JSONArray()); }
+
+void JSONValueBuilder::on_end_array() { end_container(); }
+
+void JSONValueBuilder::on_string(std::string_view value) {
+  add(JSONValue(std::string(value)));
+}
+
+void JSONValueBuilder::on_number(double value, std::string_view) {
+  add(JSONValue(value));
+}
+
+void JSONValueBuilder::on_integer(std::int64_t value, std::string_view) {
+  add(JSONValue(value));
+}
+
+void JSONValueBuilder::on_number_text(std::string_view text) {
+  if (lazy_numbers_) {
+    add(JSONValue(NumberText{std::string(text)}));
+  } else {
+    JSONHandler::on_number_text(text);
+  }
+}
+
+void JSONValueBuilder::on_bool(bool value) { add(JSONValue(value)); }
+
+void JSONValueBuilder::on_null() { add(JSONValue(nullptr)); }
+
+JSONValue JSONValueBuilder::take() {
+  has_value_ = false;
+  return std::move(value_);
+}
+
+} // namespace jqcpp::json
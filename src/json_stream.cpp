@@ -0,0 +1,417 @@
+#include "jqcpp/json_stream.hpp"
+#include "jqcpp/number_format.hpp"
+#include <cctype>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+namespace jqcpp::json {
+
+namespace {
+
+bool is_blank(const std::string &text) {
+  for (char c : text) {
+    if (!std::isspace(static_cast<unsigned char>(c))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+JSONArrayStream::JSONArrayStream(std::istream &input, std::size_t chunk_size,
+                                 std::size_t max_depth)
+    : input_(input), chunk_size_(chunk_size),
+      parser_(max_depth > 0 ? max_depth - 1 : 0) {}
+
+bool JSONArrayStream::fill() {
+  buffer_.resize(chunk_size_);
+  input_.read(buffer_.data(), static_cast<std::streamsize>(chunk_size_));
+  buffer_.resize(static_cast<std::size_t>(input_.gcount()));
+  pos_ = 0;
+  return !buffer_.empty();
+}
+
+bool JSONArrayStream::open() {
+  while (true) {
+    while (pos_ < buffer_.size() &&
+           std::isspace(static_cast<unsigned char>(buffer_[pos_]))) {
+      ++pos_;
+    }
+    if (pos_ < buffer_.size()) {
+      break;
+    }
+    if (!fill()) {
+      return false;
+    }
+  }
+  if (buffer_[pos_] != '[') {
+    return false;
+  }
+  ++pos_;
+  return true;
+}
+
+std::string JSONArrayStream::remaining() {
+  std::string text = buffer_.substr(pos_);
+  text.append(std::istreambuf_iterator<char>(input_),
+              std::istreambuf_iterator<char>());
+  buffer_.clear();
+  pos_ = 0;
+  return text;
+}
+
+JSONValue JSONArrayStream::parse_element() {
+  auto tokens = tokenizer_.tokenize(element_);
+  JSONValue value = parser_.parse(tokens);
+  // e.g. [1 2], the element has more than one value
+  if (!parser_.finished()) {
+    throw JSONParserError("Unexpected token type");
+  }
+  ++count_;
+  return value;
+}
+
+void JSONArrayStream::check_end() {
+  do {
+    for (; pos_ < buffer_.size(); ++pos_) {
+      if (!std::isspace(static_cast<unsigned char>(buffer_[pos_]))) {
+        throw JSONParserError("Unexpected data after the end of array");
+      }
+    }
+  } while (fill());
+}
+
+bool JSONArrayStream::next(JSONValue &element) {
+  // free the previous element before parsing the next one
+  element = JSONValue();
+  if (finished_) {
+    check_end();
+    return false;
+  }
+  element_.clear();
+  while (true) {
+    if (pos_ == buffer_.size() && !fill()) {
+      throw JSONParserError("Unexpected end of array");
+    }
+    std::size_t start = pos_;
+    for (; pos_ < buffer_.size(); ++pos_) {
+      char c = buffer_[pos_];
+      if (in_string_) {
+        if (escaped_) {
+          escaped_ = false;
+        } else if (c == '\\') {
+          escaped_ = true;
+        } else if (c == '"') {
+          in_string_ = false;
+        }
+        continue;
+      }
+      if (c == '"') {
+        in_string_ = true;
+      } else if (c == '[' || c == '{') {
+        ++depth_;
+      } else if ((c == ']' || c == '}') && depth_ > 0) {
+        --depth_;
+      } else if (depth_ == 0 && (c == ',' || c == ']')) {
+        element_.append(buffer_, start, pos_ - start);
+        ++pos_;
+        if (c == ']') {
+          finished_ = true;
+          // [] has no elements
+          if (count_ == 0 && is_blank(element_)) {
+            check_end();
+            return false;
+          }
+        }
+        element = parse_element();
+        return true;
+      } else if (depth_ == 0 && c == '}') {
+        throw JSONParserError("Unexpected token type");
+      }
+    }
+    // the element goes on in the next chunk
+    element_.append(buffer_, start, pos_ - start);
+  }
+}
+
+StreamEventBuilder::StreamEventBuilder(EventCallback on_event)
+    : on_event_(std::move(on_event)) {}
+
+JSONArray StreamEventBuilder::current_path() const {
+  JSONArray path;
+  path.reserve(frames_.size());
+  for (const auto &frame : frames_) {
+    if (frame.is_array) {
+      path.push_back(JSONValue(static_cast<std::int64_t>(frame.index)));
+    } else {
+      path.push_back(JSONValue(frame.key));
+    }
+  }
+  return path;
+}
+
+void StreamEventBuilder::value_done() {
+  if (frames_.empty()) {
+    return;
+  }
+  auto &frame = frames_.back();
+  frame.has_items = true;
+  if (frame.is_array) {
+    ++frame.index;
+  }
+}
+
+void StreamEventBuilder::leaf(JSONValue value) {
+  if (!frames_.empty() && !frames_.back().is_array &&
+      frames_.back().expect_key) {
+    throw JSONParserError("The key of object should be a string type");
+  }
+  JSONArray event;
+  event.push_back(JSONValue(current_path()));
+  event.push_back(std::move(value));
+  on_event_(JSONValue(std::move(event)));
+  value_done();
+}
+
+void StreamEventBuilder::start_container(bool is_array) {
+  if (!frames_.empty() && !frames_.back().is_array &&
+      frames_.back().expect_key) {
+    throw JSONParserError("The key of object should be a string type");
+  }
+  Frame frame;
+  frame.is_array = is_array;
+  frame.expect_key = !is_array;
+  frames_.push_back(std::move(frame));
+}
+
+void StreamEventBuilder::end_container(bool is_array) {
+  if (frames_.empty() || frames_.back().is_array != is_array) {
+    throw JSONParserError("Unexpected token type");
+  }
+  Frame frame = std::move(frames_.back());
+  frames_.pop_back();
+  if (!frame.has_items) {
+    // empty containers are leaves
+    leaf(is_array ? JSONValue(JSONArray()) : JSONValue(JSONObject()));
+    return;
+  }
+  // closing event, the path of the last child
+  JSONArray path = current_path();
+  if (frame.is_array) {
+    path.push_back(JSONValue(static_cast<std::int64_t>(frame.index - 1)));
+  } else {
+    path.push_back(JSONValue(std::move(frame.key)));
+  }
+  JSONArray event;
+  event.push_back(JSONValue(std::move(path)));
+  on_event_(JSONValue(std::move(event)));
+  value_done();
+}
+
+void StreamEventBuilder::on_token(const Token &token) {
+  switch (token.type) {
+  case TokenType::LeftBrace:
+    start_container(false);
+    break;
+  case TokenType::LeftBracket:
+    start_container(true);
+    break;
+  case TokenType::RightBrace:
+    end_container(false);
+    break;
+  case TokenType::RightBracket:
+    end_container(true);
+    break;
+  case TokenType::Comma:
+    if (frames_.empty()) {
+      throw JSONParserError("Unexpected token type");
+    }
+    if (!frames_.back().is_array) {
+      frames_.back().expect_key = true;
+    }
+    break;
+  case TokenType::Colon:
+    if (frames_.empty() || frames_.back().is_array) {
+      throw JSONParserError("Unexpected token type");
+    }
+    break;
+  case TokenType::String:
+    if (!frames_.empty() && !frames_.back().is_array &&
+        frames_.back().expect_key) {
+      frames_.back().key = token.value;
+      frames_.back().expect_key = false;
+    } else {
+      leaf(JSONValue(token.value));
+    }
+    break;
+  case TokenType::Number: {
+    std::int64_t integer;
+    leaf(parse_integer(token.value, integer)
+             ? JSONValue(integer)
+             : JSONValue(std::stod(token.value)));
+    break;
+  }
+  case TokenType::True:
+    leaf(JSONValue(true));
+    break;
+  case TokenType::False:
+    leaf(JSONValue(false));
+    break;
+  case TokenType::Null:
+    leaf(JSONValue(nullptr));
+    break;
+  default:
+    throw JSONParserError("Unrecognized token type");
+  }
+}
+
+void StreamEventBuilder::on_key(std::string_view key) {
+  frames_.back().key = key;
+  frames_.back().expect_key = false;
+}
+
+void StreamEventBuilder::on_value(const JSONValue &root) {
+  // the open containers and the index of their next child
+  std::vector<std::pair<const JSONValue *, std::size_t>> stack;
+  const JSONValue *value = &root;
+  while (value) {
+    if (value->is_array() || value->is_object()) {
+      start_container(value->is_array());
+      stack.emplace_back(value, 0);
+    } else {
+      leaf(value->deepCopy());
+    }
+
+    value = nullptr;
+    while (!stack.empty()) {
+      auto &[container, next] = stack.back();
+      if (container->is_array()) {
+        const auto &array = container->get_array();
+        if (next < array.size()) {
+          value = &array[next++];
+          break;
+        }
+      } else {
+        const auto &object = container->get_object();
+        if (next < object.size()) {
+          const auto &[key, member] = object[next++];
+          on_key(key);
+          value = &member;
+          break;
+        }
+      }
+      end_container(container->is_array());
+      stack.pop_back();
+    }
+  }
+}
+
+namespace {
+
+// the child of node at one path component, created when missing
+JSONValue &child_at(JSONValue &node, const JSONValue &component) {
+  if (component.is_number()) {
+    if (node.is_null()) {
+      node = JSONValue(JSONArray());
+    }
+    if (!node.is_array() || component.get_number() < 0) {
+      throw std::runtime_error("Invalid stream event path");
+    }
+    auto &array = *std::get<std::unique_ptr<JSONArray>>(node.value);
+    auto index = static_cast<std::size_t>(component.get_number());
+    if (index >= array.size()) {
+      array.resize(index + 1);
+    }
+    return array[index];
+  }
+  if (component.is_string()) {
+    if (node.is_null()) {
+      node = JSONValue(JSONObject());
+    }
+    if (!node.is_object()) {
+      throw std::runtime_error("Invalid stream event path");
+    }
+    auto &object = *std::get<std::unique_ptr<JSONObject>>(node.value);
+    const auto &key = component.get_string();
+    for (auto &[name, member] : object) {
+      if (name == key) {
+        return member;
+      }
+    }
+    object.emplace_back(key, JSONValue());
+    return object.back().second;
+  }
+  throw std::runtime_error("Invalid stream event path");
+}
+
+// the path of an event, checking the event shape
+const JSONArray &event_path(const JSONValue &event) {
+  if (!is_stream_event(event)) {
+    throw std::runtime_error("Invalid stream event");
+  }
+  return event[0].get_array();
+}
+
+} // namespace
+
+bool StreamValueBuilder::add(const JSONValue &event, JSONValue &value) {
+  const auto &path = event_path(event);
+  if (!has_current_) {
+    current_ = JSONValue();
+    has_current_ = true;
+  }
+  bool done;
+  if (event.get_array().size() == 2) {
+    done = path.empty();
+    JSONValue *node = &current_;
+    for (const auto &component : path) {
+      node = &child_at(*node, component);
+    }
+    *node = event[1].deepCopy();
+  } else {
+    done = path.size() == 1;
+  }
+  if (done) {
+    value = std::move(current_);
+    has_current_ = false;
+  }
+  return done;
+}
+
+bool is_stream_event(const JSONValue &value) {
+  if (!value.is_array() || value.get_array().empty() ||
+      value.get_array().size() > 2 || !value[0].is_array()) {
+    return false;
+  }
+  for (const auto &component : value[0].get_array()) {
+    if (!component.is_number() && !component.is_string()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+JSONArray truncate_stream_events(const JSONArray &events, std::size_t depth) {
+  JSONArray result;
+  for (const auto &event : events) {
+    const auto &path = event_path(event);
+    if (path.size() <= depth) {
+      continue;
+    }
+    JSONArray truncated_path;
+    for (std::size_t i = depth; i < path.size(); ++i) {
+      truncated_path.push_back(path[i].deepCopy());
+    }
+    JSONArray truncated;
+    truncated.push_back(JSONValue(std::move(truncated_path)));
+    if (event.get_array().size() == 2) {
+      truncated.push_back(event[1].deepCopy());
+    }
+    result.push_back(JSONValue(std::move(truncated)));
+  }
+  return result;
+}
+
+} // namespace jqcpp::json
@@ -1,9 +1,18 @@
 #include "jqcpp/json_tokenizer.hpp"
+#include "jqcpp/string_escape.hpp"
+#include <functional>
 #include <vector>
 
 namespace jqcpp::json {
-std::vector<Token> JSONTokenizer::tokenize(const std::string &json_string) {
+std::vector<Token> JSONTokenizer::tokenize(std::string_view json_string) {
   std::vector<Token> tokens;
+  tokenize(json_string,
+           [&tokens](const Token &token) { tokens.push_back(token); });
+  return tokens;
+}
+
+void JSONTokenizer::tokenize(std::string_view json_string,
+                             const TokenCallback &on_token) {
   // initialize the iterators
   it = json_string.begin();
   end = json_string.end();
@@ -15,9 +24,8 @@ std::vector<Token> JSONTokenizer::tokenize(const std::string &json_string) {
     if (token.type == TokenType::EndOfInput) {
       break;
     }
-    tokens.push_back(token);
+    on_token(token);
   }
-  return tokens;
 }
 
 Token JSONTokenizer::next_token() {
@@ -160,61 +168,11 @@ Token JSONTokenizer::parse_number() {
 Token JSONTokenizer::parse_string() {
   std::string value;
   // skip leading "
-  get();
-  while (it != end) {
-    char c = get();
-    if (c == '"') {
-      // end of string
-      return Token(TokenType::String, value);
-    } else if (c == '\\') {
-      if (it == end) {
-        throw JSONTokenizerError("Unexpected termination");
-      }
-      char esc = get();
-      switch (esc) {
-      case '"':
-      case '\\':
-      case '/':
-        value += esc;
-        break;
-      case 'b':
-        value += '\b';
-        break;
-      case 'f':
-        value += '\f';
-        break;
-      case 'n':
-        value += '\n';
-        break;
-      case 'r':
-        value += '\r';
-        break;
-      case 't':
-        value += '\t';
-        break;
-      case 'u': {
-
-        // 4 hex digits
-        std::string hex;
-        for (int i = 0; i < 4; ++i) {
-          if (it == end || !is_hex_digit(peek())) {
-            throw JSONTokenizerError("Invalid Unicode sequence");
-          }
-          hex += get();
-        }
-        value += "\\u" + hex;
-        break;
-      }
-      default:
-        throw JSONTokenizerError("Invalid string sequence");
-      }
-
-    } else {
-      value += c;
-    }
-  }
-  // unterminated string sequence
-  throw JSONTokenizerError("Unterminated string");
+  std::string_view rest(&*it, static_cast<std::size_t>(end - it));
+  std::size_t pos = 1;
+  unescape_string(rest, pos, value);
+  it += static_cast<std::ptrdiff_t>(pos);
+  return Token(TokenType::String, value);
 }
 
 } // namespace jqcpp::json
@@ -0,0 +1,292 @@
+#include "jqcpp/json_validator.hpp"
+#include "jqcpp/string_escape.hpp"
+#include "jqcpp/utf8.hpp"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace jqcpp::json {
+
+namespace {
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+bool is_hex_digit(char c) {
+  return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// one bit per open container, set for objects
+constexpr std::size_t kLocalWords = (kDefaultMaxDepth + 63) / 64;
+
+class Validator {
+public:
+  Validator(std::string_view text, std::uint64_t *kinds)
+      : p_(text.data()), n_(text.size()), kinds_(kinds) {}
+
+  // the whole text, false with offset() and message() set on an error
+  bool run(std::size_t max_depth, std::size_t &documents) {
+    std::size_t depth = 0;
+    while (true) {
+      skip_whitespace();
+      if (depth == 0 && i_ == n_) {
+        return true;
+      }
+      // a value starts at i_
+      if (i_ == n_) {
+        return fail("Unexpected end of input");
+      }
+      char c = p_[i_];
+      if (c == '{' || c == '[') {
+        if (depth >= max_depth) {
+          return fail("Exceeds depth limit for parsing");
+        }
+        bool object = c == '{';
+        set_kind(depth++, object);
+        ++i_;
+        skip_whitespace();
+        if (i_ == n_ || p_[i_] != (object ? '}' : ']')) {
+          // on to its first element
+          if (object && !key()) {
+            return false;
+          }
+          continue;
+        }
+        // an empty container is complete right away
+        ++i_;
+        --depth;
+      } else if (c == '"') {
+        if (!string()) {
+          return false;
+        }
+      } else if (c == '-' || is_digit(c)) {
+        if (!number() || (depth == 0 && !separated())) {
+          return false;
+        }
+      } else if (!literal() || (depth == 0 && !separated())) {
+        return false;
+      }
+
+      // the value is complete, close the containers it ends
+      bool next = false;
+      while (depth > 0 && !next) {
+        skip_whitespace();
+        bool object = kind(depth - 1);
+        if (i_ == n_) {
+          return fail("Unexpected end of input");
+        }
+        if (p_[i_] == ',') {
+          ++i_;
+          if (object && !key()) {
+            return false;
+          }
+          next = true;
+        } else if (p_[i_] == (object ? '}' : ']')) {
+          ++i_;
+          --depth;
+        } else {
+          return fail(object ? "Expected , or }" : "Expected , or ]");
+        }
+      }
+      if (depth == 0) {
+        ++documents;
+      }
+    }
+  }
+
+  std::size_t offset() const { return i_; }
+  const char *message() const { return message_; }
+
+private:
+  bool fail(const char *message) {
+    message_ = message;
+    return false;
+  }
+
+  void skip_whitespace() {
+    while (i_ < n_ && (p_[i_] == ' ' || p_[i_] == '\n' || p_[i_] == '\r' ||
+                       p_[i_] == '\t')) {
+      ++i_;
+    }
+  }
+
+  // a top level number or literal ends at whitespace or the end, so 01 or
+  // 1true are not read as two values
+  bool separated() {
+    if (i_ < n_ && p_[i_] != ' ' && p_[i_] != '\n' && p_[i_] != '\r' &&
+        p_[i_] != '\t') {
+      return fail("Expected whitespace after a top level value");
+    }
+    return true;
+  }
+
+  bool kind(std::size_t level) const {
+    return (kinds_[level / 64] >> (level % 64)) & 1;
+  }
+
+  void set_kind(std::size_t level, bool object) {
+    std::uint64_t bit = std::uint64_t{1} << (level % 64);
+    if (object) {
+      kinds_[level / 64] |= bit;
+    } else {
+      kinds_[level / 64] &= ~bit;
+    }
+  }
+
+  // "key": of an object, up to its value
+  bool key() {
+    skip_whitespace();
+    if (i_ == n_ || p_[i_] != '"') {
+      return fail("Expected a string key");
+    }
+    if (!string()) {
+      return false;
+    }
+    skip_whitespace();
+    if (i_ == n_ || p_[i_] != ':') {
+      return fail("Expected :");
+    }
+    ++i_;
+    return true;
+  }
+
+  bool string() {
+    // skip leading "
+    ++i_;
+    while (true) {
+      i_ += find_escape_char(std::string_view(p_ + i_, n_ - i_));
+      if (i_ == n_) {
+        return fail("Unterminated string");
+      }
+      char c = p_[i_];
+      if (c == '"') {
+        ++i_;
+        return true;
+      }
+      if (c == 0x7f) {
+        // DEL is escaped on output only
+        ++i_;
+        continue;
+      }
+      if (c != '\\') {
+        return fail("Control character in string");
+      }
+      if (i_ + 1 == n_) {
+        return fail("Unterminated string");
+      }
+      switch (p_[i_ + 1]) {
+      case '"':
+      case '\\':
+      case '/':
+      case 'b':
+      case 'f':
+      case 'n':
+      case 'r':
+      case 't':
+        i_ += 2;
+        break;
+      case 'u':
+        for (std::size_t k = 2; k < 6; ++k) {
+          if (i_ + k == n_ || !is_hex_digit(p_[i_ + k])) {
+            return fail("Invalid Unicode sequence");
+          }
+        }
+        i_ += 6;
+        break;
+      default:
+        return fail("Invalid string sequence");
+      }
+    }
+  }
+
+  // the digits at i_, false if there are none
+  bool digits() {
+    std::size_t start = i_;
+    while (i_ < n_ && is_digit(p_[i_])) {
+      ++i_;
+    }
+    return i_ != start;
+  }
+
+  bool number() {
+    if (p_[i_] == '-') {
+      ++i_;
+    }
+    if (i_ < n_ && p_[i_] == '0') {
+      // no leading zeros
+      ++i_;
+    } else if (!digits()) {
+      return fail("Invalid number format");
+    }
+    if (i_ < n_ && p_[i_] == '.') {
+      ++i_;
+      if (!digits()) {
+        return fail("Invalid number format: digit expected after dot");
+      }
+    }
+    if (i_ < n_ && (p_[i_] == 'e' || p_[i_] == 'E')) {
+      ++i_;
+      if (i_ < n_ && (p_[i_] == '+' || p_[i_] == '-')) {
+        ++i_;
+      }
+      if (!digits()) {
+        return fail("Invalid number format: digit expected");
+      }
+    }
+    return true;
+  }
+
+  bool literal() {
+    const char *expected = p_[i_] == 't'   ? "true"
+                           : p_[i_] == 'f' ? "false"
+                           : p_[i_] == 'n' ? "null"
+                                           : nullptr;
+    if (expected == nullptr) {
+      return fail("Invalid input");
+    }
+    std::size_t size = std::strlen(expected);
+    if (n_ - i_ < size || std::memcmp(p_ + i_, expected, size) != 0) {
+      return fail("Invalid literal");
+    }
+    i_ += size;
+    return true;
+  }
+
+  const char *p_;
+  std::size_t n_;
+  std::size_t i_ = 0;
+  std::uint64_t *kinds_;
+  const char *message_ = nullptr;
+};
+
+} // namespace
+
+ValidationResult validate_json(std::string_view text, std::size_t max_depth) {
+  std::uint64_t local[kLocalWords];
+  std::vector<std::uint64_t> heap;
+  std::uint64_t *kinds = local;
+  if (max_depth > kLocalWords * 64) {
+    heap.resize((max_depth + 63) / 64);
+    kinds = heap.data();
+  }
+
+  ValidationResult result;
+  Validator validator(text, kinds);
+  if (!validator.run(max_depth, result.documents)) {
+    result.valid = false;
+    result.offset = validator.offset();
+    result.message = validator.message();
+  } else {
+    result.offset = text.size();
+  }
+  // bytes outside of strings are ASCII once the structure is checked, so
+  // checking the text before the first error checks all its strings
+  std::string_view checked = text.substr(0, result.offset);
+  if (!is_utf8(checked)) {
+    result.valid = false;
+    result.offset = find_invalid_utf8(checked);
+    result.message = "Invalid UTF-8";
+  }
+  return result;
+}
+
+} // namespace jqcpp::json
@@ -0,0 +1,64 @@
+#include "jqcpp/mapped_file.hpp"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define JQCPP_HAVE_MMAP 1
+#endif
+
+namespace jqcpp {
+
+MappedFile::MappedFile(const std::string &path) {
+#ifdef JQCPP_HAVE_MMAP
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot open file " + path);
+  }
+  struct stat status;
+  if (::fstat(fd, &status) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Cannot open file " + path);
+  }
+  size_ = static_cast<std::size_t>(status.st_size);
+  if (size_ == 0) {
+    // nothing to map
+    ::close(fd);
+    return;
+  }
+  void *mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error("Cannot map file " + path);
+  }
+  mapping_ = mapping;
+  data_ = static_cast<const char *>(mapping);
+#else
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("Cannot open file " + path);
+  }
+  std::string bytes{std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>()};
+  buffer_.resize((bytes.size() + sizeof(std::uint64_t) - 1) /
+                 sizeof(std::uint64_t));
+  std::memcpy(buffer_.data(), bytes.data(), bytes.size());
+  data_ = reinterpret_cast<const char *>(buffer_.data());
+  size_ = bytes.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef JQCPP_HAVE_MMAP
+  if (mapping_ != nullptr) {
+    ::munmap(mapping_, size_);
+  }
+#endif
+}
+
+} // namespace jqcpp
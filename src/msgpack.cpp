@@ -0,0 +1,510 @@
+#include "jqcpp/msgpack.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace jqcpp::json {
+
+namespace {
+
+// big endian unsigned integer of size bytes at pos, nothing if truncated
+std::optional<std::uint64_t> load_be(std::string_view data, std::size_t pos,
+                                     std::size_t size) {
+  if (pos > data.size() || data.size() - pos < size) {
+    return std::nullopt;
+  }
+  std::uint64_t value = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    value = (value << 8) | static_cast<unsigned char>(data[pos + i]);
+  }
+  return value;
+}
+
+void store_be(std::uint64_t value, std::size_t size, OutputBuffer &out) {
+  for (std::size_t i = size; i-- > 0;) {
+    out.append(static_cast<char>((value >> (i * 8)) & 0xff));
+  }
+}
+
+double timestamp_seconds(std::int64_t seconds, std::uint32_t nanoseconds) {
+  return static_cast<double>(seconds) + nanoseconds / 1e9;
+}
+
+} // namespace
+
+std::size_t MsgPackReader::find_end(std::string_view data,
+                                    std::size_t offset) {
+  constexpr std::size_t npos = std::string_view::npos;
+  std::size_t pos = offset;
+  // values still to skip, containers add their items
+  std::size_t pending = 1;
+  while (pending > 0) {
+    if (pos >= data.size()) {
+      return npos;
+    }
+    auto tag = static_cast<unsigned char>(data[pos++]);
+    --pending;
+    // bytes of the length field and of the fixed size payload
+    std::size_t length_size = 0;
+    std::size_t payload = 0;
+    // the items are counted in pairs for maps
+    std::size_t items_per_entry = 0;
+    if (tag <= 0x7f || tag >= 0xe0 || tag == 0xc0 || tag == 0xc2 ||
+        tag == 0xc3) {
+      continue;
+    } else if (tag <= 0x8f) {
+      pending += 2 * (tag & 0x0f);
+      continue;
+    } else if (tag <= 0x9f) {
+      pending += tag & 0x0f;
+      continue;
+    } else if (tag <= 0xbf) {
+      payload = tag & 0x1f;
+    } else {
+      switch (tag) {
+      case 0xc4:
+      case 0xd9:
+        length_size = 1;
+        break;
+      case 0xc5:
+      case 0xda:
+        length_size = 2;
+        break;
+      case 0xc6:
+      case 0xdb:
+        length_size = 4;
+        break;
+      case 0xc7:
+        length_size = 1;
+        payload = 1;
+        break;
+      case 0xc8:
+        length_size = 2;
+        payload = 1;
+        break;
+      case 0xc9:
+        length_size = 4;
+        payload = 1;
+        break;
+      case 0xca:
+      case 0xce:
+      case 0xd2:
+        payload = 4;
+        break;
+      case 0xcb:
+      case 0xcf:
+      case 0xd3:
+        payload = 8;
+        break;
+      case 0xcc:
+      case 0xd0:
+        payload = 1;
+        break;
+      case 0xcd:
+      case 0xd1:
+        payload = 2;
+        break;
+      case 0xd4:
+      case 0xd5:
+      case 0xd6:
+      case 0xd7:
+      case 0xd8:
+        payload = 1 + (std::size_t{1} << (tag - 0xd4));
+        break;
+      case 0xdc:
+        length_size = 2;
+        items_per_entry = 1;
+        break;
+      case 0xdd:
+        length_size = 4;
+        items_per_entry = 1;
+        break;
+      case 0xde:
+        length_size = 2;
+        items_per_entry = 2;
+        break;
+      case 0xdf:
+        length_size = 4;
+        items_per_entry = 2;
+        break;
+      default:
+        throw MsgPackError("Invalid MessagePack type 0xc1");
+      }
+    }
+    std::uint64_t length = 0;
+    if (length_size > 0) {
+      auto value = load_be(data, pos, length_size);
+      if (!value) {
+        return npos;
+      }
+      length = *value;
+      pos += length_size;
+    }
+    if (items_per_entry > 0) {
+      pending += items_per_entry * length;
+      continue;
+    }
+    std::uint64_t skip = payload + length;
+    if (skip > data.size() - pos) {
+      return npos;
+    }
+    pos += skip;
+  }
+  return pos;
+}
+
+JSONValue MsgPackReader::read(std::string_view data, std::size_t &offset) {
+  data_ = data;
+  pos_ = offset;
+  JSONValue value = read_value();
+  offset = pos_;
+  return value;
+}
+
+std::string_view MsgPackReader::take(std::size_t size) {
+  if (pos_ > data_.size() || data_.size() - pos_ < size) {
+    throw MsgPackError("Truncated MessagePack data");
+  }
+  auto bytes = data_.substr(pos_, size);
+  pos_ += size;
+  return bytes;
+}
+
+std::uint64_t MsgPackReader::read_uint(std::size_t size) {
+  auto value = load_be(data_, pos_, size);
+  if (!value) {
+    throw MsgPackError("Truncated MessagePack data");
+  }
+  pos_ += size;
+  return *value;
+}
+
+// map keys are strings, integers are accepted and written in decimal
+std::string MsgPackReader::read_key() {
+  auto tag = static_cast<std::uint8_t>(take(1)[0]);
+  bool is_map = false;
+  std::size_t count = 0;
+  if (read_container(tag, is_map, count)) {
+    throw MsgPackError("MessagePack map keys should be strings");
+  }
+  JSONValue key = read_scalar(tag);
+  if (key.is_string()) {
+    return key.get_string();
+  }
+  if (key.is_integer()) {
+    return std::to_string(key.get_integer());
+  }
+  if (key.is_number() && std::trunc(key.get_number()) == key.get_number()) {
+    return std::to_string(static_cast<long long>(key.get_number()));
+  }
+  throw MsgPackError("MessagePack map keys should be strings");
+}
+
+JSONValue MsgPackReader::read_value() {
+  // left over from a read that threw
+  stack_.clear();
+  while (true) {
+    auto tag = static_cast<std::uint8_t>(take(1)[0]);
+    bool is_map = false;
+    std::size_t count = 0;
+    JSONValue value;
+    if (!read_container(tag, is_map, count)) {
+      value = read_scalar(tag);
+    } else {
+      if (stack_.size() >= max_depth_) {
+        throw MsgPackError("Exceeds depth limit for parsing");
+      }
+      if (count > 0) {
+        Frame &frame = stack_.emplace_back();
+        frame.is_map = is_map;
+        frame.left = count;
+        // a bogus count must not reserve more than the data can hold
+        std::size_t room = std::min<std::size_t>(count, data_.size() - pos_);
+        if (is_map) {
+          frame.object.reserve(room);
+          frame.key = read_key();
+        } else {
+          frame.array.reserve(room);
+        }
+        // on to its first item
+        continue;
+      }
+      value = is_map ? JSONValue(JSONObject()) : JSONValue(JSONArray());
+    }
+
+    // add the value to its container, closing the containers it completes
+    while (true) {
+      if (stack_.empty()) {
+        return value;
+      }
+      Frame &top = stack_.back();
+      if (top.is_map) {
+        jsonObjectInsert(top.object, top.key, std::move(value));
+      } else {
+        top.array.push_back(std::move(value));
+      }
+      if (--top.left > 0) {
+        if (top.is_map) {
+          top.key = read_key();
+        }
+        break;
+      }
+      value = top.is_map ? JSONValue(std::move(top.object))
+                         : JSONValue(std::move(top.array));
+      stack_.pop_back();
+    }
+  }
+}
+
+bool MsgPackReader::read_container(std::uint8_t tag, bool &is_map,
+                                   std::size_t &count) {
+  if (tag >= 0x80 && tag <= 0x9f) {
+    is_map = tag <= 0x8f;
+    count = tag & 0x0f;
+    return true;
+  }
+  if (tag < 0xdc || tag > 0xdf) {
+    return false;
+  }
+  // array 16, array 32, map 16 and map 32
+  is_map = tag >= 0xde;
+  count = read_uint(tag % 2 == 0 ? 2 : 4);
+  return true;
+}
+
+JSONValue MsgPackReader::read_scalar(std::uint8_t tag) {
+  // fixed size forms
+  if (tag <= 0x7f) {
+    return JSONValue(std::int64_t{tag});
+  }
+  if (tag >= 0xe0) {
+    return JSONValue(std::int64_t{static_cast<std::int8_t>(tag)});
+  }
+  if (tag >= 0xa0 && tag <= 0xbf) {
+    return JSONValue(std::string(take(tag & 0x1f)));
+  }
+
+  switch (tag) {
+  case 0xc0:
+    return JSONValue(nullptr);
+  case 0xc2:
+    return JSONValue(false);
+  case 0xc3:
+    return JSONValue(true);
+  // bin and str
+  case 0xc4:
+  case 0xd9:
+    return JSONValue(std::string(take(read_uint(1))));
+  case 0xc5:
+  case 0xda:
+    return JSONValue(std::string(take(read_uint(2))));
+  case 0xc6:
+  case 0xdb:
+    return JSONValue(std::string(take(read_uint(4))));
+  case 0xca: {
+    auto bits = static_cast<std::uint32_t>(read_uint(4));
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return JSONValue(static_cast<double>(value));
+  }
+  case 0xcb: {
+    std::uint64_t bits = read_uint(8);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return JSONValue(value);
+  }
+  case 0xcc:
+    return unsigned_number(read_uint(1));
+  case 0xcd:
+    return unsigned_number(read_uint(2));
+  case 0xce:
+    return unsigned_number(read_uint(4));
+  case 0xcf:
+    return unsigned_number(read_uint(8));
+  case 0xd0:
+    return JSONValue(std::int64_t{static_cast<std::int8_t>(read_uint(1))});
+  case 0xd1:
+    return JSONValue(std::int64_t{static_cast<std::int16_t>(read_uint(2))});
+  case 0xd2:
+    return JSONValue(std::int64_t{static_cast<std::int32_t>(read_uint(4))});
+  case 0xd3:
+    return JSONValue(static_cast<std::int64_t>(read_uint(8)));
+  default:
+    break;
+  }
+
+  // extensions, only the timestamp (-1) is known
+  std::size_t size = 0;
+  if (tag >= 0xd4 && tag <= 0xd8) {
+    size = std::size_t{1} << (tag - 0xd4);
+  } else if (tag == 0xc7) {
+    size = read_uint(1);
+  } else if (tag == 0xc8) {
+    size = read_uint(2);
+  } else if (tag == 0xc9) {
+    size = read_uint(4);
+  } else {
+    throw MsgPackError("Invalid MessagePack type 0xc1");
+  }
+  auto type = static_cast<std::int8_t>(read_uint(1));
+  std::string_view payload = take(size);
+  if (type == -1) {
+    if (size == 4) {
+      return JSONValue(static_cast<double>(*load_be(payload, 0, 4)));
+    }
+    if (size == 8) {
+      // 30 bits of nanoseconds, 34 bits of seconds
+      std::uint64_t bits = *load_be(payload, 0, 8);
+      return JSONValue(
+          timestamp_seconds(static_cast<std::int64_t>(bits & 0x3ffffffffULL),
+                            static_cast<std::uint32_t>(bits >> 34)));
+    }
+    if (size == 12) {
+      return JSONValue(timestamp_seconds(
+          static_cast<std::int64_t>(*load_be(payload, 4, 8)),
+          static_cast<std::uint32_t>(*load_be(payload, 0, 4))));
+    }
+    throw MsgPackError("Invalid MessagePack timestamp");
+  }
+  throw MsgPackError("Unsupported MessagePack extension type " +
+                     std::to_string(type));
+}
+
+void MsgPackWriter::write_header(std::uint8_t tag, std::uint64_t value,
+                                 std::size_t size, OutputBuffer &out) {
+  out.append(static_cast<char>(tag));
+  store_be(value, size, out);
+}
+
+// the smallest of the fix, 8, 16 and 32 bit length forms
+void MsgPackWriter::write_length(std::size_t length, std::uint8_t fix_tag,
+                                 std::size_t fix_limit, std::uint8_t tag8,
+                                 std::uint8_t tag16, std::uint8_t tag32,
+                                 OutputBuffer &out) {
+  if (length < fix_limit) {
+    out.append(static_cast<char>(fix_tag | length));
+  } else if (length <= 0xff && tag8 != 0) {
+    write_header(tag8, length, 1, out);
+  } else if (length <= 0xffff) {
+    write_header(tag16, length, 2, out);
+  } else if (length <= 0xffffffffULL) {
+    write_header(tag32, length, 4, out);
+  } else {
+    throw MsgPackError("Value too large for MessagePack");
+  }
+}
+
+void MsgPackWriter::write_string(std::string_view value, OutputBuffer &out) {
+  write_length(value.size(), 0xa0, 32, 0xd9, 0xda, 0xdb, out);
+  out.append(value);
+}
+
+void MsgPackWriter::write_unsigned(std::uint64_t number, OutputBuffer &out) {
+  if (number <= 0x7f) {
+    out.append(static_cast<char>(number));
+  } else if (number <= 0xff) {
+    write_header(0xcc, number, 1, out);
+  } else if (number <= 0xffff) {
+    write_header(0xcd, number, 2, out);
+  } else if (number <= 0xffffffffULL) {
+    write_header(0xce, number, 4, out);
+  } else {
+    write_header(0xcf, number, 8, out);
+  }
+}
+
+void MsgPackWriter::write_integer(std::int64_t number, OutputBuffer &out) {
+  if (number >= 0) {
+    write_unsigned(static_cast<std::uint64_t>(number), out);
+    return;
+  }
+  auto bits = static_cast<std::uint64_t>(number);
+  if (number >= -32) {
+    out.append(static_cast<char>(number));
+  } else if (number >= -128) {
+    write_header(0xd0, bits & 0xff, 1, out);
+  } else if (number >= -32768) {
+    write_header(0xd1, bits & 0xffff, 2, out);
+  } else if (number >= -2147483648LL) {
+    write_header(0xd2, bits & 0xffffffffULL, 4, out);
+  } else {
+    write_header(0xd3, bits, 8, out);
+  }
+}
+
+void MsgPackWriter::write_number(double value, OutputBuffer &out) {
+  // -0 keeps its sign as a float
+  bool integral =
+      std::trunc(value) == value && !(value == 0 && std::signbit(value));
+  if (integral && value >= 0 && value < 18446744073709551616.0) {
+    write_unsigned(static_cast<std::uint64_t>(value), out);
+    return;
+  }
+  if (integral && value < 0 && value >= -9223372036854775808.0) {
+    write_integer(static_cast<std::int64_t>(value), out);
+    return;
+  }
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  write_header(0xcb, bits, 8, out);
+}
+
+void MsgPackWriter::write(const JSONValue &root, OutputBuffer &out) {
+  // the open containers and the index of their next child
+  std::vector<std::pair<const JSONValue *, std::size_t>> stack;
+  const JSONValue *value = &root;
+  while (value) {
+    if (value->is_array()) {
+      write_length(value->get_array().size(), 0x90, 16, 0, 0xdc, 0xdd, out);
+      stack.emplace_back(value, 0);
+    } else if (value->is_object()) {
+      write_length(value->get_object().size(), 0x80, 16, 0, 0xde, 0xdf, out);
+      stack.emplace_back(value, 0);
+    } else {
+      write_scalar(*value, out);
+    }
+
+    value = nullptr;
+    while (!stack.empty()) {
+      auto &[container, next] = stack.back();
+      if (container->is_array()) {
+        const auto &array = container->get_array();
+        if (next < array.size()) {
+          value = &array[next++];
+          break;
+        }
+      } else {
+        const auto &object = container->get_object();
+        if (next < object.size()) {
+          const auto &[key, member] = object[next++];
+          write_string(key, out);
+          value = &member;
+          break;
+        }
+      }
+      stack.pop_back();
+      out.maybe_flush();
+    }
+  }
+}
+
+void MsgPackWriter::write_scalar(const JSONValue &value, OutputBuffer &out) {
+  if (value.is_null()) {
+    out.append(static_cast<char>(0xc0));
+  } else if (value.is_bool()) {
+    out.append(static_cast<char>(value.get_bool() ? 0xc3 : 0xc2));
+  } else if (value.is_integer()) {
+    write_integer(value.get_integer(), out);
+  } else if (value.is_number_text()) {
+    write_scalar(value.number_value(), out);
+  } else if (value.is_number()) {
+    write_number(value.get_number(), out);
+  } else if (value.is_string()) {
+    write_string(value.get_string(), out);
+  }
+}
+
+} // namespace jqcpp::json
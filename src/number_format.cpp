@@ -0,0 +1,44 @@
+#include "jqcpp/number_format.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace jqcpp::json {
+
+std::size_t format_number(double value, char *buffer) {
+  char *end = buffer + kNumberBufferSize;
+  if (std::isnan(value)) {
+    std::memcpy(buffer, "null", 4);
+    return 4;
+  }
+  if (std::isinf(value)) {
+    value = value > 0 ? std::numeric_limits<double>::max()
+                      : std::numeric_limits<double>::lowest();
+  }
+
+  // integer fast path, e.g. ids, counters and timestamps
+  // (-0 is left to to_chars so the sign survives)
+  if (value > -1e17 && value < 1e17) {
+    auto integer = static_cast<std::int64_t>(value);
+    if (static_cast<double>(integer) == value &&
+        !(integer == 0 && std::signbit(value))) {
+      auto result = std::to_chars(buffer, end, integer);
+      return static_cast<std::size_t>(result.ptr - buffer);
+    }
+  }
+
+  // shortest round trip representation, independent of the locale
+  auto result = std::to_chars(buffer, end, value);
+  return static_cast<std::size_t>(result.ptr - buffer);
+}
+
+bool parse_integer(std::string_view text, std::int64_t &value) {
+  const char *end = text.data() + text.size();
+  auto [ptr, ec] = std::from_chars(text.data(), end, value);
+  // a fraction or an exponent stops from_chars early
+  return ec == std::errc() && ptr == end && !(value == 0 && text[0] == '-');
+}
+
+} // namespace jqcpp::json
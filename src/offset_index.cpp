@@ -0,0 +1,259 @@
+#include "jqcpp/offset_index.hpp"
+#include "jqcpp/json_sax.hpp"
+#include "jqcpp/json_validator.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace jqcpp::json {
+
+namespace {
+
+constexpr char kMagic[] = "JQIDX001";
+constexpr std::uint64_t kByteOrderMark = 0x0102030405060708ULL;
+
+struct IndexHeader {
+  char magic[8];
+  std::uint64_t byte_order;
+  std::uint64_t source_size;
+  std::int64_t source_time;
+  // 0 for an array, 1 for an object
+  std::uint64_t kind;
+  std::uint64_t count;
+  std::uint64_t key_bytes;
+};
+static_assert(sizeof(IndexHeader) == 56, "the header is 56 bytes");
+
+std::runtime_error scan_error(const char *message, std::size_t pos) {
+  return std::runtime_error(std::string(message) + " at offset " +
+                            std::to_string(pos));
+}
+
+bool is_space(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+std::size_t skip_space(std::string_view text, std::size_t pos) {
+  while (pos < text.size() && is_space(text[pos])) {
+    ++pos;
+  }
+  return pos;
+}
+
+// pos is on the opening quote, returns the offset past the closing one
+std::size_t skip_string(std::string_view text, std::size_t pos) {
+  ++pos;
+  while (true) {
+    pos = text.find_first_of("\"\\", pos);
+    if (pos == std::string_view::npos) {
+      throw scan_error("Unterminated string", text.size());
+    }
+    if (text[pos] == '"') {
+      return pos + 1;
+    }
+    pos += 2;
+  }
+}
+
+// the end of the value at pos, nested values are only matched up as the
+// text is validated before
+std::size_t skip_value(std::string_view text, std::size_t pos) {
+  char c = text[pos];
+  if (c == '"') {
+    return skip_string(text, pos);
+  }
+  if (c == '[' || c == '{') {
+    std::size_t depth = 0;
+    while (pos < text.size()) {
+      c = text[pos];
+      if (c == '"') {
+        pos = skip_string(text, pos);
+        continue;
+      }
+      if (c == '[' || c == '{') {
+        ++depth;
+      } else if ((c == ']' || c == '}') && --depth == 0) {
+        return pos + 1;
+      }
+      ++pos;
+    }
+    throw scan_error("Unexpected end of the input", pos);
+  }
+  while (pos < text.size() && !is_space(text[pos]) && text[pos] != ',' &&
+         text[pos] != ']' && text[pos] != '}') {
+    ++pos;
+  }
+  return pos;
+}
+
+// keeps the decoded string of a key with escapes
+struct KeyDecoder : JSONHandler {
+  std::string value;
+  void on_string(std::string_view text) override { value = text; }
+};
+
+} // namespace
+
+std::string offset_index_path(const std::string &source) {
+  return source + ".jqidx";
+}
+
+void build_offset_index(std::string_view text, std::int64_t source_time,
+                        std::ostream &out, std::size_t max_depth) {
+  ValidationResult valid = validate_json(text, max_depth);
+  if (!valid.valid) {
+    throw scan_error(valid.message, valid.offset);
+  }
+  std::size_t pos = skip_space(text, 0);
+  if (pos >= text.size() || (text[pos] != '[' && text[pos] != '{')) {
+    throw std::runtime_error("The index needs a top level array or object");
+  }
+  bool is_array = text[pos] == '[';
+  char close = is_array ? ']' : '}';
+  std::vector<std::uint64_t> entries;
+  std::string keys;
+  std::size_t count = 0;
+  pos = skip_space(text, pos + 1);
+  if (pos < text.size() && text[pos] == close) {
+    ++pos;
+  } else {
+    while (true) {
+      if (pos >= text.size()) {
+        throw scan_error("Unexpected end of the input", pos);
+      }
+      std::uint64_t key_offset = keys.size();
+      if (!is_array) {
+        if (text[pos] != '"') {
+          throw scan_error("Expected a key", pos);
+        }
+        std::size_t end = skip_string(text, pos);
+        std::string_view quoted = text.substr(pos, end - pos);
+        if (quoted.find('\\') == std::string_view::npos) {
+          keys.append(quoted.substr(1, quoted.size() - 2));
+        } else {
+          KeyDecoder decoder;
+          JSONSAXParser().parse(quoted, decoder);
+          keys.append(decoder.value);
+        }
+        pos = skip_space(text, end);
+        if (pos >= text.size() || text[pos] != ':') {
+          throw scan_error("Expected ':'", pos);
+        }
+        pos = skip_space(text, pos + 1);
+        if (pos >= text.size()) {
+          throw scan_error("Unexpected end of the input", pos);
+        }
+      }
+      std::size_t start = pos;
+      pos = skip_value(text, pos);
+      entries.push_back(start);
+      entries.push_back(pos);
+      if (!is_array) {
+        entries.push_back(key_offset);
+        entries.push_back(keys.size() - key_offset);
+      }
+      ++count;
+      pos = skip_space(text, pos);
+      if (pos < text.size() && text[pos] == ',') {
+        pos = skip_space(text, pos + 1);
+        continue;
+      }
+      if (pos < text.size() && text[pos] == close) {
+        ++pos;
+        break;
+      }
+      throw scan_error(is_array ? "Expected ',' or ']'" : "Expected ',' or '}'",
+                       pos);
+    }
+  }
+  if (skip_space(text, pos) != text.size()) {
+    throw std::runtime_error("The index needs a single top level value");
+  }
+
+  IndexHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(header.magic));
+  header.byte_order = kByteOrderMark;
+  header.source_size = text.size();
+  header.source_time = source_time;
+  header.kind = is_array ? 0 : 1;
+  header.count = count;
+  header.key_bytes = keys.size();
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(entries.data()),
+            static_cast<std::streamsize>(entries.size() *
+                                         sizeof(std::uint64_t)));
+  out.write(keys.data(), static_cast<std::streamsize>(keys.size()));
+  out.flush();
+  if (!out) {
+    throw std::runtime_error("Cannot write the index");
+  }
+}
+
+OffsetIndex::OffsetIndex(const std::string &path) : file_(path) {
+  IndexHeader header;
+  if (file_.size() < sizeof(header) ||
+      std::memcmp(file_.data(), kMagic, sizeof(header.magic)) != 0) {
+    throw std::runtime_error("Not a jqcpp index: " + path);
+  }
+  std::memcpy(&header, file_.data(), sizeof(header));
+  if (header.byte_order != kByteOrderMark || header.kind > 1) {
+    throw std::runtime_error("Not a jqcpp index: " + path);
+  }
+  is_array_ = header.kind == 0;
+  entry_words_ = is_array_ ? 2 : 4;
+  std::size_t body = file_.size() - sizeof(header);
+  std::size_t entry_size = entry_words_ * sizeof(std::uint64_t);
+  if (header.count > body / entry_size ||
+      header.key_bytes != body - header.count * entry_size) {
+    throw std::runtime_error("Truncated index: " + path);
+  }
+  count_ = header.count;
+  source_size_ = header.source_size;
+  source_time_ = header.source_time;
+  const char *entries = file_.data() + sizeof(header);
+  entries_ = reinterpret_cast<const std::uint64_t *>(entries);
+  keys_ = std::string_view(entries + count_ * entry_size, header.key_bytes);
+}
+
+bool OffsetIndex::matches(std::uint64_t source_size,
+                          std::int64_t source_time) const {
+  return source_size == source_size_ && source_time == source_time_;
+}
+
+std::uint64_t OffsetIndex::entry(std::size_t i, std::size_t field) const {
+  return entries_[i * entry_words_ + field];
+}
+
+std::string_view OffsetIndex::value(std::string_view source,
+                                    std::size_t i) const {
+  std::uint64_t start = entry(i, 0);
+  std::uint64_t end = entry(i, 1);
+  if (start > end || end > source.size()) {
+    throw std::runtime_error("Invalid index entry " + std::to_string(i));
+  }
+  return source.substr(start, end - start);
+}
+
+std::string_view OffsetIndex::key(std::size_t i) const {
+  if (is_array_) {
+    return {};
+  }
+  std::uint64_t offset = entry(i, 2);
+  std::uint64_t length = entry(i, 3);
+  if (offset > keys_.size() || length > keys_.size() - offset) {
+    throw std::runtime_error("Invalid index entry " + std::to_string(i));
+  }
+  return keys_.substr(offset, length);
+}
+
+std::optional<std::size_t> OffsetIndex::find(std::string_view key) const {
+  // duplicate keys keep the last value, as in the parsed JSONValue
+  for (std::size_t i = count_; i-- > 0;) {
+    if (this->key(i) == key) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace jqcpp::json
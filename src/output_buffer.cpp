@@ -0,0 +1,29 @@
+#include "jqcpp/output_buffer.hpp"
+#include <utility>
+
+namespace jqcpp::json {
+
+OutputBuffer::OutputBuffer(std::ostream &sink, std::size_t chunk_size)
+    : sink_(&sink), chunk_size_(chunk_size) {
+  // leave some headroom so a chunk rarely triggers a reallocation
+  buffer_.reserve(chunk_size_ + chunk_size_ / 4);
+}
+
+OutputBuffer::~OutputBuffer() { flush(); }
+
+void OutputBuffer::flush() {
+  if (sink_ == nullptr || buffer_.empty()) {
+    return;
+  }
+  sink_->write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  // keep the capacity, the buffer is reused for the next chunk
+  buffer_.clear();
+}
+
+std::string OutputBuffer::take() {
+  std::string out = std::move(buffer_);
+  buffer_.clear();
+  return out;
+}
+
+} // namespace jqcpp::json
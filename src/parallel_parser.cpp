@@ -0,0 +1,195 @@
+#include "jqcpp/parallel_parser.hpp"
+#include "jqcpp/json_parser.hpp"
+#include "jqcpp/json_tokenizer.hpp"
+#include <algorithm>
+#include <cctype>
+#include <exception>
+#include <thread>
+
+namespace jqcpp::json {
+
+namespace {
+
+bool is_space(char c) { return std::isspace(static_cast<unsigned char>(c)); }
+
+std::size_t skip_space(std::string_view text, std::size_t pos) {
+  while (pos < text.size() && is_space(text[pos])) {
+    ++pos;
+  }
+  return pos;
+}
+
+// parse the elements in spans[first, last) into out, nested at most
+// max_depth levels below the top level array
+void parse_chunk(std::string_view text, const std::vector<ElementSpan> &spans,
+                 std::size_t first, std::size_t last, std::size_t max_depth,
+                 bool lazy_numbers, JSONArray &out) {
+  JSONTokenizer tokenizer;
+  JSONParser parser(max_depth);
+  parser.set_lazy_numbers(lazy_numbers);
+  out.reserve(last - first);
+  for (std::size_t i = first; i < last; ++i) {
+    const auto &span = spans[i];
+    auto tokens = tokenizer.tokenize(
+        text.substr(span.begin, span.end - span.begin));
+    out.push_back(parser.parse(tokens));
+    // e.g. [1 2], the element has more than one value
+    if (!parser.finished()) {
+      throw JSONParserError("Unexpected token type");
+    }
+  }
+}
+
+} // namespace
+
+std::optional<std::vector<ElementSpan>>
+find_array_elements(std::string_view text) {
+  std::size_t pos = skip_space(text, 0);
+  if (pos >= text.size() || text[pos] != '[') {
+    return std::nullopt;
+  }
+  ++pos;
+
+  std::vector<ElementSpan> spans;
+  std::size_t depth = 0;
+  std::size_t begin = skip_space(text, pos);
+  bool in_string = false;
+  bool empty_array = begin < text.size() && text[begin] == ']';
+
+  for (; pos < text.size(); ++pos) {
+    char c = text[pos];
+    if (in_string) {
+      if (c == '\\') {
+        // skip the escaped char
+        ++pos;
+      } else if (c == '"') {
+        in_string = false;
+      }
+      continue;
+    }
+    switch (c) {
+    case '"':
+      in_string = true;
+      break;
+    case '[':
+    case '{':
+      ++depth;
+      break;
+    case '}':
+      if (depth == 0) {
+        return std::nullopt;
+      }
+      --depth;
+      break;
+    case ']':
+      if (depth > 0) {
+        --depth;
+        break;
+      }
+      // end of the top level array
+      if (!empty_array) {
+        spans.push_back({begin, pos});
+      }
+      // only whitespace may follow
+      if (skip_space(text, pos + 1) != text.size()) {
+        return std::nullopt;
+      }
+      return spans;
+    case ',':
+      if (depth == 0) {
+        spans.push_back({begin, pos});
+        begin = pos + 1;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  // unterminated array or string
+  return std::nullopt;
+}
+
+ParallelJSONParser::ParallelJSONParser(unsigned threads,
+                                       std::size_t min_parallel_bytes)
+    : threads_(threads), min_parallel_bytes_(min_parallel_bytes) {
+  if (threads_ == 0) {
+    threads_ = std::max(1u, std::thread::hardware_concurrency());
+  }
+}
+
+JSONValue ParallelJSONParser::parse_serial(std::string_view text) {
+  JSONTokenizer tokenizer;
+  JSONParser parser(max_depth_);
+  parser.set_lazy_numbers(lazy_numbers_);
+  return parser.parse(tokenizer.tokenize(text));
+}
+
+JSONValue ParallelJSONParser::parse(std::string_view text) {
+  if (threads_ < 2 || text.size() < min_parallel_bytes_ || max_depth_ < 2) {
+    return parse_serial(text);
+  }
+  auto spans = find_array_elements(text);
+  if (!spans) {
+    return parse_serial(text);
+  }
+
+  // split the elements into chunks of about the same number of bytes
+  std::size_t chunk_count = std::min<std::size_t>(
+      threads_, std::max<std::size_t>(spans->size(), 1));
+  std::size_t target = text.size() / chunk_count + 1;
+  std::vector<std::size_t> bounds = {0};
+  std::size_t chunk_bytes = 0;
+  for (std::size_t i = 0; i < spans->size(); ++i) {
+    chunk_bytes += (*spans)[i].end - (*spans)[i].begin;
+    if (chunk_bytes >= target && bounds.size() < chunk_count) {
+      bounds.push_back(i + 1);
+      chunk_bytes = 0;
+    }
+  }
+  if (bounds.back() != spans->size()) {
+    bounds.push_back(spans->size());
+  }
+
+  std::size_t chunks = bounds.size() - 1;
+  std::vector<JSONArray> parts(chunks);
+  std::vector<std::exception_ptr> errors(chunks);
+  auto run_chunk = [&](std::size_t c) {
+    try {
+      parse_chunk(text, *spans, bounds[c], bounds[c + 1], max_depth_ - 1,
+                  lazy_numbers_, parts[c]);
+    } catch (...) {
+      errors[c] = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(chunks);
+  for (std::size_t c = 1; c < chunks; ++c) {
+    workers.emplace_back(run_chunk, c);
+  }
+  // the calling thread takes the first chunk
+  if (chunks > 0) {
+    run_chunk(0);
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  // report the error of the first broken element
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // splice the parts in order
+  JSONArray result;
+  result.reserve(spans->size());
+  for (auto &part : parts) {
+    for (auto &value : part) {
+      result.push_back(std::move(value));
+    }
+  }
+  return JSONValue(std::move(result));
+}
+
+} // namespace jqcpp::json
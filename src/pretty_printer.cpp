@@ -5,105 +5,299 @@
 
 #include "jqcpp/pretty_printer.hpp"
 #include "jqcpp/json_value.hpp"
-#include <sstream>
+#include "jqcpp/number_format.hpp"
+#include "jqcpp/string_escape.hpp"
+#include <algorithm>
+#include <charconv>
+#include <string_view>
 
 namespace jqcpp::json {
 
+JSONPrinter::JSONPrinter(const PrintOptions &options) {
+  if (options.use_tab) {
+    indent_char_ = '\t';
+    indent_width_ = 1;
+  } else {
+    indent_width_ =
+        static_cast<std::size_t>(std::max(options.indent_width, 0));
+  }
+  compact_ = options.compact || indent_width_ == 0;
+}
+
 /**
- * @brief pretty print a json object
+ * @brief pretty print a json object into a string
  *
  * @param value
  * @param indent
  * @return
  */
 std::string JSONPrinter::print(const JSONValue &value, int indent) {
-  std::string out;
-  if (value.is_null()) {
-    return "null";
-  } else if (value.is_bool()) {
-    return value.get_bool() ? "true" : "false";
-  } else if (value.is_number()) {
-    std::ostringstream oss;
-    // oss << std::setprecision(std::numeric_limits<double>::max_digits10)
-    //     << value.get_number();
-    oss << value.get_number();
-    return oss.str();
-  } else if (value.is_string()) {
-    return "\"" + value.get_string() + "\"";
-  } else if (value.is_array()) {
-    return print_array(value.get_array(), indent);
-  } else if (value.is_object()) {
-    return print_object(value.get_object(), indent);
+  OutputBuffer out;
+  print(value, out, indent);
+  return out.take();
+}
+
+/**
+ * @brief print a json object, appending to the output buffer
+ *
+ * @param value
+ * @param out
+ * @param indent
+ */
+void JSONPrinter::print(const JSONValue &value, OutputBuffer &out,
+                        int indent) {
+  if (compact_) {
+    print_value<false>(value, out, indent);
+  } else {
+    print_value<true>(value, out, indent);
   }
-  return "";
 }
 
 /**
- * @brief get a indent string, the default indent space for each
- * level is 2
+ * @brief print a value of a tape, same output as for its JSONValue
  *
- * @param indent indent level
- * @return
+ * The tape is read in order, so the printer walks memory front to back.
+ * An object which repeats a key is built as a JSONValue first, that keeps
+ * the member order and values of JSONParser.
  */
-std::string JSONPrinter::indent_string(int indent) {
-  return std::string(indent * 2, ' ');
+void JSONPrinter::print(const TapeRef &value, OutputBuffer &out, int indent) {
+  if (compact_) {
+    print_value<false>(value, out, indent);
+  } else {
+    print_value<true>(value, out, indent);
+  }
+}
+
+// an object which repeats a key is built first, as for print
+void JSONPrinter::print_values(const TapeRef &object, OutputBuffer &out,
+                               int indent) {
+  if (!object.unique_keys()) {
+    JSONValue built = object.to_value();
+    JSONArray values;
+    for (const auto &[key, member] : built.get_object()) {
+      values.push_back(member.deepCopy());
+    }
+    print(JSONValue(std::move(values)), out, indent);
+  } else if (compact_) {
+    print_value<false>(object, out, indent, true);
+  } else {
+    print_value<true>(object, out, indent, true);
+  }
 }
 
 /**
- * @brief pretty print out a object
+ * @brief the serializer, Pretty selects the layout
  *
- * @param obj
- * @param indent
- * @return a string
+ * compact, e.g. {"a":[1,2]}, or pretty
  * {
- *    "a": 1,
- *    "b": 2
+ *   "a": [
+ *     1,
+ *     2
+ *   ]
  * }
+ * A container is opened by pushing it on the stack, then each step prints
+ * the next child of the innermost container, or closes it once it has none
+ * left.
  */
-std::string JSONPrinter::print_object(const JSONObject &obj, int indent) {
-  if (obj.empty()) {
-    return "{}";
+template <bool Pretty>
+void JSONPrinter::print_value(const JSONValue &root, OutputBuffer &out,
+                              int indent) {
+  // the stack may hold the containers of an outer call, see the tape
+  std::size_t base = value_stack_.size();
+  const JSONValue *value = &root;
+  while (value) {
+    if (value->is_array() && !value->get_array().empty()) {
+      out.append('[');
+      value_stack_.push_back({value, 0});
+    } else if (value->is_object() && !value->get_object().empty()) {
+      out.append('{');
+      value_stack_.push_back({value, 0});
+    } else {
+      print_scalar(*value, out);
+    }
+
+    value = nullptr;
+    while (value_stack_.size() > base) {
+      ValueFrame &top = value_stack_.back();
+      int depth = indent + static_cast<int>(value_stack_.size() - base);
+      if (top.value->is_array()) {
+        const auto &array = top.value->get_array();
+        if (top.next < array.size()) {
+          write_separator<Pretty>(top.next == 0, depth, out);
+          value = &array[top.next++];
+          break;
+        }
+        write_close<Pretty>(']', depth - 1, out);
+      } else {
+        const auto &object = top.value->get_object();
+        if (top.next < object.size()) {
+          write_separator<Pretty>(top.next == 0, depth, out);
+          const auto &[key, member] = object[top.next++];
+          write_escaped_string(key, out);
+          out.append(Pretty ? ": " : ":");
+          value = &member;
+          break;
+        }
+        write_close<Pretty>('}', depth - 1, out);
+      }
+      value_stack_.pop_back();
+    }
   }
-  std::ostringstream oss;
-  // print {
-  oss << "{\n";
-  // output each key:value
-  bool first = true;
-  for (const auto &[key, value] : obj) {
-    //"key": value,
-    // if not the first key:value
-    // need to output a newline
-    if (!first) {
-      oss << ",\n";
+}
+
+template <bool Pretty>
+void JSONPrinter::print_value(const TapeRef &root, OutputBuffer &out,
+                              int indent, bool values) {
+  const TapeView &tape = root.tape();
+  std::size_t base = tape_stack_.size();
+  std::size_t index = root.index();
+  bool more = true;
+  while (more) {
+    TapeRef value(tape, index);
+    if (values) {
+      // the root object, as an array
+      values = false;
+      out.append('[');
+      if (value.size() == 0) {
+        out.append(']');
+      } else {
+        tape_stack_.push_back({index + 1, value.end() - 1, false, true, true});
+      }
+    } else if (value.is_object() && !value.unique_keys()) {
+      int depth = indent + static_cast<int>(tape_stack_.size() - base);
+      print_value<Pretty>(value.to_value(), out, depth);
+    } else if ((value.is_array() || value.is_object()) && value.size() != 0) {
+      out.append(value.is_array() ? '[' : '{');
+      tape_stack_.push_back(
+          {index + 1, value.end() - 1, value.is_array(), true, false});
+    } else {
+      print_scalar(value, out);
+    }
+
+    more = false;
+    while (tape_stack_.size() > base) {
+      TapeFrame &top = tape_stack_.back();
+      int depth = indent + static_cast<int>(tape_stack_.size() - base);
+      if (top.next != top.last) {
+        write_separator<Pretty>(top.first, depth, out);
+        top.first = false;
+        index = top.next;
+        if (!top.is_array) {
+          TapeRef key(tape, index);
+          if (!top.values) {
+            write_escaped_string(key.get_string(), out);
+            out.append(Pretty ? ": " : ":");
+          }
+          index = key.end();
+        }
+        top.next = TapeRef(tape, index).end();
+        more = true;
+        break;
+      }
+      write_close<Pretty>(top.is_array || top.values ? ']' : '}', depth - 1,
+                          out);
+      tape_stack_.pop_back();
     }
-    first = false;
-    oss << indent_string(indent + 1) << "\"" << key
-        << "\": " << print(value, indent + 1);
   }
-  // after output all the key:values
-  // output the }
-  oss << "\n" << indent_string(indent) << "}";
+}
 
-  return oss.str();
+template <bool Pretty>
+void JSONPrinter::write_separator(bool first, int indent, OutputBuffer &out) {
+  if (!first) {
+    out.append(',');
+  }
+  if constexpr (Pretty) {
+    out.append('\n');
+    write_indent(out, indent);
+  }
 }
 
-std::string JSONPrinter::print_array(const JSONArray &arr, int indent) {
-  if (arr.empty()) {
-    return "[]";
+template <bool Pretty>
+void JSONPrinter::write_close(char bracket, int indent, OutputBuffer &out) {
+  if constexpr (Pretty) {
+    out.append('\n');
+    write_indent(out, indent);
   }
+  out.append(bracket);
+  out.maybe_flush();
+}
 
-  std::ostringstream oss;
-  oss << "[\n";
-  bool first = true;
-  for (const auto &value : arr) {
-    if (!first) {
-      oss << ",\n";
-    }
-    first = false;
-    oss << indent_string(indent + 1) << print(value, indent + 1);
+void JSONPrinter::print_scalar(const JSONValue &value, OutputBuffer &out) {
+  if (value.is_string()) {
+    write_escaped_string(value.get_string(), out);
+  } else if (value.is_number_text()) {
+    out.append(value.get_number_text());
+  } else if (value.is_integer()) {
+    print_integer(value.get_integer(), out);
+  } else if (value.is_number()) {
+    print_number(value.get_number(), out);
+  } else if (value.is_bool()) {
+    out.append(value.get_bool() ? "true" : "false");
+  } else if (value.is_array()) {
+    out.append("[]");
+  } else if (value.is_object()) {
+    out.append("{}");
+  } else {
+    out.append("null");
+  }
+}
+
+void JSONPrinter::print_scalar(const TapeRef &value, OutputBuffer &out) {
+  switch (value.tag()) {
+  case TapeTag::String:
+    write_escaped_string(value.get_string(), out);
+    break;
+  case TapeTag::Number:
+    print_number(value.get_number(), out);
+    break;
+  case TapeTag::Integer:
+    print_integer(value.get_integer(), out);
+    break;
+  case TapeTag::True:
+    out.append("true");
+    break;
+  case TapeTag::False:
+    out.append("false");
+    break;
+  case TapeTag::StartArray:
+    out.append("[]");
+    break;
+  case TapeTag::StartObject:
+    out.append("{}");
+    break;
+  default:
+    out.append("null");
   }
-  oss << "\n" << indent_string(indent) << "]";
-  return oss.str();
+}
+
+/**
+ * @brief output the indent of a level, the default indent for each
+ * level is 2 spaces
+ *
+ * @param out
+ * @param indent indent level
+ */
+void JSONPrinter::write_indent(OutputBuffer &out, int indent) {
+  std::size_t width = static_cast<std::size_t>(indent) * indent_width_;
+  if (indent_cache_.size() < width) {
+    indent_cache_.assign(width, indent_char_);
+  }
+  out.append(std::string_view(indent_cache_.data(), width));
+}
+
+/**
+ * @brief shortest round trip text of the number, see format_number
+ */
+void JSONPrinter::print_number(double number, OutputBuffer &out) {
+  char buf[kNumberBufferSize];
+  out.append(std::string_view(buf, format_number(number, buf)));
+}
+
+// integers are exact, all their digits are printed
+void JSONPrinter::print_integer(std::int64_t number, OutputBuffer &out) {
+  char buf[kNumberBufferSize];
+  auto result = std::to_chars(buf, buf + sizeof(buf), number);
+  out.append(std::string_view(buf, result.ptr - buf));
 }
 
 } // namespace jqcpp::json
@@ -0,0 +1,92 @@
+#include "jqcpp/snapshot.hpp"
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+namespace jqcpp::json {
+
+namespace {
+
+// the last two digits are the version of the tape format
+constexpr char kMagic[kSnapshotMagicSize + 1] = "JQSNAP03";
+constexpr std::size_t kVersionSize = 2;
+// reads back as another number on a host of the other byte order
+constexpr std::uint64_t kByteOrderMark = 0x0102030405060708ULL;
+
+struct SnapshotHeader {
+  char magic[kSnapshotMagicSize];
+  std::uint64_t byte_order;
+  std::uint64_t words;
+  std::uint64_t string_bytes;
+};
+static_assert(sizeof(SnapshotHeader) == 32, "the header is 32 bytes");
+
+} // namespace
+
+void save_snapshot(const TapeView &tape, std::ostream &out) {
+  SnapshotHeader header;
+  std::memcpy(header.magic, kMagic, kSnapshotMagicSize);
+  header.byte_order = kByteOrderMark;
+  header.words = tape.size;
+  header.string_bytes = tape.strings.size();
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(tape.words),
+            static_cast<std::streamsize>(tape.size * sizeof(std::uint64_t)));
+  out.write(tape.strings.data(),
+            static_cast<std::streamsize>(tape.strings.size()));
+  out.flush();
+  if (!out) {
+    throw std::runtime_error("Cannot write the snapshot");
+  }
+}
+
+bool is_snapshot(std::string_view prefix) {
+  std::string_view name(kMagic, kSnapshotMagicSize - kVersionSize);
+  return prefix.size() >= kSnapshotMagicSize &&
+         prefix.substr(0, name.size()) == name;
+}
+
+Snapshot::Snapshot(const std::string &path)
+    : file_(std::make_unique<MappedFile>(path)) {
+  load(file_->data(), file_->size());
+}
+
+Snapshot::Snapshot(std::istream &in) {
+  std::string bytes{std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>()};
+  buffer_.resize((bytes.size() + sizeof(std::uint64_t) - 1) /
+                 sizeof(std::uint64_t));
+  std::memcpy(buffer_.data(), bytes.data(), bytes.size());
+  load(reinterpret_cast<const char *>(buffer_.data()), bytes.size());
+}
+
+Snapshot::~Snapshot() = default;
+
+void Snapshot::load(const char *data, std::size_t size) {
+  SnapshotHeader header;
+  if (size < sizeof(header) ||
+      !is_snapshot(std::string_view(data, kSnapshotMagicSize))) {
+    throw std::runtime_error("Not a jqcpp snapshot");
+  }
+  if (std::string_view(data, kSnapshotMagicSize) != kMagic) {
+    throw std::runtime_error(
+        "The snapshot was written by another version of jqcpp");
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (header.byte_order != kByteOrderMark) {
+    throw std::runtime_error(
+        "The snapshot was written on a host of another byte order");
+  }
+  std::size_t body = size - sizeof(header);
+  if (header.words > body / sizeof(std::uint64_t) ||
+      header.string_bytes != body - header.words * sizeof(std::uint64_t)) {
+    throw std::runtime_error("Truncated snapshot");
+  }
+  const char *words = data + sizeof(header);
+  tape_.words = reinterpret_cast<const std::uint64_t *>(words);
+  tape_.size = header.words;
+  tape_.strings = std::string_view(
+      words + header.words * sizeof(std::uint64_t), header.string_bytes);
+}
+
+} // namespace jqcpp::json
@@ -0,0 +1,356 @@
+#include "jqcpp/string_escape.hpp"
+#include "jqcpp/cpu_dispatch.hpp"
+#include "jqcpp/json_tokenizer.hpp"
+#include "jqcpp/utf8.hpp"
+#include <cstdint>
+
+#if defined(JQCPP_X86_DISPATCH)
+#include <immintrin.h>
+#endif
+
+namespace jqcpp::json {
+
+namespace {
+
+bool needs_escape(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\' || c == 0x7f;
+}
+
+std::size_t find_escape_char_scalar(std::string_view s) {
+  for (std::size_t i = 0; i < s.size(); ++i) {
+    if (needs_escape(static_cast<unsigned char>(s[i]))) {
+      return i;
+    }
+  }
+  return s.size();
+}
+
+std::size_t find_string_end_scalar(std::string_view s, bool &ascii) {
+  for (std::size_t i = 0; i < s.size(); ++i) {
+    char c = s[i];
+    if (c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20) {
+      return i;
+    }
+    if (static_cast<unsigned char>(c) >= 0x80) {
+      ascii = false;
+    }
+  }
+  return s.size();
+}
+
+#if defined(JQCPP_X86_DISPATCH)
+// true when the high bit of a byte below the first set bit of stop is set
+bool high_before(std::uint64_t high, std::uint64_t stop) {
+  if (stop == 0) {
+    return high != 0;
+  }
+  return (high & ((std::uint64_t{1} << __builtin_ctzll(stop)) - 1)) != 0;
+}
+
+// the kernels of each level scan whole blocks and leave the rest to the
+// level below
+
+// bit i is set when byte i of the block needs escaping
+JQCPP_TARGET("sse2") unsigned escape_mask_16(const char *p) {
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  // unsigned v <= 0x1f  <=>  min(v, 0x1f) == v
+  __m128i hit = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v);
+  hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+  hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+  hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+  return static_cast<unsigned>(_mm_movemask_epi8(hit));
+}
+
+JQCPP_TARGET("sse2") std::size_t find_escape_char_sse2(std::string_view s) {
+  std::size_t i = 0;
+  for (; i + 16 <= s.size(); i += 16) {
+    if (unsigned mask = escape_mask_16(s.data() + i)) {
+      return i + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+  }
+  return i + find_escape_char_scalar(s.substr(i));
+}
+
+JQCPP_TARGET("avx2") unsigned escape_mask_32(const char *p) {
+  const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  __m256i hit =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1f)), v);
+  hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+  hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+  hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f)));
+  return static_cast<unsigned>(_mm256_movemask_epi8(hit));
+}
+
+JQCPP_TARGET("avx2") std::size_t find_escape_char_avx2(std::string_view s) {
+  std::size_t i = 0;
+  for (; i + 32 <= s.size(); i += 32) {
+    if (unsigned mask = escape_mask_32(s.data() + i)) {
+      return i + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+  }
+  return i + find_escape_char_sse2(s.substr(i));
+}
+
+JQCPP_TARGET("avx512f,avx512bw")
+std::uint64_t escape_mask_64(const char *p) {
+  const __m512i v = _mm512_loadu_si512(p);
+  return _mm512_cmple_epu8_mask(v, _mm512_set1_epi8(0x1f)) |
+         _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('"')) |
+         _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\\')) |
+         _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(0x7f));
+}
+
+JQCPP_TARGET("avx512f,avx512bw")
+std::size_t find_escape_char_avx512(std::string_view s) {
+  std::size_t i = 0;
+  for (; i + 64 <= s.size(); i += 64) {
+    if (std::uint64_t mask = escape_mask_64(s.data() + i)) {
+      return i + static_cast<std::size_t>(__builtin_ctzll(mask));
+    }
+  }
+  return i + find_escape_char_avx2(s.substr(i));
+}
+
+// bit i of stop is set when byte i of the block is a quote, a backslash or
+// a control character
+JQCPP_TARGET("sse2")
+std::size_t find_string_end_sse2(std::string_view s, bool &ascii) {
+  std::size_t i = 0;
+  for (; i + 16 <= s.size(); i += 16) {
+    __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + i));
+    __m128i hit = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v);
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+    auto stop = static_cast<unsigned>(_mm_movemask_epi8(hit));
+    if (high_before(static_cast<unsigned>(_mm_movemask_epi8(v)), stop)) {
+      ascii = false;
+    }
+    if (stop != 0) {
+      return i + static_cast<std::size_t>(__builtin_ctz(stop));
+    }
+  }
+  return i + find_string_end_scalar(s.substr(i), ascii);
+}
+
+JQCPP_TARGET("avx2")
+std::size_t find_string_end_avx2(std::string_view s, bool &ascii) {
+  std::size_t i = 0;
+  for (; i + 32 <= s.size(); i += 32) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s.data() + i));
+    __m256i hit =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1f)), v);
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+    auto stop = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+    if (high_before(static_cast<unsigned>(_mm256_movemask_epi8(v)), stop)) {
+      ascii = false;
+    }
+    if (stop != 0) {
+      return i + static_cast<std::size_t>(__builtin_ctz(stop));
+    }
+  }
+  return i + find_string_end_sse2(s.substr(i), ascii);
+}
+
+JQCPP_TARGET("avx512f,avx512bw")
+std::size_t find_string_end_avx512(std::string_view s, bool &ascii) {
+  std::size_t i = 0;
+  for (; i + 64 <= s.size(); i += 64) {
+    __m512i v = _mm512_loadu_si512(s.data() + i);
+    std::uint64_t stop = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('"')) |
+                         _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\\')) |
+                         _mm512_cmple_epu8_mask(v, _mm512_set1_epi8(0x1f));
+    if (high_before(_mm512_movepi8_mask(v), stop)) {
+      ascii = false;
+    }
+    if (stop != 0) {
+      return i + static_cast<std::size_t>(__builtin_ctzll(stop));
+    }
+  }
+  return i + find_string_end_avx2(s.substr(i), ascii);
+}
+#endif
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+std::uint32_t read_hex4(std::string_view text, std::size_t &pos) {
+  std::uint32_t code = 0;
+  for (int i = 0; i < 4; ++i) {
+    int digit = pos < text.size() ? hex_value(text[pos]) : -1;
+    if (digit < 0) {
+      throw JSONTokenizerError("Invalid Unicode sequence");
+    }
+    code = code * 16 + static_cast<std::uint32_t>(digit);
+    ++pos;
+  }
+  return code;
+}
+
+} // namespace
+
+void detail::bind_string_kernels(SimdLevel level, detail::SimdKernels &table) {
+  table.find_escape_char = find_escape_char_scalar;
+  table.find_string_end = find_string_end_scalar;
+#if defined(JQCPP_X86_DISPATCH)
+  switch (level) {
+  case SimdLevel::Scalar:
+    break;
+  case SimdLevel::Sse2:
+  case SimdLevel::Ssse3:
+    table.find_escape_char = find_escape_char_sse2;
+    table.find_string_end = find_string_end_sse2;
+    break;
+  case SimdLevel::Avx2:
+    table.find_escape_char = find_escape_char_avx2;
+    table.find_string_end = find_string_end_avx2;
+    break;
+  case SimdLevel::Avx512:
+    table.find_escape_char = find_escape_char_avx512;
+    table.find_string_end = find_string_end_avx512;
+    break;
+  }
+#else
+  (void)level;
+#endif
+}
+
+std::size_t find_escape_char(std::string_view s) {
+  return detail::kernels().find_escape_char(s);
+}
+
+std::size_t find_string_end(std::string_view s, bool &ascii) {
+  return detail::kernels().find_string_end(s, ascii);
+}
+
+void unescape_string(std::string_view text, std::size_t &pos,
+                     std::string &out) {
+  while (true) {
+    // copy the run up to the next quote or escape in bulk
+    bool ascii = true;
+    std::string_view rest = text.substr(pos);
+    std::size_t run = find_string_end(rest, ascii);
+    if (ascii || is_utf8(rest.substr(0, run))) {
+      out.append(rest.substr(0, run));
+    } else {
+      append_utf8_lossy(rest.substr(0, run), out);
+    }
+    pos += run;
+    if (pos == text.size()) {
+      throw JSONTokenizerError("Unterminated string");
+    }
+    if (static_cast<unsigned char>(text[pos]) < 0x20) {
+      throw JSONTokenizerError("Control character in string");
+    }
+    if (text[pos++] == '"') {
+      return;
+    }
+    if (pos == text.size()) {
+      throw JSONTokenizerError("Unexpected termination");
+    }
+    char esc = text[pos++];
+    switch (esc) {
+    case '"':
+    case '\\':
+    case '/':
+      out += esc;
+      break;
+    case 'b':
+      out += '\b';
+      break;
+    case 'f':
+      out += '\f';
+      break;
+    case 'n':
+      out += '\n';
+      break;
+    case 'r':
+      out += '\r';
+      break;
+    case 't':
+      out += '\t';
+      break;
+    case 'u': {
+      std::uint32_t code = read_hex4(text, pos);
+      if (code >= 0xD800 && code <= 0xDBFF &&
+          text.substr(pos, 2) == "\\u") {
+        // high surrogate, combine with the low one
+        std::size_t saved = pos;
+        pos += 2;
+        std::uint32_t low = read_hex4(text, pos);
+        if (low >= 0xDC00 && low <= 0xDFFF) {
+          code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        } else {
+          pos = saved;
+        }
+      }
+      if (code >= 0xD800 && code <= 0xDFFF) {
+        // lone surrogate, same replacement as jq
+        code = 0xFFFD;
+      }
+      append_utf8(out, code);
+      break;
+    }
+    default:
+      throw JSONTokenizerError("Invalid string sequence");
+    }
+  }
+}
+
+void write_escaped_string(std::string_view s, OutputBuffer &out) {
+  static const char hex[] = "0123456789abcdef";
+  out.append('"');
+  while (!s.empty()) {
+    std::size_t clean = find_escape_char(s);
+    // bulk copy the run which needs no escaping
+    out.append(s.substr(0, clean));
+    if (clean == s.size()) {
+      break;
+    }
+    unsigned char c = static_cast<unsigned char>(s[clean]);
+    switch (c) {
+    case '"':
+      out.append("\\\"");
+      break;
+    case '\\':
+      out.append("\\\\");
+      break;
+    case '\b':
+      out.append("\\b");
+      break;
+    case '\f':
+      out.append("\\f");
+      break;
+    case '\n':
+      out.append("\\n");
+      break;
+    case '\r':
+      out.append("\\r");
+      break;
+    case '\t':
+      out.append("\\t");
+      break;
+    default: {
+      // other control chars and DEL
+      const char escaped[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+      out.append(std::string_view(escaped, sizeof(escaped)));
+    }
+    }
+    s.remove_prefix(clean + 1);
+  }
+  out.append('"');
+}
+
+} // namespace jqcpp::json
@@ -0,0 +1,481 @@
+#include "jqcpp/tape.hpp"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace jqcpp::json {
+
+namespace {
+
+constexpr std::uint64_t kPayloadMask = (std::uint64_t{1} << 56) - 1;
+// set in the end word of an object which repeats a key, next to the count
+constexpr std::uint64_t kRepeatedKeys = std::uint64_t{1} << 55;
+constexpr std::uint64_t kCountMask = kRepeatedKeys - 1;
+// objects up to this size are checked for repeated keys pair by pair
+constexpr std::size_t kSmallObject = 8;
+constexpr std::size_t kMaxSharedKeys = 64 * 1024;
+
+std::uint64_t make_word(TapeTag tag, std::uint64_t payload) {
+  return (static_cast<std::uint64_t>(tag) << 56) | (payload & kPayloadMask);
+}
+
+TapeTag word_tag(std::uint64_t word) { return TapeTag(word >> 56); }
+
+} // namespace
+
+TapeRef::TapeRef(const TapeView &tape, std::size_t index)
+    : tape_(&tape), index_(index) {
+  tag_ = word_tag(word(index));
+  switch (tag_) {
+  case TapeTag::Null:
+  case TapeTag::True:
+  case TapeTag::False:
+  case TapeTag::Number:
+  case TapeTag::Integer:
+  case TapeTag::String:
+  case TapeTag::StartArray:
+  case TapeTag::StartObject:
+    break;
+  default:
+    throw TapeError("Invalid tape: no value at " + std::to_string(index));
+  }
+}
+
+std::uint64_t TapeRef::word(std::size_t index) const {
+  if (index >= tape_->size) {
+    throw TapeError("Invalid tape: index " + std::to_string(index) +
+                    " past the end");
+  }
+  return tape_->words[index];
+}
+
+std::size_t TapeRef::end() const {
+  switch (tag_) {
+  case TapeTag::Number:
+  case TapeTag::Integer:
+  case TapeTag::String:
+    return index_ + 2;
+  case TapeTag::StartArray:
+  case TapeTag::StartObject: {
+    std::size_t end = word(index_) & kPayloadMask;
+    if (end < index_ + 2 || end > tape_->size) {
+      throw TapeError("Invalid tape: bad container end");
+    }
+    return end;
+  }
+  default:
+    return index_ + 1;
+  }
+}
+
+double TapeRef::get_number() const {
+  std::uint64_t bits = word(index_ + 1);
+  if (tag_ == TapeTag::Integer) {
+    return static_cast<double>(static_cast<std::int64_t>(bits));
+  }
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+std::int64_t TapeRef::get_integer() const {
+  return static_cast<std::int64_t>(word(index_ + 1));
+}
+
+std::string_view TapeRef::get_string() const {
+  std::uint64_t offset = word(index_) & kPayloadMask;
+  std::uint64_t length = word(index_ + 1);
+  const auto &strings = tape_->strings;
+  if (offset > strings.size() || length > strings.size() - offset) {
+    throw TapeError("Invalid tape: string out of range");
+  }
+  return strings.substr(offset, length);
+}
+
+std::uint64_t TapeRef::close_word() const {
+  std::uint64_t close = word(end() - 1);
+  auto expected = is_array() ? TapeTag::EndArray : TapeTag::EndObject;
+  if (word_tag(close) != expected) {
+    throw TapeError("Invalid tape: bad container end");
+  }
+  return close;
+}
+
+std::size_t TapeRef::size() const {
+  if (!is_array() && !is_object()) {
+    return 0;
+  }
+  return close_word() & kCountMask;
+}
+
+bool TapeRef::unique_keys() const {
+  return !is_object() || (close_word() & kRepeatedKeys) == 0;
+}
+
+TapeRange<TapeRef> TapeRef::elements() const {
+  if (!is_array()) {
+    throw TapeError("Not an array");
+  }
+  return {*tape_, index_ + 1, end() - 1};
+}
+
+TapeRange<TapeMember> TapeRef::members() const {
+  if (!is_object()) {
+    throw TapeError("Not an object");
+  }
+  return {*tape_, index_ + 1, end() - 1};
+}
+
+std::optional<TapeRef> TapeRef::at(std::size_t index) const {
+  std::size_t n = 0;
+  for (TapeRef element : elements()) {
+    if (n++ == index) {
+      return element;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<TapeRef> TapeRef::find(std::string_view key) const {
+  std::optional<TapeRef> found;
+  for (const auto &member : members()) {
+    // duplicate keys keep the last value, as in the parsed JSONValue
+    if (member.key == key) {
+      found = member.value;
+    }
+  }
+  return found;
+}
+
+JSONValue TapeRef::to_value() const {
+  // an open container, the index of its next child and of its end word
+  struct Frame {
+    bool is_array;
+    bool unique;
+    std::size_t next;
+    std::size_t last;
+    JSONArray array;
+    JSONObject object;
+    std::string key;
+  };
+  std::vector<Frame> stack;
+  TapeRef ref = *this;
+  while (true) {
+    JSONValue value;
+    bool opened = false;
+    switch (ref.tag_) {
+    case TapeTag::Null:
+      value = JSONValue(nullptr);
+      break;
+    case TapeTag::True:
+      value = JSONValue(true);
+      break;
+    case TapeTag::False:
+      value = JSONValue(false);
+      break;
+    case TapeTag::Number:
+      value = JSONValue(ref.get_number());
+      break;
+    case TapeTag::Integer:
+      value = JSONValue(ref.get_integer());
+      break;
+    case TapeTag::String:
+      value = JSONValue(std::string(ref.get_string()));
+      break;
+    default: {
+      Frame &frame = stack.emplace_back();
+      frame.is_array = ref.is_array();
+      frame.unique = ref.unique_keys();
+      frame.next = ref.index_ + 1;
+      frame.last = ref.end() - 1;
+      if (frame.is_array) {
+        frame.array.reserve(ref.size());
+      } else {
+        frame.object.reserve(ref.size());
+      }
+      opened = true;
+      break;
+    }
+    }
+
+    // add the value to its container, closing the containers it completes,
+    // until a child is left to build
+    while (true) {
+      if (!opened) {
+        if (stack.empty()) {
+          return value;
+        }
+        Frame &top = stack.back();
+        if (top.is_array) {
+          top.array.push_back(std::move(value));
+        } else if (top.unique) {
+          top.object.emplace_back(std::move(top.key), std::move(value));
+        } else {
+          jsonObjectInsert(top.object, top.key, std::move(value));
+        }
+      }
+      opened = false;
+      Frame &top = stack.back();
+      if (top.next != top.last) {
+        std::size_t index = top.next;
+        if (!top.is_array) {
+          TapeRef key(*tape_, index);
+          top.key = key.get_string();
+          index = key.end();
+        }
+        ref = TapeRef(*tape_, index);
+        top.next = ref.end();
+        break;
+      }
+      value = top.is_array ? JSONValue(std::move(top.array))
+                           : JSONValue(std::move(top.object));
+      stack.pop_back();
+    }
+  }
+}
+
+JSONValue TapeRef::slice(std::size_t start, std::size_t end) const {
+  JSONArray array;
+  std::size_t n = 0;
+  for (TapeRef element : elements()) {
+    if (n >= end) {
+      break;
+    }
+    if (n++ >= start) {
+      array.push_back(element.to_value());
+    }
+  }
+  return JSONValue(std::move(array));
+}
+
+void TapeBuilder::add(TapeTag tag, std::uint64_t payload) {
+  tape_.words.push_back(make_word(tag, payload));
+}
+
+void TapeBuilder::add_string(std::string_view value) {
+  add(TapeTag::String, strings_base_ + tape_.strings.size());
+  tape_.words.push_back(value.size());
+  tape_.strings.append(value);
+}
+
+void TapeBuilder::on_key(std::string_view key) {
+  if (spill_ && open_.size() == 1) {
+    top_keys_.push_back(std::hash<std::string_view>()(key));
+  }
+  std::string name(key);
+  auto it = keys_.find(name);
+  if (it == keys_.end()) {
+    // objects keyed by ids would fill the table for nothing
+    if (keys_.size() >= kMaxSharedKeys) {
+      add_string(key);
+      return;
+    }
+    it = keys_.emplace(std::move(name), strings_base_ + tape_.strings.size())
+             .first;
+    tape_.strings.append(key);
+    if (spill_) {
+      spilled_keys_.emplace(it->second, it->first);
+    }
+  }
+  add(TapeTag::String, it->second);
+  tape_.words.push_back(key.size());
+}
+
+void TapeBuilder::start(TapeTag tag) {
+  if (open_.empty()) {
+    top_keys_.clear();
+  }
+  open_.emplace_back(words_base_ + tape_.words.size(), 0);
+  add(tag, 0);
+}
+
+bool TapeBuilder::repeats_key(std::size_t start, std::size_t count) {
+  if (spill_ && open_.empty()) {
+    // a top level object, its first members may be spilled
+    std::sort(top_keys_.begin(), top_keys_.end());
+    // equal hashes only cost the fast paths of the tape
+    return std::adjacent_find(top_keys_.begin(), top_keys_.end()) !=
+           top_keys_.end();
+  }
+  std::string_view small[kSmallObject];
+  seen_keys_.clear();
+  std::size_t n = 0;
+  // nested values are never spilled, all members are in memory
+  for (std::size_t i = start + 1 - words_base_; i < tape_.words.size(); ++n) {
+    std::string_view name =
+        key_text(tape_.words[i] & kPayloadMask, tape_.words[i + 1]);
+    if (count <= kSmallObject) {
+      if (std::find(small, small + n, name) != small + n) {
+        return true;
+      }
+      small[n] = name;
+    } else if (!seen_keys_.insert(name).second) {
+      return true;
+    }
+    i = next_value(i + 2);
+  }
+  return false;
+}
+
+std::size_t TapeBuilder::next_value(std::size_t i) const {
+  std::uint64_t word = tape_.words[i];
+  switch (word_tag(word)) {
+  case TapeTag::Number:
+  case TapeTag::Integer:
+  case TapeTag::String:
+    return i + 2;
+  case TapeTag::StartArray:
+  case TapeTag::StartObject:
+    return (word & kPayloadMask) - words_base_;
+  default:
+    return i + 1;
+  }
+}
+
+std::string_view TapeBuilder::key_text(std::uint64_t offset,
+                                       std::uint64_t length) const {
+  if (offset >= strings_base_) {
+    return std::string_view(tape_.strings)
+        .substr(offset - strings_base_, length);
+  }
+  return spilled_keys_.at(offset);
+}
+
+void TapeBuilder::end(TapeTag tag) {
+  auto [start, count] = open_.back();
+  open_.pop_back();
+  std::uint64_t payload = count;
+  if (tag == TapeTag::EndObject && count > 1 && repeats_key(start, count)) {
+    payload |= kRepeatedKeys;
+  }
+  add(tag, payload);
+  auto start_tag =
+      tag == TapeTag::EndArray ? TapeTag::StartArray : TapeTag::StartObject;
+  std::uint64_t word =
+      make_word(start_tag, words_base_ + tape_.words.size());
+  if (start >= words_base_) {
+    tape_.words[start - words_base_] = word;
+  } else {
+    spill_->patch(start, word);
+  }
+  value_done();
+}
+
+void TapeBuilder::value_done() {
+  if (!open_.empty()) {
+    ++open_.back().second;
+  }
+  if (spill_ && open_.size() <= 1 &&
+      tape_.words.size() * sizeof(std::uint64_t) + tape_.strings.size() >=
+          budget_) {
+    spill();
+  }
+}
+
+void TapeBuilder::spill_to(Spill &spill, std::size_t budget) {
+  spill_ = &spill;
+  budget_ = budget;
+}
+
+void TapeBuilder::spill() {
+  spill_->write(tape_);
+  words_base_ += tape_.words.size();
+  strings_base_ += tape_.strings.size();
+  tape_.words.clear();
+  tape_.strings.clear();
+}
+
+void TapeBuilder::on_string(std::string_view value) {
+  add_string(value);
+  value_done();
+}
+
+void TapeBuilder::on_number(double value, std::string_view) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  add(TapeTag::Number, 0);
+  tape_.words.push_back(bits);
+  value_done();
+}
+
+void TapeBuilder::on_integer(std::int64_t value, std::string_view) {
+  add(TapeTag::Integer, 0);
+  tape_.words.push_back(static_cast<std::uint64_t>(value));
+  value_done();
+}
+
+void TapeBuilder::on_bool(bool value) {
+  add(value ? TapeTag::True : TapeTag::False, 0);
+  value_done();
+}
+
+void TapeBuilder::on_null() {
+  add(TapeTag::Null, 0);
+  value_done();
+}
+
+void TapeBuilder::on_value(const JSONValue &root) {
+  // the open containers and the index of their next child
+  std::vector<std::pair<const JSONValue *, std::size_t>> stack;
+  const JSONValue *value = &root;
+  while (value) {
+    if (value->is_array()) {
+      on_start_array();
+      stack.emplace_back(value, 0);
+    } else if (value->is_object()) {
+      on_start_object();
+      stack.emplace_back(value, 0);
+    } else if (value->is_null()) {
+      on_null();
+    } else if (value->is_bool()) {
+      on_bool(value->get_bool());
+    } else if (value->is_number_text()) {
+      on_number_text(value->get_number_text());
+    } else if (value->is_integer()) {
+      on_integer(value->get_integer(), {});
+    } else if (value->is_number()) {
+      on_number(value->get_number(), {});
+    } else if (value->is_string()) {
+      on_string(value->get_string());
+    }
+
+    value = nullptr;
+    while (!stack.empty()) {
+      auto &[container, next] = stack.back();
+      if (container->is_array()) {
+        const auto &array = container->get_array();
+        if (next < array.size()) {
+          value = &array[next++];
+          break;
+        }
+        on_end_array();
+      } else {
+        const auto &object = container->get_object();
+        if (next < object.size()) {
+          const auto &[key, member] = object[next++];
+          on_key(key);
+          value = &member;
+          break;
+        }
+        on_end_object();
+      }
+      stack.pop_back();
+    }
+  }
+}
+
+Tape TapeBuilder::take() {
+  if (!open_.empty()) {
+    throw TapeError("Incomplete document on the tape");
+  }
+  Tape tape = std::move(tape_);
+  tape_ = Tape();
+  keys_.clear();
+  spilled_keys_.clear();
+  words_base_ = 0;
+  strings_base_ = 0;
+  return tape;
+}
+
+} // namespace jqcpp::json
@@ -0,0 +1,405 @@
+#include "jqcpp/utf8.hpp"
+#include "jqcpp/cpu_dispatch.hpp"
+
+#if defined(JQCPP_X86_DISPATCH)
+#include <immintrin.h>
+#endif
+
+namespace jqcpp::json {
+
+namespace {
+
+// the length of the valid sequence starting at s[i], 0 if none does
+std::size_t sequence_length(std::string_view s, std::size_t i) {
+  auto c = static_cast<unsigned char>(s[i]);
+  if (c < 0x80) {
+    return 1;
+  }
+  std::size_t length;
+  std::uint32_t code;
+  if (c >= 0xc2 && c <= 0xdf) {
+    length = 2;
+    code = c & 0x1f;
+  } else if (c >= 0xe0 && c <= 0xef) {
+    length = 3;
+    code = c & 0x0f;
+  } else if (c >= 0xf0 && c <= 0xf4) {
+    length = 4;
+    code = c & 0x07;
+  } else {
+    return 0;
+  }
+  if (s.size() - i < length) {
+    return 0;
+  }
+  for (std::size_t k = 1; k < length; ++k) {
+    auto next = static_cast<unsigned char>(s[i + k]);
+    if ((next & 0xc0) != 0x80) {
+      return 0;
+    }
+    code = (code << 6) | (next & 0x3f);
+  }
+  // overlong forms, surrogates and code points past U+10FFFF
+  if ((length == 3 && code < 0x800) || (length == 4 && code < 0x10000) ||
+      (code >= 0xd800 && code <= 0xdfff) || code > 0x10ffff) {
+    return 0;
+  }
+  return length;
+}
+
+std::size_t find_non_ascii_scalar(std::string_view s) {
+  for (std::size_t i = 0; i < s.size(); ++i) {
+    if (static_cast<unsigned char>(s[i]) >= 0x80) {
+      return i;
+    }
+  }
+  return s.size();
+}
+
+// checks the sequences one by one, used below SSSE3
+bool is_utf8_scalar(std::string_view s) {
+  return find_invalid_utf8(s) == s.size();
+}
+
+#if defined(JQCPP_X86_DISPATCH)
+JQCPP_TARGET("sse2") std::size_t find_non_ascii_sse2(std::string_view s) {
+  std::size_t i = 0;
+  for (; i + 16 <= s.size(); i += 16) {
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + i))));
+    if (mask != 0) {
+      return i + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+  }
+  return i + find_non_ascii_scalar(s.substr(i));
+}
+
+JQCPP_TARGET("avx2") std::size_t find_non_ascii_avx2(std::string_view s) {
+  std::size_t i = 0;
+  for (; i + 32 <= s.size(); i += 32) {
+    auto mask = static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s.data() + i))));
+    if (mask != 0) {
+      return i + static_cast<std::size_t>(__builtin_ctz(mask));
+    }
+  }
+  return i + find_non_ascii_sse2(s.substr(i));
+}
+
+JQCPP_TARGET("avx512f,avx512bw")
+std::size_t find_non_ascii_avx512(std::string_view s) {
+  std::size_t i = 0;
+  for (; i + 64 <= s.size(); i += 64) {
+    std::uint64_t mask = _mm512_movepi8_mask(_mm512_loadu_si512(s.data() + i));
+    if (mask != 0) {
+      return i + static_cast<std::size_t>(__builtin_ctzll(mask));
+    }
+  }
+  return i + find_non_ascii_avx2(s.substr(i));
+}
+
+// the error bits of Keiser and Lemire, each names a pair of the previous
+// and the current byte which can't follow each other
+constexpr std::uint8_t kTooShort = 1 << 0;
+constexpr std::uint8_t kTooLong = 1 << 1;
+constexpr std::uint8_t kOverlong3 = 1 << 2;
+constexpr std::uint8_t kTooLarge = 1 << 3;
+constexpr std::uint8_t kSurrogate = 1 << 4;
+constexpr std::uint8_t kOverlong2 = 1 << 5;
+constexpr std::uint8_t kTooLarge1000 = 1 << 6;
+constexpr std::uint8_t kOverlong4 = 1 << 6;
+constexpr std::uint8_t kTwoConts = 1 << 7;
+constexpr std::uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+constexpr std::uint8_t kLarge = kCarry | kTooLarge | kTooLarge1000;
+constexpr std::uint8_t kCont = kTooLong | kOverlong2 | kTwoConts;
+
+// errors by the high nibble of the previous byte
+alignas(16) constexpr std::uint8_t kByte1High[16] = {
+    // ASCII
+    kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+    kTooLong,
+    // continuation
+    kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+    // two byte leads
+    kTooShort | kOverlong2, kTooShort,
+    // three byte lead
+    kTooShort | kOverlong3 | kSurrogate,
+    // four byte lead
+    kTooShort | kTooLarge | kTooLarge1000 | kOverlong4};
+
+// errors by the low nibble of the previous byte
+alignas(16) constexpr std::uint8_t kByte1Low[16] = {
+    kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+    kCarry | kOverlong2,
+    kCarry,
+    kCarry,
+    kCarry | kTooLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge,
+    kLarge | kSurrogate,
+    kLarge,
+    kLarge};
+
+// errors by the high nibble of the current byte
+alignas(16) constexpr std::uint8_t kByte2High[16] = {
+    // ASCII
+    kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+    kTooShort, kTooShort,
+    // 1000____, 1001____, 101_____
+    kCont | kOverlong3 | kTooLarge1000 | kOverlong4,
+    kCont | kOverlong3 | kTooLarge, kCont | kSurrogate | kTooLarge,
+    kCont | kSurrogate | kTooLarge,
+    // leads
+    kTooShort, kTooShort, kTooShort, kTooShort};
+
+// a block ends inside a sequence when one of its last three bytes is above
+// these, the 16 byte blocks use the second half
+alignas(32) constexpr std::uint8_t kIncompleteMax[32] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1};
+
+JQCPP_TARGET("ssse3") __m128i load_table_16(const std::uint8_t *table) {
+  return _mm_load_si128(reinterpret_cast<const __m128i *>(table));
+}
+
+// the error bits of the 16 bytes of input, prev is the block before
+JQCPP_TARGET("ssse3") __m128i block_errors_16(__m128i input, __m128i prev) {
+  const __m128i low_nibble = _mm_set1_epi8(0x0f);
+  __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+  __m128i special = _mm_and_si128(
+      _mm_and_si128(
+          _mm_shuffle_epi8(load_table_16(kByte1High),
+                           _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble)),
+          _mm_shuffle_epi8(load_table_16(kByte1Low),
+                           _mm_and_si128(prev1, low_nibble))),
+      _mm_shuffle_epi8(load_table_16(kByte2High),
+                       _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble)));
+
+  // the third and fourth bytes of 3 and 4 byte sequences must be
+  // continuations, where special already expects two of them in a row
+  __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+  __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+  __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(char(0xe0 - 0x80)));
+  __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(char(0xf0 - 0x80)));
+  __m128i must_continue = _mm_and_si128(_mm_or_si128(third, fourth),
+                                        _mm_set1_epi8(char(0x80)));
+  return _mm_xor_si128(must_continue, special);
+}
+
+// fold the block input into errors, an ASCII block only checks that no
+// sequence of the block before is cut
+JQCPP_TARGET("ssse3")
+void check_block_16(__m128i input, __m128i &prev, __m128i &errors,
+                    __m128i &incomplete) {
+  if (_mm_movemask_epi8(input) == 0) {
+    errors = _mm_or_si128(errors, incomplete);
+  } else {
+    errors = _mm_or_si128(errors, block_errors_16(input, prev));
+    incomplete = _mm_subs_epu8(input, load_table_16(kIncompleteMax + 16));
+  }
+  prev = input;
+}
+
+JQCPP_TARGET("ssse3") bool is_utf8_ssse3(std::string_view s) {
+  __m128i errors = _mm_setzero_si128();
+  __m128i prev = _mm_setzero_si128();
+  __m128i incomplete = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 16 <= s.size(); i += 16) {
+    check_block_16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + i)),
+        prev, errors, incomplete);
+  }
+  if (i < s.size()) {
+    // the tail padded with ASCII zeros
+    alignas(16) char tail[16] = {};
+    s.copy(tail, s.size() - i, i);
+    check_block_16(_mm_load_si128(reinterpret_cast<const __m128i *>(tail)),
+                   prev, errors, incomplete);
+  }
+  errors = _mm_or_si128(errors, incomplete);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(errors, _mm_setzero_si128())) ==
+         0xffff;
+}
+
+JQCPP_TARGET("avx2") __m256i load_table_32(const std::uint8_t *table) {
+  return _mm256_broadcastsi128_si256(
+      _mm_load_si128(reinterpret_cast<const __m128i *>(table)));
+}
+
+// input shifted right by n bytes, with the last bytes of prev shifted in
+template <int N>
+JQCPP_TARGET("avx2")
+__m256i previous_32(__m256i input, __m256i prev) {
+  return _mm256_alignr_epi8(
+      input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+// the same check as block_errors_16 on 32 bytes, the tables are repeated
+// in both 128 bit lanes
+JQCPP_TARGET("avx2") __m256i block_errors_32(__m256i input, __m256i prev) {
+  const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+  __m256i prev1 = previous_32<1>(input, prev);
+  __m256i special = _mm256_and_si256(
+      _mm256_and_si256(
+          _mm256_shuffle_epi8(
+              load_table_32(kByte1High),
+              _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble)),
+          _mm256_shuffle_epi8(load_table_32(kByte1Low),
+                              _mm256_and_si256(prev1, low_nibble))),
+      _mm256_shuffle_epi8(
+          load_table_32(kByte2High),
+          _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble)));
+
+  __m256i third = _mm256_subs_epu8(previous_32<2>(input, prev),
+                                   _mm256_set1_epi8(char(0xe0 - 0x80)));
+  __m256i fourth = _mm256_subs_epu8(previous_32<3>(input, prev),
+                                    _mm256_set1_epi8(char(0xf0 - 0x80)));
+  __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                           _mm256_set1_epi8(char(0x80)));
+  return _mm256_xor_si256(must_continue, special);
+}
+
+JQCPP_TARGET("avx2")
+void check_block_32(__m256i input, __m256i &prev, __m256i &errors,
+                    __m256i &incomplete) {
+  if (_mm256_movemask_epi8(input) == 0) {
+    errors = _mm256_or_si256(errors, incomplete);
+  } else {
+    errors = _mm256_or_si256(errors, block_errors_32(input, prev));
+    incomplete = _mm256_subs_epu8(
+        input,
+        _mm256_load_si256(reinterpret_cast<const __m256i *>(kIncompleteMax)));
+  }
+  prev = input;
+}
+
+JQCPP_TARGET("avx2") bool is_utf8_avx2(std::string_view s) {
+  __m256i errors = _mm256_setzero_si256();
+  __m256i prev = _mm256_setzero_si256();
+  __m256i incomplete = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 32 <= s.size(); i += 32) {
+    check_block_32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s.data() + i)),
+        prev, errors, incomplete);
+  }
+  if (i < s.size()) {
+    alignas(32) char tail[32] = {};
+    s.copy(tail, s.size() - i, i);
+    check_block_32(_mm256_load_si256(reinterpret_cast<const __m256i *>(tail)),
+                   prev, errors, incomplete);
+  }
+  errors = _mm256_or_si256(errors, incomplete);
+  return _mm256_testz_si256(errors, errors) != 0;
+}
+#endif
+
+} // namespace
+
+void detail::bind_utf8_kernels(SimdLevel level, detail::SimdKernels &table) {
+  table.find_non_ascii = find_non_ascii_scalar;
+  table.is_utf8 = is_utf8_scalar;
+#if defined(JQCPP_X86_DISPATCH)
+  switch (level) {
+  case SimdLevel::Scalar:
+    break;
+  case SimdLevel::Sse2:
+    table.find_non_ascii = find_non_ascii_sse2;
+    break;
+  case SimdLevel::Ssse3:
+    table.find_non_ascii = find_non_ascii_sse2;
+    table.is_utf8 = is_utf8_ssse3;
+    break;
+  case SimdLevel::Avx2:
+    table.find_non_ascii = find_non_ascii_avx2;
+    table.is_utf8 = is_utf8_avx2;
+    break;
+  case SimdLevel::Avx512:
+    // the lookups have no wider form here, AVX2 is used for them
+    table.find_non_ascii = find_non_ascii_avx512;
+    table.is_utf8 = is_utf8_avx2;
+    break;
+  }
+#else
+  (void)level;
+#endif
+}
+
+std::size_t find_non_ascii(std::string_view s) {
+  return detail::kernels().find_non_ascii(s);
+}
+
+std::size_t find_invalid_utf8(std::string_view s) {
+  std::size_t i = 0;
+  while (true) {
+    i += find_non_ascii(s.substr(i));
+    if (i == s.size()) {
+      return i;
+    }
+    std::size_t length = sequence_length(s, i);
+    if (length == 0) {
+      return i;
+    }
+    i += length;
+  }
+}
+
+std::size_t count_code_points(std::string_view s) {
+  std::size_t count = 0;
+  std::size_t i = 0;
+  while (true) {
+    std::size_t ascii = find_non_ascii(s.substr(i));
+    count += ascii;
+    i += ascii;
+    if (i == s.size()) {
+      return count;
+    }
+    // continuation bytes do not start a code point
+    for (; i < s.size() && static_cast<unsigned char>(s[i]) >= 0x80; ++i) {
+      count += (static_cast<unsigned char>(s[i]) & 0xC0) != 0x80;
+    }
+  }
+}
+
+bool is_utf8(std::string_view s) { return detail::kernels().is_utf8(s); }
+
+void append_utf8(std::string &out, std::uint32_t code) {
+  if (code < 0x80) {
+    out += static_cast<char>(code);
+  } else if (code < 0x800) {
+    out += static_cast<char>(0xC0 | (code >> 6));
+    out += static_cast<char>(0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    out += static_cast<char>(0xE0 | (code >> 12));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (code >> 18));
+    out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code & 0x3F));
+  }
+}
+
+void append_utf8_lossy(std::string_view s, std::string &out) {
+  while (!s.empty()) {
+    // the valid run is copied in bulk
+    std::size_t valid = find_invalid_utf8(s);
+    out.append(s.substr(0, valid));
+    if (valid == s.size()) {
+      break;
+    }
+    append_utf8(out, 0xFFFD);
+    s.remove_prefix(valid + 1);
+  }
+}
+
+} // namespace jqcpp::json
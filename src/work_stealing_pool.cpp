@@ -0,0 +1,202 @@
+#include "jqcpp/work_stealing_pool.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace jqcpp {
+
+namespace {
+
+// the task indexes of one worker
+struct WorkQueue {
+  std::mutex mutex;
+  std::deque<std::size_t> indexes;
+
+  std::optional<std::size_t> pop_front() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (indexes.empty()) {
+      return std::nullopt;
+    }
+    std::size_t index = indexes.front();
+    indexes.pop_front();
+    return index;
+  }
+
+  std::optional<std::size_t> steal_back() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (indexes.empty()) {
+      return std::nullopt;
+    }
+    std::size_t index = indexes.back();
+    indexes.pop_back();
+    return index;
+  }
+
+  std::size_t size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return indexes.size();
+  }
+};
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(unsigned workers) : workers_(workers) {
+  if (workers_ == 0) {
+    workers_ = std::max(1u, std::thread::hardware_concurrency());
+  }
+}
+
+void WorkStealingPool::run(std::size_t count, const Task &task) {
+  std::size_t workers = std::min<std::size_t>(workers_, count);
+  if (workers <= 1) {
+    for (std::size_t i = 0; i < count; ++i) {
+      task(0, i);
+    }
+    return;
+  }
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  for (std::size_t w = 0; w < workers; ++w) {
+    queues.push_back(std::make_unique<WorkQueue>());
+    for (std::size_t i = count * w / workers; i < count * (w + 1) / workers;
+         ++i) {
+      queues[w]->indexes.push_back(i);
+    }
+  }
+
+  std::vector<std::exception_ptr> errors(workers);
+  auto work = [&](std::size_t self) {
+    try {
+      while (true) {
+        auto index = queues[self]->pop_front();
+        if (!index) {
+          // steal from the worker with the most tasks left
+          std::size_t victim = self;
+          std::size_t most = 0;
+          for (std::size_t w = 0; w < workers; ++w) {
+            std::size_t left = w == self ? 0 : queues[w]->size();
+            if (left > most) {
+              most = left;
+              victim = w;
+            }
+          }
+          if (victim == self) {
+            // tasks are never added, so there is nothing left to run
+            return;
+          }
+          index = queues[victim]->steal_back();
+          if (!index) {
+            continue;
+          }
+        }
+        task(static_cast<unsigned>(self), *index);
+      }
+    } catch (...) {
+      errors[self] = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(workers - 1);
+  for (std::size_t w = 1; w < workers; ++w) {
+    threads.emplace_back(work, w);
+  }
+  work(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+void WorkStealingPool::run_ordered(std::size_t count, const Task &task,
+                                   const Write &write,
+                                   std::size_t max_pending) {
+  max_pending = std::max<std::size_t>(max_pending, 1);
+  std::mutex mutex;
+  // a task is done, or the run stopped
+  std::condition_variable task_done;
+  // a result is written, or the run stopped
+  std::condition_variable written_one;
+  std::vector<bool> done(count);
+  std::size_t taken = 0;
+  std::size_t written = 0;
+  bool stopped = false;
+  std::exception_ptr error;
+  // called with mutex held
+  auto stop = [&](std::exception_ptr thrown) {
+    if (!error) {
+      error = thrown;
+    }
+    stopped = true;
+    task_done.notify_all();
+    written_one.notify_all();
+  };
+
+  // the pool runs on its own thread, the indexes come from a shared counter
+  // instead of the index of the pool task, so they are taken in order
+  std::thread runner([&] {
+    try {
+      run(count, [&](unsigned worker, std::size_t) {
+        std::size_t index;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          written_one.wait(lock, [&] {
+            return stopped || taken < written + max_pending;
+          });
+          if (stopped) {
+            return;
+          }
+          index = taken++;
+        }
+        try {
+          task(worker, index);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mutex);
+          stop(std::current_exception());
+          return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        done[index] = true;
+        task_done.notify_all();
+      });
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop(std::current_exception());
+    }
+  });
+
+  try {
+    for (std::size_t index = 0; index < count; ++index) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        task_done.wait(lock, [&] { return stopped || done[index]; });
+        if (!done[index]) {
+          break;
+        }
+      }
+      write(index);
+      std::lock_guard<std::mutex> lock(mutex);
+      ++written;
+      written_one.notify_all();
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop(std::current_exception());
+  }
+  runner.join();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace jqcpp
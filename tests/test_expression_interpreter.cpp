@@ -63,3 +63,36 @@ TEST_CASE("Expression parser handles array operations", "[parser]") {
     CHECK(arr[1].get_number() == 3.0);
   }
 }
+
+TEST_CASE("Leading iterator over the input can be stripped", "[parser]") {
+  JSONTokenizer tokenizer;
+  JSONParser parser;
+  JSONValue element(parser.parse(tokenizer.tokenize(R"({"a": {"b": 7}})")));
+
+  SECTION("Iterator followed by a field") {
+    JQInterpreter interpreter(".[].a.b");
+    REQUIRE(interpreter.strip_root_iterator());
+    CHECK(interpreter.execute(element).get_number() == 7);
+  }
+
+  SECTION("Iterator followed by a pipe") {
+    JQInterpreter interpreter(".[] | .a | .b");
+    REQUIRE(interpreter.strip_root_iterator());
+    CHECK(interpreter.execute(element).get_number() == 7);
+  }
+
+  SECTION("Bare iterator") {
+    JQInterpreter interpreter(".[]");
+    REQUIRE(interpreter.strip_root_iterator());
+    CHECK(interpreter.execute(element).is_object());
+  }
+
+  SECTION("Filters not starting with an iterator are unchanged") {
+    JQInterpreter field(".a.b");
+    CHECK_FALSE(field.strip_root_iterator());
+    CHECK(field.execute(element).get_number() == 7);
+
+    JQInterpreter nested(".a | .[]");
+    CHECK_FALSE(nested.strip_root_iterator());
+  }
+}
@@ -113,4 +113,12 @@ TEST_CASE("JQLexer tokenizes expressions correctly", "[tokenizer]") {
     CHECK(tokens[6].type == TokenType::Identifier);
     CHECK(tokens[6].value == "name");
   }
+
+  SECTION("Pipe") {
+    auto tokens = tokenizer.tokenize(".[] | .name");
+    CHECK(tokens.size() == 7); // Including End token
+    CHECK(tokens[3].type == TokenType::Pipe);
+    CHECK(tokens[3].value == "|");
+    CHECK(tokens[5].type == TokenType::Identifier);
+  }
 }
@@ -1,9 +1,21 @@
+#include "jqcpp/cbor.hpp"
+#include "jqcpp/compression.hpp"
+#include "jqcpp/cpu_dispatch.hpp"
 #include "jqcpp/jq_interpreter.hpp"
 #include "jqcpp/json_parser.hpp"
 #include "jqcpp/json_tokenizer.hpp"
+#include "jqcpp/msgpack.hpp"
 #include "jqcpp/pretty_printer.hpp"
+#include "jqcpp/spsc_queue.hpp"
+#include "jqcpp/work_stealing_pool.hpp"
 #include <catch2/catch_all.hpp>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
 #include <sstream>
+#include <thread>
 
 using namespace jqcpp;
 
@@ -21,6 +33,23 @@ std::string run_jqcpp_test(const std::string &input,
   }
 }
 
+// Helper function to run jqcpp with extra command line options
+std::string run_jqcpp_args(const std::string &input,
+                           const std::vector<std::string> &args) {
+  std::istringstream iss(input);
+  std::ostringstream oss;
+  std::vector<const char *> argv = {"jqcpp"};
+  for (const auto &arg : args) {
+    argv.push_back(arg.c_str());
+  }
+  int status = run_jqcpp(static_cast<int>(argv.size()),
+                         const_cast<char **>(argv.data()), iss, oss);
+  if (status != 0) {
+    throw std::runtime_error("jqcpp exited with " + std::to_string(status));
+  }
+  return oss.str();
+}
+
 std::string pretty_json(const std::string &s) {
   json::JSONTokenizer lexer;
   json::JSONParser parser;
@@ -484,4 +513,964 @@ TEST_CASE("End-to-end jqcpp functionality tests", "[e2e]") {
     std::string filter = ".invalid[";
     CHECK_THROWS(run_jqcpp_test(input, filter));
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Output formatting options", "[cli]") {
+  std::string input = R"({"a": [1, 2], "b": {"c": "d"}})";
+
+  SECTION("Compact output") {
+    CHECK(run_jqcpp_args(input, {"-c", "."}) ==
+          "{\"a\":[1,2],\"b\":{\"c\":\"d\"}}\n");
+    CHECK(run_jqcpp_args(input, {"--compact-output", ".a"}) == "[1,2]\n");
+  }
+
+  SECTION("Indent width") {
+    CHECK(run_jqcpp_args(input, {"--indent", "1", ".b"}) ==
+          "{\n \"c\": \"d\"\n}\n");
+    CHECK(run_jqcpp_args(input, {"--indent", "0", ".b"}) ==
+          "{\"c\":\"d\"}\n");
+    CHECK_THROWS(run_jqcpp_args(input, {"--indent", "8", ".b"}));
+  }
+
+  SECTION("Tab indent") {
+    CHECK(run_jqcpp_args(input, {"--tab", ".b"}) ==
+          "{\n\t\"c\": \"d\"\n}\n");
+  }
+
+  SECTION("Unknown option") {
+    CHECK_THROWS(run_jqcpp_args(input, {"--bogus", "."}));
+  }
+}
+
+TEST_CASE("Raw and join output", "[cli]") {
+  std::string input = R"({"name": "a\"b\tc", "n": 1, "list": ["x"]})";
+
+  SECTION("Raw string output") {
+    CHECK(run_jqcpp_args(input, {"-r", ".name"}) == "a\"b\tc\n");
+    CHECK(run_jqcpp_args(input, {"--raw-output", ".name"}) == "a\"b\tc\n");
+  }
+
+  SECTION("Raw output leaves other values as JSON") {
+    CHECK(run_jqcpp_args(input, {"-r", ".n"}) == "1\n");
+    CHECK(run_jqcpp_args(input, {"-r", "-c", ".list"}) == "[\"x\"]\n");
+  }
+
+  SECTION("Join output") {
+    CHECK(run_jqcpp_args(input, {"-j", ".name"}) == "a\"b\tc");
+    CHECK(run_jqcpp_args(input, {"--join-output", ".n"}) == "1");
+  }
+}
+
+TEST_CASE("Parallel parsing of the input", "[cli]") {
+  std::string input = R"([{"a": 1}, {"a": 2}, {"a": 3}])";
+  CHECK(run_jqcpp_args(input, {"--parallel-parse", "--threads", "2", ".[2]"}) ==
+        run_jqcpp_args(input, {".[2]"}));
+  std::vector<std::string> args = {"--parallel-parse", "--threads", "2",
+                                   "--max-depth", "2", "-c", "."};
+  CHECK(run_jqcpp_args(input, args) == run_jqcpp_args(input, {"-c", "."}));
+  CHECK_THROWS(run_jqcpp_args(R"([{"a": [1]}])", args));
+}
+
+TEST_CASE("Streaming the elements of a top level array", "[cli]") {
+  std::string input = R"([{"name": "a", "n": 1}, {"name": "b", "n": 2}])";
+
+  SECTION("One result per element") {
+    CHECK(run_jqcpp_args(input, {"--stream-array", ".[] | .name"}) ==
+          "\"a\"\n\"b\"\n");
+    CHECK(run_jqcpp_args(input, {"--stream-array", "-r", ".[].name"}) ==
+          "a\nb\n");
+    CHECK(run_jqcpp_args(input, {"--stream-array", "-c", ".[]"}) ==
+          "{\"name\":\"a\",\"n\":1}\n{\"name\":\"b\",\"n\":2}\n");
+  }
+
+  SECTION("Objects are iterated over their values") {
+    CHECK(run_jqcpp_args(R"({"x": 1, "y": 2})", {"--stream-array", ".[]"}) ==
+          "1\n2\n");
+  }
+
+  SECTION("Other filters are evaluated as usual") {
+    CHECK(run_jqcpp_args(input, {"--stream-array", ".[1].n"}) == "2\n");
+  }
+
+  SECTION("The depth limit counts the top level array") {
+    std::vector<std::string> args = {"--max-depth", "2", "--stream-array",
+                                      "-c", ".[]"};
+    CHECK_THROWS(run_jqcpp_args("[[[]]]", args));
+    args[1] = "3";
+    CHECK(run_jqcpp_args("[[[]]]", args) == "[[]]\n");
+    std::string deep = "[" + std::string(10006, '[') + std::string(10006, ']') +
+                       "]";
+    CHECK_THROWS(run_jqcpp_args(deep, {"--stream-array", ".[] | length"}));
+    CHECK(run_jqcpp_args(deep, {"--max-depth", "20000", "--stream-array",
+                                ".[] | length"}) == "1\n");
+  }
+
+  SECTION("Errors stop the stream") {
+    CHECK_THROWS(run_jqcpp_args("[1, 2", {"--stream-array", ".[]"}));
+    CHECK_THROWS(run_jqcpp_args("[1, 2] garbage", {"--stream-array", ".[]"}));
+    CHECK_THROWS(run_jqcpp_args("{\"a\": 1} 2", {"--stream-array", ".[]"}));
+    CHECK(run_jqcpp_args("[1, 2] \n", {"--stream-array", ".[]"}) ==
+          "1\n2\n");
+  }
+}
+
+TEST_CASE("Pipe operator", "[filter]") {
+  std::string input = R"({"user": {"name": "Alice"}})";
+  CHECK(run_jqcpp_test(input, ".user | .name") == "\"Alice\"\n");
+}
+
+TEST_CASE("Stream events", "[stream]") {
+  std::string input = R"({"a": [1, 2]})";
+
+  SECTION("--stream runs the filter on each event") {
+    CHECK(run_jqcpp_args(input, {"--stream", "-c", "."}) ==
+          "[[\"a\",0],1]\n[[\"a\",1],2]\n[[\"a\",1]]\n[[\"a\"]]\n");
+    CHECK(run_jqcpp_args("3", {"--stream", "-c", "."}) == "[[],3]\n");
+    CHECK_THROWS(run_jqcpp_args("[1, 2", {"--stream", "."}));
+  }
+
+  SECTION("tostream") {
+    CHECK(run_jqcpp_args(input, {"-c", "tostream"}) ==
+          "[[[\"a\",0],1],[[\"a\",1],2],[[\"a\",1]],[[\"a\"]]]\n");
+    CHECK(run_jqcpp_args(input, {"-c", ".a | tostream"}) ==
+          "[[[0],1],[[1],2],[[1]]]\n");
+  }
+
+  SECTION("fromstream") {
+    CHECK(run_jqcpp_args(input, {"-c", "fromstream(tostream)"}) ==
+          "[{\"a\":[1,2]}]\n");
+    CHECK(run_jqcpp_args("[[[],3]]", {"-c", "fromstream(.)"}) == "[3]\n");
+  }
+
+  SECTION("truncate_stream") {
+    CHECK(run_jqcpp_args(input, {"-c", "tostream | truncate_stream(1)"}) ==
+          "[[[0],1],[[1],2],[[1]]]\n");
+    CHECK(run_jqcpp_args(input,
+                         {"-c", "fromstream(tostream | truncate_stream(1))"}) ==
+          "[[1,2]]\n");
+  }
+}
+
+TEST_CASE("Several documents in the input", "[cli]") {
+  CHECK(run_jqcpp_args("{\"a\": 1}\n{\"a\": 2} {\"a\"\n: 3}", {".a"}) ==
+        "1\n2\n3\n");
+  CHECK(run_jqcpp_args("", {"."}) == "");
+  CHECK(run_jqcpp_args("\"\\u00e9\"", {"."}) == "\"\xc3\xa9\"\n");
+  // length counts code points, like jq
+  CHECK(run_jqcpp_args("\"\\u00e9\" \"\xc3\xa9t\xc3\xa9\"", {"length"}) ==
+        "1\n3\n");
+  CHECK_THROWS(run_jqcpp_args("{\"a\": 1} {", {".a"}));
+}
+
+TEST_CASE("SPSC queue", "[pipeline]") {
+  SECTION("Values arrive in order through a small ring") {
+    SPSCQueue<int> queue(4);
+    std::thread producer([&queue] {
+      for (int i = 0; i < 10000; ++i) {
+        queue.push(i);
+      }
+      queue.close();
+    });
+    int expected = 0;
+    int value;
+    bool in_order = true;
+    while (queue.pop(value)) {
+      in_order = in_order && value == expected++;
+    }
+    producer.join();
+    CHECK(in_order);
+    CHECK(expected == 10000);
+  }
+
+  SECTION("Closing stops the producer") {
+    SPSCQueue<int> queue(2);
+    CHECK(queue.push(1));
+    queue.close();
+    CHECK_FALSE(queue.push(2));
+    int value;
+    CHECK(queue.pop(value));
+    CHECK(value == 1);
+    CHECK_FALSE(queue.pop(value));
+  }
+}
+
+TEST_CASE("Pipelined execution", "[pipeline]") {
+  std::string input;
+  std::string expected;
+  for (int i = 0; i < 2000; ++i) {
+    input += "{\"id\": " + std::to_string(i) + ", \"tags\": [\"x\"]}\n";
+    expected += std::to_string(i + 1) + "\n";
+  }
+
+  SECTION("Same results as the serial path") {
+    CHECK(run_jqcpp_args(input, {"--pipeline", ".id + 1"}) == expected);
+    CHECK(run_jqcpp_args(input, {".id + 1"}) == expected);
+    CHECK(run_jqcpp_args(R"({"a": [1, 2]})", {"--pipeline", "--stream", "-c",
+                                              "."}) ==
+          "[[\"a\",0],1]\n[[\"a\",1],2]\n[[\"a\",1]]\n[[\"a\"]]\n");
+  }
+
+  SECTION("Errors are reported after the earlier results") {
+    std::istringstream iss("1 2 [");
+    std::ostringstream oss;
+    const char *argv[] = {"jqcpp", "--pipeline", "."};
+    CHECK(run_jqcpp(3, const_cast<char **>(argv), iss, oss) == 1);
+    CHECK(oss.str() == "1\n2\n");
+
+    CHECK_THROWS(run_jqcpp_args(input, {"--pipeline", ".tags + 1"}));
+  }
+}
+
+TEST_CASE("Ordered results of a work stealing pool", "[pool]") {
+  WorkStealingPool pool(4);
+
+  SECTION("A slow task holds back a bounded number of results") {
+    std::atomic<int> pending{0};
+    std::atomic<int> most_pending{0};
+    std::vector<std::size_t> order;
+    pool.run_ordered(
+        100,
+        [&](unsigned, std::size_t index) {
+          if (index == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+          }
+          int now = ++pending;
+          int most = most_pending;
+          while (now > most && !most_pending.compare_exchange_weak(most, now)) {
+          }
+        },
+        [&](std::size_t index) {
+          --pending;
+          order.push_back(index);
+        },
+        3);
+    REQUIRE(order.size() == 100);
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      CHECK(order[i] == i);
+    }
+    CHECK(most_pending <= 3);
+  }
+
+  SECTION("Exceptions reach the calling thread") {
+    std::size_t written = 0;
+    auto task = [](unsigned, std::size_t index) {
+      if (index == 20) {
+        throw std::runtime_error("task failed");
+      }
+    };
+    CHECK_THROWS_WITH(pool.run_ordered(
+                          100, task, [&](std::size_t) { ++written; }, 8),
+                      "task failed");
+    CHECK(written <= 20);
+    auto write = [](std::size_t index) {
+      if (index == 10) {
+        throw std::runtime_error("write failed");
+      }
+    };
+    CHECK_THROWS_WITH(
+        pool.run_ordered(100, [](unsigned, std::size_t) {}, write, 8),
+        "write failed");
+  }
+}
+
+TEST_CASE("Several input files", "[cli]") {
+  namespace fs = std::filesystem;
+  fs::path dir = fs::temp_directory_path() / "jqcpp_test_files";
+  fs::create_directories(dir);
+  std::vector<std::string> files;
+  std::string expected;
+  for (int i = 0; i < 40; ++i) {
+    fs::path file = dir / ("f" + std::to_string(i) + ".json");
+    std::ofstream(file) << "{\"id\": " << i << "}\n{\"id\": " << i + 100
+                        << "}\n";
+    files.push_back(file.string());
+    expected += std::to_string(i) + "\n" + std::to_string(i + 100) + "\n";
+  }
+
+  SECTION("Results in argument order") {
+    std::vector<std::string> args = {"--threads", "4", ".id"};
+    args.insert(args.end(), files.begin(), files.end());
+    CHECK(run_jqcpp_args("", args) == expected);
+  }
+
+  SECTION("Unordered results") {
+    std::vector<std::string> args = {"--threads", "4", "--unordered", ".id"};
+    args.insert(args.end(), files.begin(), files.end());
+    std::istringstream lines(run_jqcpp_args("", args));
+    std::vector<int> ids;
+    int id;
+    while (lines >> id) {
+      ids.push_back(id);
+    }
+    std::sort(ids.begin(), ids.end());
+    REQUIRE(ids.size() == 80);
+    CHECK(ids.front() == 0);
+    CHECK(ids.back() == 139);
+  }
+
+  SECTION("Files listed in a file or on stdin") {
+    std::string list;
+    for (const auto &file : files) {
+      list += file + "\n";
+    }
+    CHECK(run_jqcpp_args(list, {"--files-from", "-", ".id"}) == expected);
+    fs::path list_file = dir / "list.txt";
+    std::ofstream(list_file) << list;
+    CHECK(run_jqcpp_args("", {"--files-from", list_file.string(), ".id"}) ==
+          expected);
+  }
+
+  SECTION("Each file takes the same path as a single input") {
+    std::vector<std::string> arrays;
+    std::string each;
+    for (int i = 0; i < 3; ++i) {
+      fs::path file = dir / ("a" + std::to_string(i) + ".json");
+      std::ofstream(file) << "[{\"id\": " << i << "}, {\"id\": " << i + 10
+                          << "}]";
+      arrays.push_back(file.string());
+      each += std::to_string(i) + "\n" + std::to_string(i + 10) + "\n";
+    }
+    for (std::vector<std::string> args :
+         {std::vector<std::string>{"--stream-array", ".[] | .id"},
+          {"--stream-array", "--threads", "2", ".[].id"}}) {
+      args.insert(args.end(), arrays.begin(), arrays.end());
+      CHECK(run_jqcpp_args("", args) == each);
+    }
+    for (std::string flag : {"--pipeline", "--parallel-parse"}) {
+      std::vector<std::string> args = {flag, "--threads", "2", ".[1].id"};
+      args.insert(args.end(), arrays.begin(), arrays.end());
+      CHECK(run_jqcpp_args("", args) == "10\n11\n12\n");
+    }
+  }
+
+  SECTION("A broken file does not stop the others") {
+    fs::path broken = dir / "broken.json";
+    std::ofstream(broken) << "{\"id\": ";
+    std::istringstream iss;
+    std::ostringstream oss;
+    std::vector<std::string> args = {"jqcpp", ".id", files[0], broken.string(),
+                                     (dir / "missing.json").string(),
+                                     files[1]};
+    std::vector<char *> argv;
+    for (auto &arg : args) {
+      argv.push_back(arg.data());
+    }
+    CHECK(run_jqcpp(static_cast<int>(argv.size()), argv.data(), iss, oss) ==
+          1);
+    CHECK(oss.str() == "0\n100\n1\n101\n");
+  }
+
+  fs::remove_all(dir);
+}
+
+TEST_CASE("Compressed input and output", "[compression]") {
+  SECTION("Plain JSON is left alone") {
+    std::istringstream plain(R"({"a": 1})");
+    CHECK(detect_compression(plain) == Compression::None);
+    CHECK(open_decompressed(plain) == nullptr);
+    CHECK(plain.get() == '{');
+  }
+
+#ifdef JQCPP_HAVE_ZLIB
+  auto gzip = [](const std::string &text) {
+    std::ostringstream compressed;
+    CompressingOutput out(compressed, Compression::Gzip);
+    out << text;
+    out.finish();
+    return compressed.str();
+  };
+  std::string input;
+  std::string expected;
+  for (int i = 0; i < 20000; ++i) {
+    input += "{\"id\": " + std::to_string(i) + "}\n";
+    expected += std::to_string(i) + "\n";
+  }
+
+  SECTION("gzip input is detected and decoded") {
+    std::string compressed = gzip(input);
+    REQUIRE(compressed.size() < input.size());
+    std::istringstream in(compressed);
+    CHECK(detect_compression(in) == Compression::Gzip);
+    CHECK(run_jqcpp_args(compressed, {".id"}) == expected);
+    CHECK(run_jqcpp_args(compressed, {"--pipeline", ".id"}) == expected);
+    // concatenated members, as written by cat a.gz b.gz
+    CHECK(run_jqcpp_args(gzip("1") + gzip(" 2"), {"."}) == "1\n2\n");
+  }
+
+  SECTION("gzip output") {
+    std::string compressed = run_jqcpp_args(input, {"--compress", "gzip", ".id"});
+    std::istringstream in(compressed);
+    auto decoded = open_decompressed(in);
+    REQUIRE(decoded != nullptr);
+    std::ostringstream text;
+    text << decoded->rdbuf();
+    CHECK(text.str() == expected);
+  }
+
+  SECTION("Broken gzip input") {
+    std::string compressed = gzip(input);
+    CHECK_THROWS(run_jqcpp_args(compressed.substr(0, compressed.size() / 2),
+                                {".id"}));
+    compressed[compressed.size() / 2] ^= 0x55;
+    CHECK_THROWS(run_jqcpp_args(compressed, {".id"}));
+  }
+#endif
+}
+
+TEST_CASE("MessagePack input and output", "[msgpack]") {
+  auto bytes = [](std::initializer_list<int> values) {
+    std::string s;
+    for (int v : values) {
+      s += static_cast<char>(v);
+    }
+    return s;
+  };
+
+  SECTION("Smallest encodings") {
+    std::vector<std::string> args = {"--output-format", "msgpack", "."};
+    CHECK(run_jqcpp_args("1", args) == bytes({0x01}));
+    CHECK(run_jqcpp_args("-1", args) == bytes({0xff}));
+    CHECK(run_jqcpp_args("200", args) == bytes({0xcc, 0xc8}));
+    CHECK(run_jqcpp_args("-200", args) == bytes({0xd1, 0xff, 0x38}));
+    CHECK(run_jqcpp_args("65536", args) ==
+          bytes({0xce, 0x00, 0x01, 0x00, 0x00}));
+    CHECK(run_jqcpp_args("1.5", args) ==
+          bytes({0xcb, 0x3f, 0xf8, 0, 0, 0, 0, 0, 0}));
+    CHECK(run_jqcpp_args("null true false", args) == bytes({0xc0, 0xc3, 0xc2}));
+    CHECK(run_jqcpp_args("\"ab\"", args) == bytes({0xa2, 'a', 'b'}));
+    CHECK(run_jqcpp_args("{\"a\": [1, 2]}", args) ==
+          bytes({0x81, 0xa1, 'a', 0x92, 0x01, 0x02}));
+  }
+
+  SECTION("Round trip") {
+    std::string input = R"({"name": "caf)" "\xc3\xa9" R"(", "n": [0, -32, -33,
+      127, 128, 4294967296, -2147483649, 0.25, 1e300], "ok": true,
+      "none": null, "empty": {}, "list": []})";
+    std::string encoded =
+        run_jqcpp_args(input, {"--output-format", "msgpack", "."});
+    CHECK(run_jqcpp_args(encoded, {"--input-format", "msgpack", "-c", "."}) ==
+          run_jqcpp_args(input, {"-c", "."}));
+    std::string large;
+    for (int i = 0; i < 100000; ++i) {
+      large += std::to_string(i) + " ";
+    }
+    CHECK(run_jqcpp_args(run_jqcpp_args(large, {"--output-format", "msgpack",
+                                               "."}),
+                         {"--input-format", "msgpack", "-c", "."}) ==
+          run_jqcpp_args(large, {"-c", "."}));
+  }
+
+  SECTION("Decoding") {
+    std::vector<std::string> args = {"--input-format", "msgpack", "-c", "."};
+    // bin 8, str 8, float 32, int 64
+    CHECK(run_jqcpp_args(bytes({0xc4, 0x02, 'h', 'i'}), args) == "\"hi\"\n");
+    CHECK(run_jqcpp_args(bytes({0xd9, 0x01, 'x'}), args) == "\"x\"\n");
+    CHECK(run_jqcpp_args(bytes({0xca, 0x3f, 0xc0, 0x00, 0x00}), args) ==
+          "1.5\n");
+    CHECK(run_jqcpp_args(bytes({0xd3, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xfe}),
+                         args) == "-2\n");
+    // integer map keys are written in decimal
+    CHECK(run_jqcpp_args(bytes({0x81, 0x07, 0xc3}), args) == "{\"7\":true}\n");
+    // timestamp 32 and timestamp 64 with half a second
+    CHECK(run_jqcpp_args(bytes({0xd6, 0xff, 0x00, 0x00, 0x00, 0x64}), args) ==
+          "100\n");
+    CHECK(run_jqcpp_args(bytes({0xd7, 0xff, 0x77, 0x35, 0x94, 0x00, 0x00,
+                                0x00, 0x00, 0x0a}),
+                         args) == "10.5\n");
+    CHECK(run_jqcpp_args(bytes({0x92, 0x01, 0x02}),
+                         {"--input-format", "msgpack", "--stream", "-c",
+                          "."}) == "[[0],1]\n[[1],2]\n[[1]]\n");
+  }
+
+  SECTION("Invalid input") {
+    std::vector<std::string> args = {"--input-format", "msgpack", "."};
+    CHECK_THROWS(run_jqcpp_args(bytes({0x92, 0x01}), args));
+    CHECK_THROWS(run_jqcpp_args(bytes({0xc1}), args));
+    CHECK_THROWS(run_jqcpp_args(bytes({0xd4, 0x05, 0x00}), args));
+    CHECK_THROWS(run_jqcpp_args(bytes({0x81, 0xc3, 0xc3}), args));
+    CHECK_THROWS(run_jqcpp_args(bytes({0x81, 0x90, 0xc3}), args));
+    CHECK_THROWS(run_jqcpp_args("1", {"--input-format", "yaml", "."}));
+  }
+
+  SECTION("Nesting depth limit") {
+    std::vector<std::string> args = {"--input-format", "msgpack", "-c",
+                                     "."};
+    // fixarrays of one element down to 1
+    std::string deep = std::string(1000000, '\x91') + '\x01';
+    CHECK_THROWS(run_jqcpp_args(deep, args));
+    std::string allowed = std::string(20000, '\x91') + '\x01';
+    CHECK_THROWS(run_jqcpp_args(allowed, args));
+    CHECK(run_jqcpp_args(allowed, {"--input-format", "msgpack",
+                                   "--max-depth", "20000", "-c", "."}) ==
+          std::string(20000, '[') + "1" + std::string(20000, ']') + "\n");
+    CHECK(run_jqcpp_args(bytes({0x92, 0x91, 0x01, 0x81, 0xa1, 'a', 0x01}),
+                         {"--input-format", "msgpack", "--max-depth", "2",
+                          "-c", "."}) == "[[1],{\"a\":1}]\n");
+    CHECK_THROWS(run_jqcpp_args(bytes({0x91, 0x91, 0x91, 0x01}),
+                                {"--input-format", "msgpack", "--max-depth",
+                                 "2", "."}));
+  }
+}
+
+TEST_CASE("CBOR input and output", "[cbor]") {
+  auto bytes = [](std::initializer_list<int> values) {
+    std::string s;
+    for (int v : values) {
+      s += static_cast<char>(v);
+    }
+    return s;
+  };
+
+  SECTION("Smallest encodings") {
+    std::vector<std::string> args = {"--output-format", "cbor", "."};
+    CHECK(run_jqcpp_args("10", args) == bytes({0x0a}));
+    CHECK(run_jqcpp_args("-500", args) == bytes({0x39, 0x01, 0xf3}));
+    CHECK(run_jqcpp_args("100000", args) ==
+          bytes({0x1a, 0x00, 0x01, 0x86, 0xa0}));
+    CHECK(run_jqcpp_args("1.5", args) == bytes({0xfa, 0x3f, 0xc0, 0, 0}));
+    CHECK(run_jqcpp_args("0.1", args) ==
+          bytes({0xfb, 0x3f, 0xb9, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9a}));
+    CHECK(run_jqcpp_args("null true false", args) == bytes({0xf6, 0xf5, 0xf4}));
+    CHECK(run_jqcpp_args("{\"a\": [1, \"b\"]}", args) ==
+          bytes({0xa1, 0x61, 'a', 0x82, 0x01, 0x61, 'b'}));
+  }
+
+  SECTION("Round trip") {
+    std::string input = R"({"name": "caf)" "\xc3\xa9" R"(", "n": [0, 23, 24,
+      -24, -25, 4294967296, -4294967297, 0.25, 1e300], "ok": false,
+      "none": null, "empty": {}, "list": []})";
+    std::string encoded =
+        run_jqcpp_args(input, {"--output-format", "cbor", "."});
+    CHECK(run_jqcpp_args(encoded, {"--input-format", "cbor", "-c", "."}) ==
+          run_jqcpp_args(input, {"-c", "."}));
+    // byte strings keep their bytes
+    std::string binary = bytes({0x42, 0xff, 0x00});
+    CHECK(run_jqcpp_args(run_jqcpp_args(binary, {"--input-format", "cbor",
+                                                 "--output-format", "cbor",
+                                                 "."}),
+                         {"--input-format", "cbor", "--output-format", "cbor",
+                          "."}) == binary);
+  }
+
+  SECTION("Decoding") {
+    std::vector<std::string> args = {"--input-format", "cbor", "-c", "."};
+    // half float, undefined, bignum, a dropped date tag
+    CHECK(run_jqcpp_args(bytes({0xf9, 0x3e, 0x00}), args) == "1.5\n");
+    CHECK(run_jqcpp_args(bytes({0xf7}), args) == "null\n");
+    CHECK(run_jqcpp_args(bytes({0xc3, 0x42, 0x01, 0x00}), args) == "-257\n");
+    CHECK(run_jqcpp_args(bytes({0xc1, 0x1a, 0x00, 0x00, 0x00, 0x64}), args) ==
+          "100\n");
+    // indefinite length string, array and map
+    CHECK(run_jqcpp_args(bytes({0x7f, 0x62, 'a', 'b', 0x61, 'c', 0xff}),
+                         args) == "\"abc\"\n");
+    CHECK(run_jqcpp_args(bytes({0x9f, 0x01, 0x9f, 0xff, 0xff}), args) ==
+          "[1,[]]\n");
+    CHECK(run_jqcpp_args(bytes({0xbf, 0x61, 'k', 0xf5, 0x05, 0xf4, 0xff}),
+                         args) == "{\"k\":true,\"5\":false}\n");
+    // typed arrays: uint16 big endian, sint16 little endian, float32 little
+    // endian
+    CHECK(run_jqcpp_args(bytes({0xd8, 0x41, 0x44, 0x00, 0x01, 0x01, 0x00}),
+                         args) == "[1,256]\n");
+    CHECK(run_jqcpp_args(bytes({0xd8, 0x4d, 0x44, 0xfe, 0xff, 0x00, 0x80}),
+                         args) == "[-2,-32768]\n");
+    CHECK(run_jqcpp_args(bytes({0xd8, 0x55, 0x44, 0x00, 0x00, 0xc0, 0x3f}),
+                         args) == "[1.5]\n");
+    // a CBOR sequence
+    CHECK(run_jqcpp_args(bytes({0x01, 0x02, 0x03}), args) == "1\n2\n3\n");
+  }
+
+  SECTION("Elements of a top level array") {
+    std::vector<std::string> args = {"--input-format", "cbor",
+                                     "--stream-array", "-c", ".[]"};
+    CHECK(run_jqcpp_args(bytes({0x9f, 0x01, 0x82, 0x02, 0x03, 0xff, 0x81,
+                                0x04}),
+                         args) == "1\n[2,3]\n4\n");
+    CHECK(run_jqcpp_args(bytes({0xa1, 0x61, 'a', 0x07}), args) == "7\n");
+    CHECK_THROWS(run_jqcpp_args(bytes({0x9f, 0x01, 0x02}), args));
+  }
+
+  SECTION("Invalid input") {
+    std::vector<std::string> args = {"--input-format", "cbor", "."};
+    CHECK_THROWS(run_jqcpp_args(bytes({0x82, 0x01}), args));
+    CHECK_THROWS(run_jqcpp_args(bytes({0x1c}), args));
+    CHECK_THROWS(run_jqcpp_args(bytes({0xff}), args));
+    CHECK_THROWS(run_jqcpp_args(bytes({0x7f, 0x41, 'a', 0xff}), args));
+    CHECK_THROWS(run_jqcpp_args(bytes({0xd8, 0x41, 0x43, 0, 0, 0}), args));
+    CHECK_THROWS(run_jqcpp_args(bytes({0xa1, 0xf6, 0x01}), args));
+    CHECK_THROWS(run_jqcpp_args(bytes({0xa1, 0x80, 0x01}), args));
+    CHECK_THROWS(run_jqcpp_args(bytes({0x9f, 0x01}), args));
+  }
+
+  SECTION("Nesting depth limit") {
+    std::vector<std::string> args = {"--input-format", "cbor", "-c", "."};
+    // arrays of one item down to 1, then indefinite ones
+    std::string deep = std::string(1000000, '\x81') + '\x01';
+    CHECK_THROWS(run_jqcpp_args(deep, args));
+    std::string indefinite =
+        std::string(1000000, '\x9f') + std::string(1000000, '\xff');
+    CHECK_THROWS(run_jqcpp_args(indefinite, args));
+    // a long chain of tags is not nesting
+    CHECK(run_jqcpp_args(std::string(100000, '\xc6') + '\x01', args) ==
+          "1\n");
+    std::string allowed = std::string(20000, '\x81') + '\x01';
+    CHECK_THROWS(run_jqcpp_args(allowed, args));
+    CHECK(run_jqcpp_args(allowed, {"--input-format", "cbor", "--max-depth",
+                                   "20000", "-c", "."}) ==
+          std::string(20000, '[') + "1" + std::string(20000, ']') + "\n");
+    CHECK(run_jqcpp_args(bytes({0x82, 0x9f, 0x01, 0xff, 0xa1, 0x61, 'a',
+                                0x01}),
+                         {"--input-format", "cbor", "--max-depth", "2", "-c",
+                          "."}) == "[[1],{\"a\":1}]\n");
+    CHECK_THROWS(run_jqcpp_args(bytes({0x81, 0x81, 0x81, 0x01}),
+                                {"--input-format", "cbor", "--max-depth",
+                                 "2", "."}));
+  }
+}
+
+TEST_CASE("Snapshots of the parsed input", "[snapshot]") {
+  auto dir = std::filesystem::temp_directory_path() / "jqcpp_snapshot_test";
+  std::filesystem::create_directories(dir);
+  std::string path = (dir / "catalog.snap").string();
+  std::string input = R"({"version": 3, "items": [{"id": 0, "tags": ["a"]},
+    {"id": 1, "tags": []}, {"id": 2, "tags": ["b", "c"]}]} {"version": 4})";
+
+  // the filter still runs on the input while the snapshot is written
+  CHECK(run_jqcpp_args(input, {"--save-snapshot", path, "-c", ".version"}) ==
+        "3\n4\n");
+  REQUIRE(std::filesystem::exists(path));
+
+  for (std::string filter :
+       {".", ".version", ".items[2].tags", ".items[1].tags[0]",
+        ".items[7]", ".items[0].id", ".items | length",
+        ".items[2] | keys", ".items[1:3]"}) {
+    CAPTURE(filter);
+    std::string expected;
+    try {
+      expected = run_jqcpp_args(input, {"-c", filter});
+    } catch (const std::exception &) {
+      CHECK_THROWS(run_jqcpp_args("", {"-c", filter, path}));
+      continue;
+    }
+    CHECK(run_jqcpp_args("", {"-c", filter, path}) == expected);
+  }
+  // printed, measured and listed straight from the tape
+  for (std::string filter : {".", "keys", "length", ". | keys"}) {
+    CAPTURE(filter);
+    CHECK(run_jqcpp_args("", {filter, path}) ==
+          run_jqcpp_args(input, {filter}));
+  }
+  CHECK(run_jqcpp_args("", {"-r", "keys", path}) ==
+        run_jqcpp_args(input, {"-r", "keys"}));
+  // errors come from the evaluator as for JSON input
+  CHECK_THROWS(run_jqcpp_args("", {".missing", path}));
+  CHECK_THROWS(run_jqcpp_args("", {".version.x", path}));
+
+  // a snapshot on stdin is read into memory
+  std::ifstream file(path, std::ios::binary);
+  std::string bytes{std::istreambuf_iterator<char>(file),
+                    std::istreambuf_iterator<char>()};
+  CHECK(run_jqcpp_args(bytes, {"-c", ".version"}) == "3\n4\n");
+  CHECK_THROWS(run_jqcpp_args(bytes.substr(0, bytes.size() - 3), {"."}));
+  CHECK_THROWS(run_jqcpp_args(input, {"--save-snapshot", path, "--input-format",
+                                      "msgpack", "."}));
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Offset index of a JSON file", "[index]") {
+  auto dir = std::filesystem::temp_directory_path() / "jqcpp_index_cli_test";
+  std::filesystem::create_directories(dir);
+  std::string path = (dir / "items.json").string();
+  std::string input = R"([{"id": 0, "tags": ["a"]}, {"id": 1, "tags": []},
+    {"id": 2, "tags": ["b", "c"]}, "x", 5])";
+  std::ofstream(path, std::ios::binary) << input;
+
+  CHECK(run_jqcpp_args("", {"--build-index", "-c", ".[1]", path}) ==
+        "{\"id\":1,\"tags\":[]}\n");
+  REQUIRE(std::filesystem::exists(path + ".jqidx"));
+  for (std::string filter :
+       {".", ".[0]", ".[2].tags", ".[2].tags[1]", ".[9]", ".[1:3]", ".[3:]",
+        ".[:2]", ".[2] | keys", ".[0].id + .[1].id", ".[4].x", ".[0].missing",
+        ".key", ".[2].tags | length"}) {
+    CAPTURE(filter);
+    std::string expected;
+    try {
+      expected = run_jqcpp_args(input, {"-c", filter});
+    } catch (const std::exception &) {
+      CHECK_THROWS(run_jqcpp_args("", {"-c", filter, path}));
+      continue;
+    }
+    CHECK(run_jqcpp_args("", {"-c", filter, path}) == expected);
+  }
+
+  // only the selected element is parsed: damage another one in place
+  auto time = std::filesystem::last_write_time(path);
+  std::string damaged = input;
+  damaged[damaged.find("\"x\"")] = '?';
+  std::ofstream(path, std::ios::binary) << damaged;
+  std::filesystem::last_write_time(path, time);
+  CHECK(run_jqcpp_args("", {"-c", ".[1].id", path}) == "1\n");
+  CHECK_THROWS(run_jqcpp_args("", {"-c", ".", path}));
+
+  // a changed file makes the index stale, the whole file is read again
+  std::ofstream(path, std::ios::binary) << "[7, 8]";
+  CHECK(run_jqcpp_args("", {"-c", ".[1]", path}) == "8\n");
+
+  std::ofstream(path, std::ios::binary) << R"({"a": {"b": [1, 2]}, "c": 3})";
+  CHECK(run_jqcpp_args("", {"--build-index", "-c", ".a.b[1]", path}) ==
+        "2\n");
+  CHECK(run_jqcpp_args("", {"-c", ".c", path}) == "3\n");
+  CHECK_THROWS(run_jqcpp_args("", {"-c", ".[0]", path}));
+
+  // invalid JSON leaves no index behind
+  std::filesystem::remove(path + ".jqidx");
+  std::ofstream(path, std::ios::binary) << "[1,,2]";
+  CHECK_THROWS(run_jqcpp_args("", {"--build-index", ".[0]", path}));
+  CHECK_FALSE(std::filesystem::exists(path + ".jqidx"));
+
+  // scalars and several documents cannot be indexed
+  std::ofstream(path, std::ios::binary) << "[1] [2]";
+  CHECK_THROWS(run_jqcpp_args("", {"--build-index", ".", path}));
+  CHECK_THROWS(run_jqcpp_args("[1]", {"--build-index", "."}));
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Memory budget for large inputs", "[budget]") {
+  auto dir = std::filesystem::temp_directory_path() / "jqcpp_budget_test";
+  std::filesystem::create_directories(dir);
+  std::string path = (dir / "items.json").string();
+  std::string input = R"([{"id": 0, "tags": ["a"]}, {"id": 1, "tags": []},
+    {"id": 2, "tags": ["b", "c"]}, "x", 5] {"id": 3, "id": 4})";
+  std::ofstream(path, std::ios::binary) << input;
+
+  // run on the tape, or on one small element at a time
+  for (std::string filter : {".", ".[2].tags", "length", "keys", ".[0].id",
+                             ".id", ".[]", ".[2].tags[]", ".[] | length",
+                             ".[0] | .tags"}) {
+    CAPTURE(filter);
+    std::string expected;
+    try {
+      expected = run_jqcpp_args(input, {"-c", filter});
+    } catch (const std::exception &) {
+      CHECK_THROWS(run_jqcpp_args("", {"--memory-budget", "1", filter, path}));
+      continue;
+    }
+    // the mapped file, and stdin
+    for (std::string budget : {"1K", "1G"}) {
+      CHECK(run_jqcpp_args("", {"--memory-budget", budget, "-c", filter,
+                                path}) == expected);
+    }
+    CHECK(run_jqcpp_args(input, {"--memory-budget", "1K", "-c", filter}) ==
+          expected);
+  }
+  // printing and paths need no value at all
+  for (std::string filter : {".", ".[]"}) {
+    CHECK(run_jqcpp_args(input, {"--memory-budget", "1", "-c", filter}) ==
+          run_jqcpp_args(input, {"-c", filter}));
+  }
+  CHECK_THROWS(run_jqcpp_args("[1, 2", {"--memory-budget", "1", "."}));
+
+  // values larger than the budget are refused instead of built
+  std::string numbers = "[";
+  for (int i = 0; i < 1000; ++i) {
+    numbers += "[" + std::to_string(i) + (i < 999 ? "]," : "]]");
+  }
+  std::ofstream(path, std::ios::binary) << numbers;
+  for (std::vector<std::string> args :
+       {std::vector<std::string>{"--stream-array", "-c", ".[] | .[0]"},
+        {"-c", ".[]"}, {".[] | keys"}, {".[1:3]"}}) {
+    std::string expected = run_jqcpp_args(numbers, args);
+    args.insert(args.begin(), {"--memory-budget", "1K"});
+    args.push_back(path);
+    CHECK(run_jqcpp_args("", args) == expected);
+  }
+  for (std::vector<std::string> args :
+       {std::vector<std::string>{".[0:1000] | length"}, {".[1:]"},
+        {"--stream", "."}, {"--output-format", "cbor", "."}}) {
+    CAPTURE(args);
+    CHECK_NOTHROW(run_jqcpp_args(numbers, args));
+    args.insert(args.begin(), {"--memory-budget", "1K"});
+    args.push_back(path);
+    CHECK_THROWS(run_jqcpp_args("", args));
+  }
+  for (std::string bad : {"0", "", "1T", "M", "12MB", "99999999999"}) {
+    CHECK_THROWS(run_jqcpp_args("1", {"--memory-budget", bad, "."}));
+  }
+  // no temporary files are left behind
+  std::size_t left = 0;
+  for (const auto &entry : std::filesystem::directory_iterator(
+           std::filesystem::temp_directory_path())) {
+    left += entry.path().filename().string().rfind("jqcpp-", 0) == 0;
+  }
+  CHECK(left == 0);
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Integers are exact", "[integer]") {
+  std::string input = R"({"id": 1152921504606846977, "a": 9007199254740993,
+    "b": 2, "max": 9223372036854775807, "neg": -0, "list": [1, 2, 3]})";
+  CHECK(run_jqcpp_args(input, {".id"}) == "1152921504606846977\n");
+  CHECK(run_jqcpp_args(input, {".a + .b"}) == "9007199254740995\n");
+  CHECK(run_jqcpp_args(input, {".a - .b"}) == "9007199254740991\n");
+  // literals of the filter too
+  CHECK(run_jqcpp_args(input, {".a + 2"}) == "9007199254740995\n");
+  CHECK(run_jqcpp_args(input, {".a - 9007199254740992"}) == "1\n");
+  CHECK(run_jqcpp_args(input, {".b + 0.5"}) == "2.5\n");
+  // past int64 the sum is a double
+  CHECK(run_jqcpp_args(input, {".max + .b"}) == "9223372036854775808\n");
+  CHECK(run_jqcpp_args(input, {".neg"}) == "-0\n");
+  CHECK(run_jqcpp_args(input, {".list | length"}) == "3\n");
+  CHECK(run_jqcpp_args(input, {"-c", ".list | keys"}) == "[0,1,2]\n");
+  for (std::string format : {"msgpack", "cbor"}) {
+    CAPTURE(format);
+    std::string encoded =
+        run_jqcpp_args(input, {"--output-format", format, "."});
+    CHECK(run_jqcpp_args(encoded, {"--input-format", format, "-c", "."}) ==
+          run_jqcpp_args(input, {"-c", "."}));
+  }
+}
+
+TEST_CASE("Lazy numbers", "[integer]") {
+  std::string input = R"({"a": [1.0, 1e2, 0.1000000000000000000001, -0,
+    123456789012345678901234567890, 1E400], "b": 2.50, "c": 9007199254740993})";
+  std::vector<std::string> args = {"--lazy-numbers", "-c"};
+  auto run = [&](const std::string &filter) {
+    auto all = args;
+    all.push_back(filter);
+    return run_jqcpp_args(input, all);
+  };
+  // printed as written
+  CHECK(run(".a") == "[1.0,1e2,0.1000000000000000000001,-0,"
+                     "123456789012345678901234567890,1E400]\n");
+  CHECK(run(".b") == "2.50\n");
+  // converted for arithmetic, integers stay exact
+  CHECK(run(".b + .b") == "5\n");
+  CHECK(run(".c + .c") == "18014398509481986\n");
+  CHECK(run(".a | length") == "6\n");
+  CHECK_THROWS(run(".a[5] + .b"));
+  // on every path reading JSON text
+  std::string array = "[1.10, 100000000000000000000001]";
+  for (std::vector<std::string> other :
+       {std::vector<std::string>{"--stream-array", ".[]"},
+        {"--parallel-parse", "."},
+        {"--parallel-parse", "--threads", "2", "."},
+        {"--pipeline", "."}}) {
+    CAPTURE(other);
+    other.insert(other.begin(), {"--lazy-numbers", "-c"});
+    std::string expected =
+        other[2] == "--stream-array" ? "1.10\n100000000000000000000001\n"
+                                     : "[1.10,100000000000000000000001]\n";
+    CHECK(run_jqcpp_args(array, other) == expected);
+  }
+  // binary output converts them
+  std::string small = R"([2.50, 9007199254740993])";
+  CHECK(run_jqcpp_args(small, {"--lazy-numbers", "--output-format", "cbor",
+                               "."}) ==
+        run_jqcpp_args(small, {"--output-format", "cbor", "."}));
+  // without the option numbers are formatted from their value, 1E400 does
+  // not fit in a double
+  CHECK(run_jqcpp_args(small, {"-c", "."}) == "[2.5,9007199254740993]\n");
+  CHECK_THROWS(run_jqcpp_args(input, {"-c", ".b"}));
+}
+
+TEST_CASE("Nesting depth limit", "[depth]") {
+  std::string deep = std::string(20000, '[') + std::string(20000, ']');
+  CHECK_THROWS(run_jqcpp_args(deep, {"length"}));
+  CHECK(run_jqcpp_args(deep, {"--max-depth", "20000", "length"}) == "1\n");
+  CHECK(run_jqcpp_args(deep, {"--max-depth", "20000", "-c", "."}) ==
+        deep + "\n");
+  CHECK(run_jqcpp_args("[[1]]", {"--max-depth", "2", "-c", "."}) ==
+        "[[1]]\n");
+  CHECK_THROWS(run_jqcpp_args("[[[1]]]", {"--max-depth", "2", "."}));
+  CHECK_THROWS(run_jqcpp_args("[[[1]]]",
+                              {"--max-depth", "2", "--pipeline", "."}));
+  for (std::string bad : {"0", "", "-1", "x", "9999999999"}) {
+    CHECK_THROWS(run_jqcpp_args("1", {"--max-depth", bad, "."}));
+  }
+
+  // deeper values are written, saved and rebuilt without recursion
+  std::string deeper =
+      std::string(200000, '[') + "1" + std::string(200000, ']');
+  CHECK(run_jqcpp_args(deeper, {"--max-depth", "200000", "--output-format",
+                                "msgpack", "-c", "."}) ==
+        std::string(200000, '\x91') + '\x01');
+  CHECK(run_jqcpp_args(deeper, {"--max-depth", "200000", "--output-format",
+                                "cbor", "-c", "."}) ==
+        std::string(200000, '\x81') + '\x01');
+  CHECK(run_jqcpp_args(deeper, {"--max-depth", "200000", "--parallel-parse",
+                                "--threads", "2", "length"}) == "1\n");
+  CHECK_THROWS(run_jqcpp_args(deeper, {"--parallel-parse", "--threads", "2",
+                                       "length"}));
+  auto path = std::filesystem::temp_directory_path() / "jqcpp_deep.snap";
+  run_jqcpp_args(deeper, {"--max-depth", "200000", "--save-snapshot",
+                          path.string(), "length"});
+  CHECK(run_jqcpp_args("", {"-c", ".[0][0] | length", path.string()}) ==
+        "1\n");
+  CHECK(run_jqcpp_args("", {"-c", ".[0:1] | length", path.string()}) ==
+        "1\n");
+  CHECK_THROWS(run_jqcpp_args("", {".[0][0] + 1", path.string()}));
+  std::filesystem::remove(path);
+}
+
+// what --validate writes to std::cerr for input
+std::string validate_errors(const std::string &input,
+                            std::vector<std::string> args = {}) {
+  std::ostringstream errors;
+  std::streambuf *saved = std::cerr.rdbuf(errors.rdbuf());
+  args.push_back("--validate");
+  try {
+    run_jqcpp_args(input, args);
+  } catch (const std::exception &) {
+  }
+  std::cerr.rdbuf(saved);
+  return errors.str();
+}
+
+TEST_CASE("Validate mode", "[validate]") {
+  CHECK(run_jqcpp_args(R"({"a": [1, "x"]} 2)", {"--validate"}).empty());
+  CHECK_THROWS(run_jqcpp_args(R"({"a": [1, "x"})", {"--validate"}));
+  CHECK_THROWS(run_jqcpp_args("[[1]]", {"--max-depth", "1", "--validate"}));
+
+  // the error names the byte it was found at
+  CHECK(validate_errors("[1, 2") ==
+        "Error: <stdin>: Unexpected end of input at byte 5\n");
+  CHECK(validate_errors("{\"a\" 1}") ==
+        "Error: <stdin>: Expected : at byte 5\n");
+  CHECK(validate_errors("[[1]]", {"--max-depth", "1"}) ==
+        "Error: <stdin>: Exceeds depth limit for parsing at byte 1\n");
+  CHECK(validate_errors("[1] 2").empty());
+
+  // a top level number needs whitespace before the next value
+  CHECK(validate_errors("01") == "Error: <stdin>: Expected whitespace after "
+                                 "a top level value at byte 1\n");
+  CHECK(validate_errors("1true") == "Error: <stdin>: Expected whitespace "
+                                    "after a top level value at byte 1\n");
+  CHECK(validate_errors("0 1\n").empty());
+
+  auto path = std::filesystem::temp_directory_path() / "jqcpp_validate.json";
+  {
+    std::ofstream file(path);
+    file << "[1, 2, 3]\n";
+  }
+  CHECK(run_jqcpp_args("", {"--validate", path.string()}).empty());
+  {
+    std::ofstream file(path);
+    file << "[1, 2, 3\n";
+  }
+  CHECK_THROWS(run_jqcpp_args("", {"--validate", path.string()}));
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("SIMD level selection", "[simd]") {
+  std::string report = run_jqcpp_args("", {"--cpu-features"});
+  CHECK(report.find("best level: ") != std::string::npos);
+  CHECK(report.find("kernels: ") != std::string::npos);
+  CHECK(run_jqcpp_args("", {"--simd-level", "scalar", "--cpu-features"})
+            .find("kernels: scalar") != std::string::npos);
+  std::string input = R"(["caf\u00e9 \"x\"", "tab\there"])";
+  CHECK(run_jqcpp_args(input, {"--simd-level", "scalar", "-c", "."}) ==
+        run_jqcpp_args(input, {"--simd-level", "sse2", "-c", "."}));
+  CHECK_THROWS(run_jqcpp_args(input, {"--simd-level", "avx3", "."}));
+  // back to the detected level for the other tests
+  json::set_simd_level(json::detected_simd_level());
+}
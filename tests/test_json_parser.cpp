@@ -1,6 +1,22 @@
+#include "jqcpp/cpu_dispatch.hpp"
+#include "jqcpp/disk_tape.hpp"
 #include "jqcpp/json_parser.hpp"
+#include "jqcpp/json_sax.hpp"
+#include "jqcpp/json_stream.hpp"
+#include "jqcpp/json_validator.hpp"
+#include "jqcpp/offset_index.hpp"
+#include "jqcpp/parallel_parser.hpp"
+#include "jqcpp/pretty_printer.hpp"
+#include "jqcpp/snapshot.hpp"
+#include "jqcpp/string_escape.hpp"
+#include "jqcpp/tape.hpp"
+#include "jqcpp/utf8.hpp"
 #include <catch2/catch_all.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
 
 using namespace jqcpp::json;
 
@@ -238,3 +254,918 @@ TEST_CASE("JSONParser handles complex nested structures", "[parser]") {
   REQUIRE(number_it != phoneNumbers[1].get_object().end());
   CHECK(number_it->second.get_string() == "555-5678");
 }
+
+TEST_CASE("Pre-scan finds the top level array elements", "[parallel]") {
+  SECTION("Nested values, strings and escapes") {
+    std::string text = R"( [1, {"a": [2, 3]}, "x,]\"y", [] ] )";
+    auto spans = find_array_elements(text);
+    REQUIRE(spans);
+    REQUIRE(spans->size() == 4);
+    auto element = [&](std::size_t i) {
+      return text.substr((*spans)[i].begin,
+                         (*spans)[i].end - (*spans)[i].begin);
+    };
+    CHECK(element(0) == "1");
+    CHECK(element(1) == R"( {"a": [2, 3]})");
+    CHECK(element(2) == R"( "x,]\"y")");
+  }
+
+  SECTION("Empty array") {
+    auto spans = find_array_elements("[ ]");
+    REQUIRE(spans);
+    CHECK(spans->empty());
+  }
+
+  SECTION("Not a single top level array") {
+    CHECK_FALSE(find_array_elements(R"({"a": 1})"));
+    CHECK_FALSE(find_array_elements("[1, 2"));
+    CHECK_FALSE(find_array_elements("[1] [2]"));
+    CHECK_FALSE(find_array_elements(R"(["abc)"));
+  }
+}
+
+TEST_CASE("ParallelJSONParser parses top level arrays", "[parallel]") {
+  ParallelJSONParser parser(4, 0);
+
+  SECTION("Same result as the serial parser") {
+    std::string text = "[";
+    for (int i = 0; i < 1000; ++i) {
+      if (i != 0) {
+        text += ",";
+      }
+      text += R"({"id": )" + std::to_string(i) + R"(, "tags": ["a", "b"]})";
+    }
+    text += "]";
+    auto result = parser.parse(text);
+    REQUIRE(result.is_array());
+    const auto &arr = result.get_array();
+    REQUIRE(arr.size() == 1000);
+    for (int i = 0; i < 1000; ++i) {
+      CHECK(arr[i]["id"].get_number() == i);
+    }
+    CHECK(arr[999]["tags"][1].get_string() == "b");
+  }
+
+  SECTION("Fewer elements than threads") {
+    auto result = parser.parse("[true]");
+    REQUIRE(result.get_array().size() == 1);
+    CHECK(parser.parse("[]").get_array().empty());
+  }
+
+  SECTION("Other documents fall back to the serial parser") {
+    auto result = parser.parse(R"({"a": [1, 2]})");
+    CHECK(result.is_object());
+    CHECK(parser.parse("42").get_number() == 42);
+  }
+
+  SECTION("Errors inside elements are reported") {
+    CHECK_THROWS_AS(parser.parse("[1, 2 3, 4]"), JSONParserError);
+    CHECK_THROWS(parser.parse("[1, , 2]"));
+    CHECK_THROWS_AS(parser.parse("[1, tru, 2]"), JSONTokenizerError);
+    CHECK_THROWS(parser.parse("[1, 2"));
+  }
+
+  SECTION("Depth limit") {
+    std::string deep = "[1, " + std::string(20000, '[') +
+                       std::string(20000, ']') + "]";
+    CHECK_THROWS_AS(parser.parse(deep), JSONParserError);
+    parser.set_max_depth(20001);
+    CHECK(parser.parse(deep).get_array().size() == 2);
+    parser.set_max_depth(2);
+    CHECK(parser.parse("[[1], [2]]").get_array().size() == 2);
+    CHECK_THROWS_AS(parser.parse("[[1], [[2]]]"), JSONParserError);
+    CHECK_THROWS_AS(parser.parse("{\"a\": [[2]]}"), JSONParserError);
+  }
+}
+
+TEST_CASE("JSONArrayStream reads one element at a time", "[stream]") {
+  SECTION("Elements split across small chunks") {
+    std::istringstream input(R"( [ {"a": "x]\"y"}, [1, [2]], 3, "s" ] )");
+    JSONArrayStream stream(input, 3);
+    REQUIRE(stream.open());
+    JSONValue element;
+    REQUIRE(stream.next(element));
+    CHECK(element["a"].get_string() == "x]\"y");
+    REQUIRE(stream.next(element));
+    CHECK(element[1][0].get_number() == 2);
+    REQUIRE(stream.next(element));
+    CHECK(element.get_number() == 3);
+    REQUIRE(stream.next(element));
+    CHECK(element.get_string() == "s");
+    CHECK_FALSE(stream.next(element));
+    CHECK_FALSE(stream.next(element));
+  }
+
+  SECTION("Empty array") {
+    std::istringstream input("[ ]");
+    JSONArrayStream stream(input);
+    REQUIRE(stream.open());
+    JSONValue element;
+    CHECK_FALSE(stream.next(element));
+  }
+
+  SECTION("Other documents are left to the caller") {
+    std::istringstream input(R"(  {"a": 1})");
+    JSONArrayStream stream(input);
+    CHECK_FALSE(stream.open());
+    CHECK(stream.remaining() == R"({"a": 1})");
+  }
+
+  SECTION("Malformed arrays") {
+    std::istringstream truncated("[1, 2");
+    JSONArrayStream stream(truncated);
+    REQUIRE(stream.open());
+    JSONValue element;
+    CHECK(stream.next(element));
+    CHECK_THROWS_AS(stream.next(element), JSONParserError);
+
+    std::istringstream extra("[1 2]");
+    JSONArrayStream extra_stream(extra);
+    REQUIRE(extra_stream.open());
+    CHECK_THROWS_AS(extra_stream.next(element), JSONParserError);
+
+    std::istringstream trailing("[1, 2] \n garbage");
+    JSONArrayStream trailing_stream(trailing, 4);
+    REQUIRE(trailing_stream.open());
+    CHECK(trailing_stream.next(element));
+    CHECK(trailing_stream.next(element));
+    CHECK_THROWS_AS(trailing_stream.next(element), JSONParserError);
+
+    std::istringstream empty("[] 1");
+    JSONArrayStream empty_stream(empty);
+    REQUIRE(empty_stream.open());
+    CHECK_THROWS_AS(empty_stream.next(element), JSONParserError);
+  }
+}
+
+TEST_CASE("Stream events of a document", "[stream]") {
+  auto events_of = [](std::string_view text) {
+    std::vector<std::string> events;
+    JSONPrinter printer(PrintOptions{0, false, true});
+    StreamEventBuilder builder([&](JSONValue event) {
+      events.push_back(printer.print(event));
+    });
+    JSONTokenizer tokenizer;
+    tokenizer.tokenize(text,
+                       [&](const Token &token) { builder.on_token(token); });
+    CHECK(builder.complete());
+    return events;
+  };
+
+  SECTION("Leaves and closing events") {
+    CHECK(events_of(R"({"a": [1, 2]})") ==
+          std::vector<std::string>{R"([["a",0],1])", R"([["a",1],2])",
+                                   R"([["a",1]])", R"([["a"]])"});
+  }
+
+  SECTION("Empty containers are leaves") {
+    CHECK(events_of(R"({"a": [], "b": {}})") ==
+          std::vector<std::string>{R"([["a"],[]])", R"([["b"],{}])",
+                                   R"([["b"]])"});
+  }
+
+  SECTION("Top level scalar") {
+    CHECK(events_of("3") == std::vector<std::string>{"[[],3]"});
+  }
+
+  SECTION("Events rebuild the document") {
+    JSONTokenizer tokenizer;
+    JSONParser parser;
+    JSONValue doc =
+        parser.parse(tokenizer.tokenize(R"({"a": [1, {"b": null}]})"));
+    std::vector<JSONValue> rebuilt;
+    StreamValueBuilder values;
+    StreamEventBuilder builder([&](JSONValue event) {
+      JSONValue value;
+      if (values.add(event, value)) {
+        rebuilt.push_back(std::move(value));
+      }
+    });
+    builder.on_value(doc);
+    REQUIRE(rebuilt.size() == 1);
+    JSONPrinter printer;
+    CHECK(printer.print(rebuilt[0]) == printer.print(doc));
+  }
+
+  SECTION("Malformed input") {
+    CHECK_THROWS_AS(events_of("[1}"), JSONParserError);
+    CHECK_THROWS_AS(events_of("{1: 2}"), JSONParserError);
+  }
+}
+
+namespace {
+
+// aggregates on the fly, nothing is allocated per value
+struct CountingHandler : JSONHandler {
+  int objects = 0;
+  int arrays = 0;
+  int depth = 0;
+  int max_depth = 0;
+  double sum = 0;
+  std::string last_key;
+  std::vector<std::string> strings;
+
+  void on_start_object() override {
+    ++objects;
+    max_depth = std::max(max_depth, ++depth);
+  }
+  void on_end_object() override { --depth; }
+  void on_start_array() override {
+    ++arrays;
+    max_depth = std::max(max_depth, ++depth);
+  }
+  void on_end_array() override { --depth; }
+  void on_key(std::string_view key) override { last_key = key; }
+  void on_string(std::string_view value) override {
+    strings.emplace_back(value);
+  }
+  void on_number(double value, std::string_view) override { sum += value; }
+};
+
+} // namespace
+
+TEST_CASE("JSONSAXParser drives a handler from the bytes", "[sax]") {
+  JSONSAXParser parser;
+
+  SECTION("Events") {
+    CountingHandler handler;
+    parser.parse(
+        R"( {"a": [1, 2.5, {"b": -3}], "c": "x", "d": [true, null]} )",
+        handler);
+    CHECK(handler.objects == 2);
+    CHECK(handler.arrays == 2);
+    CHECK(handler.depth == 0);
+    CHECK(handler.max_depth == 3);
+    CHECK(handler.sum == 0.5);
+    CHECK(handler.last_key == "d");
+    CHECK(handler.strings == std::vector<std::string>{"x"});
+  }
+
+  SECTION("Number text is kept") {
+    struct Handler : JSONHandler {
+      std::string text;
+      void on_number(double, std::string_view number) override {
+        text = number;
+      }
+    } handler;
+    parser.parse("1.50e+2", handler);
+    CHECK(handler.text == "1.50e+2");
+  }
+
+  SECTION("Escapes are decoded") {
+    CountingHandler handler;
+    parser.parse(R"(["a\"b\n", "\u00e9\ud83d\ude00", "\ud800"])", handler);
+    REQUIRE(handler.strings.size() == 3);
+    CHECK(handler.strings[0] == "a\"b\n");
+    CHECK(handler.strings[1] == "\xc3\xa9\xf0\x9f\x98\x80");
+    CHECK(handler.strings[2] == "\xef\xbf\xbd");
+  }
+
+  SECTION("Builds the same value as JSONParser") {
+    std::string text = R"({"a": [1, {"b": null}], "c": "s", "a": false})";
+    JSONValueBuilder builder;
+    parser.parse(text, builder);
+    REQUIRE(builder.has_value());
+    JSONValue value = builder.take();
+    JSONTokenizer tokenizer;
+    JSONParser dom_parser;
+    JSONPrinter printer;
+    CHECK(printer.print(value) ==
+          printer.print(dom_parser.parse(tokenizer.tokenize(text))));
+    CHECK_FALSE(builder.has_value());
+  }
+
+  SECTION("Errors report the offset") {
+    JSONHandler handler;
+    CHECK_THROWS_AS(parser.parse("", handler), JSONParserError);
+    CHECK_THROWS_AS(parser.parse("[1, 2", handler), JSONParserError);
+    CHECK_THROWS_AS(parser.parse("[1 2]", handler), JSONParserError);
+    CHECK(parser.offset() == 3);
+    CHECK_THROWS_AS(parser.parse("{\"a\": 1]", handler), JSONParserError);
+    CHECK(parser.offset() == 7);
+    CHECK_THROWS_AS(parser.parse("{1: 2}", handler), JSONParserError);
+    CHECK_THROWS_AS(parser.parse("[1] 2", handler), JSONParserError);
+    CHECK_THROWS_AS(parser.parse("[tru]", handler), JSONTokenizerError);
+    CHECK_THROWS_AS(parser.parse("[01.]", handler), JSONParserError);
+    CHECK_THROWS_AS(parser.parse("[1.]", handler), JSONTokenizerError);
+    CHECK_THROWS_AS(parser.parse("\"abc", handler), JSONTokenizerError);
+  }
+}
+
+TEST_CASE("JSONSAXParser push mode", "[sax]") {
+  std::string text =
+      R"({"s": "a\"b\\c\u00e9", "n": [-12.5e+3, 0, true, false, null]} 42
+      "x" [])";
+  JSONPrinter printer(PrintOptions{0, false, true});
+
+  SECTION("Documents are complete for any split of the input") {
+    for (std::size_t chunk = 1; chunk <= text.size(); ++chunk) {
+      std::vector<std::string> documents;
+      JSONValueBuilder builder([&](JSONValue document) {
+        documents.push_back(printer.print(document));
+      });
+      JSONSAXParser parser;
+      for (std::size_t pos = 0; pos < text.size(); pos += chunk) {
+        parser.feed(std::string_view(text).substr(pos, chunk), builder);
+      }
+      parser.finish(builder);
+      REQUIRE(documents.size() == 4);
+      CHECK(documents[0] ==
+            R"({"s":"a\"b\\c)"
+            "\xc3\xa9"
+            R"(","n":[-12500,0,true,false,null]})");
+      CHECK(documents[1] == "42");
+      CHECK(documents[2] == R"("x")");
+      CHECK(documents[3] == "[]");
+    }
+  }
+
+  SECTION("Documents are emitted before the input ends") {
+    std::vector<std::string> documents;
+    JSONValueBuilder builder([&](JSONValue document) {
+      documents.push_back(printer.print(document));
+    });
+    JSONSAXParser parser;
+    parser.feed(R"({"a": [1, "x)", builder);
+    CHECK(documents.empty());
+    parser.feed(R"("]} {"b")", builder);
+    REQUIRE(documents.size() == 1);
+    CHECK(documents[0] == R"({"a":[1,"x"]})");
+    parser.feed(": 1} 1", builder);
+    CHECK(documents.size() == 2);
+    // the number may go on in the next chunk
+    parser.feed("2", builder);
+    CHECK(documents.size() == 2);
+    parser.finish(builder);
+    REQUIRE(documents.size() == 3);
+    CHECK(documents[2] == "12");
+  }
+
+  SECTION("Errors") {
+    JSONHandler handler;
+    JSONSAXParser parser;
+    parser.feed("[1, 2", handler);
+    CHECK_THROWS_AS(parser.finish(handler), JSONParserError);
+
+    parser.reset();
+    parser.feed("[1, ", handler);
+    CHECK_THROWS_AS(parser.feed("2 3]", handler), JSONParserError);
+    CHECK(parser.offset() == 6);
+
+    parser.reset();
+    CHECK_THROWS_AS(parser.feed("[tx", handler), JSONTokenizerError);
+
+    parser.reset();
+    parser.feed("\"abc", handler);
+    CHECK_THROWS_AS(parser.finish(handler), JSONTokenizerError);
+  }
+}
+
+TEST_CASE("Tape of a parsed document", "[tape]") {
+  JSONSAXParser parser;
+  TapeBuilder builder;
+  std::string text =
+      R"({"a": [1, "two", null, {"b": true}], "c": {}, "a2": [], "c": 3.5})";
+  parser.parse(text, builder);
+  Tape tape = builder.take();
+  TapeView view = tape.view();
+  JSONPrinter printer;
+
+  SECTION("Navigation") {
+    TapeRef root(view, 0);
+    REQUIRE(root.is_object());
+    CHECK(root.end() == view.size);
+    CHECK(root.size() == 4);
+    auto a = root.find("a");
+    REQUIRE(a);
+    CHECK(a->is_array());
+    CHECK(a->size() == 4);
+    CHECK(a->at(0)->get_number() == 1);
+    CHECK(a->at(1)->get_string() == "two");
+    CHECK(a->at(2)->is_null());
+    CHECK(a->at(3)->find("b")->get_bool());
+    CHECK_FALSE(a->at(4));
+    // duplicate keys keep the last value
+    CHECK(root.find("c")->get_number() == 3.5);
+    CHECK_FALSE(root.find("missing"));
+    CHECK_THROWS_AS(a->find("b"), TapeError);
+  }
+
+  SECTION("Building the JSONValue") {
+    auto expected = JSONParser().parse(JSONTokenizer().tokenize(text));
+    CHECK(printer.print(TapeRef(view, 0).to_value()) ==
+          printer.print(expected));
+    TapeBuilder copy;
+    copy.on_value(expected);
+    Tape copied = copy.take();
+    CHECK(copied.words.size() < tape.words.size());
+    TapeView copied_view = copied.view();
+    CHECK(printer.print(TapeRef(copied_view, 0).to_value()) ==
+          printer.print(expected));
+  }
+
+  SECTION("Iteration") {
+    TapeRef root(view, 0);
+    std::vector<std::string_view> keys;
+    for (const auto &member : root.members()) {
+      keys.push_back(member.key);
+    }
+    CHECK(keys == std::vector<std::string_view>{"a", "c", "a2", "c"});
+    CHECK_FALSE(root.unique_keys());
+    auto a = root.find("a");
+    CHECK(a->unique_keys());
+    std::size_t count = 0;
+    for (TapeRef element : a->elements()) {
+      CHECK(element.index() == a->at(count)->index());
+      ++count;
+    }
+    CHECK(count == 4);
+    CHECK(root.find("a2")->elements().begin() ==
+          root.find("a2")->elements().end());
+    CHECK_THROWS_AS(root.elements(), TapeError);
+    CHECK_THROWS_AS(a->members(), TapeError);
+  }
+
+  SECTION("Printing from the tape") {
+    for (const auto &options : {PrintOptions{}, PrintOptions{2, false, true},
+                                PrintOptions{1, true}}) {
+      JSONPrinter with(options);
+      for (std::string doc :
+           {text, std::string(R"([[], {}, "\u00e9\n", -0.5, [{"a": [1]}]])"),
+            std::string("3"), std::string(R"({"x": 1, "y": {"x": 2}})")}) {
+        CAPTURE(doc);
+        JSONSAXParser doc_parser;
+        TapeBuilder doc_builder;
+        doc_parser.parse(doc, doc_builder);
+        Tape doc_tape = doc_builder.take();
+        TapeView doc_view = doc_tape.view();
+        OutputBuffer out;
+        with.print(TapeRef(doc_view, 0), out);
+        CHECK(out.take() == with.print(TapeRef(doc_view, 0).to_value()));
+      }
+    }
+  }
+
+  SECTION("Damaged tapes throw") {
+    Tape broken = tape;
+    broken.words.resize(broken.words.size() - 1);
+    TapeView broken_view = broken.view();
+    CHECK_THROWS_AS(TapeRef(broken_view, 0).to_value(), TapeError);
+    broken = tape;
+    broken.strings.clear();
+    broken_view = broken.view();
+    CHECK_THROWS_AS(TapeRef(broken_view, 0).to_value(), TapeError);
+    CHECK_THROWS_AS(TapeRef(view, view.size - 1), TapeError);
+    CHECK_THROWS_AS(TapeRef(view, view.size), TapeError);
+  }
+
+  SECTION("Snapshot round trip") {
+    std::stringstream file;
+    save_snapshot(view, file);
+    std::string bytes = file.str();
+    CHECK(is_snapshot(bytes));
+    Snapshot snapshot(file);
+    REQUIRE(snapshot.tape().size == view.size);
+    CHECK(printer.print(TapeRef(snapshot.tape(), 0).to_value()) ==
+          printer.print(TapeRef(view, 0).to_value()));
+    std::istringstream truncated(bytes.substr(0, bytes.size() - 1));
+    CHECK_THROWS(Snapshot(truncated));
+    std::istringstream text_input(text);
+    CHECK_THROWS(Snapshot(text_input));
+    // a snapshot of an older tape format is refused by its version
+    std::string old = bytes;
+    old.replace(0, kSnapshotMagicSize, "JQSNAP02");
+    CHECK(is_snapshot(old));
+    std::istringstream old_input(old);
+    CHECK_THROWS_WITH(Snapshot(old_input),
+                      "The snapshot was written by another version of jqcpp");
+  }
+}
+
+TEST_CASE("Tape spilled to temporary files", "[tape]") {
+  std::string text = R"({"a": [1, {"k": "v", "k2": null}], "b": "x",
+    "c": {"k": [true, false], "k": 2}, "a": 3.5, "d": [[], {}]}
+    [1, "two", {"k": 3}] "alone" {"z": 1, "y": {"z": [2]}})";
+  TapeBuilder memory;
+  JSONSAXParser parser;
+  parser.feed(text, memory);
+  parser.finish(memory);
+  Tape expected = memory.take();
+  for (std::size_t budget : {1, 16, 64, 1 << 20}) {
+    CAPTURE(budget);
+    DiskTape disk(budget);
+    JSONSAXParser spilled;
+    spilled.feed(text, disk.handler());
+    spilled.finish(disk.handler());
+    const TapeView &tape = disk.finish();
+    // the same words, patched starts and repeated key marks included
+    REQUIRE(tape.size == expected.words.size());
+    CHECK(std::equal(tape.words, tape.words + tape.size,
+                     expected.words.begin()));
+    CHECK(tape.strings == expected.strings);
+    CHECK_FALSE(TapeRef(tape, 0).unique_keys());
+  }
+}
+
+TEST_CASE("Offset index of a JSON file", "[index]") {
+  auto dir = std::filesystem::temp_directory_path() / "jqcpp_index_test";
+  std::filesystem::create_directories(dir);
+  std::string path = (dir / "data.jqidx").string();
+  auto build = [&](std::string_view text) {
+    std::ofstream file(path, std::ios::binary);
+    build_offset_index(text, 42, file);
+  };
+
+  SECTION("Array elements") {
+    std::string text = R"( [1, "a,]\"", {"b": [2, "}"]}, [] ,null] )";
+    build(text);
+    OffsetIndex index(path);
+    REQUIRE(index.is_array());
+    REQUIRE(index.size() == 5);
+    CHECK(index.matches(text.size(), 42));
+    CHECK_FALSE(index.matches(text.size(), 43));
+    CHECK(index.value(text, 0) == "1");
+    CHECK(index.value(text, 1) == R"("a,]\"")");
+    CHECK(index.value(text, 2) == R"({"b": [2, "}"]})");
+    CHECK(index.value(text, 3) == "[]");
+    CHECK(index.value(text, 4) == "null");
+    CHECK(index.key(0).empty());
+    CHECK_THROWS(index.value(text.substr(0, 10), 2));
+  }
+
+  SECTION("Object members") {
+    std::string text =
+        R"({"a": 1, "bé": {"c": [3]}, "a": "x", "": {}, "\u0041": 5})";
+    build(text);
+    OffsetIndex index(path);
+    REQUIRE_FALSE(index.is_array());
+    REQUIRE(index.size() == 5);
+    CHECK(index.key(1) == "b\xc3\xa9");
+    CHECK(index.value(text, *index.find("b\xc3\xa9")) == R"({"c": [3]})");
+    // duplicate keys keep the last value
+    CHECK(index.value(text, *index.find("a")) == R"("x")");
+    CHECK(index.value(text, *index.find("")) == "{}");
+    // keys are stored decoded
+    CHECK(index.value(text, *index.find("A")) == "5");
+    CHECK_FALSE(index.find("c"));
+  }
+
+  SECTION("Empty containers and bad input") {
+    build("[ ]");
+    CHECK(OffsetIndex(path).size() == 0);
+    std::ostringstream out;
+    CHECK_THROWS(build_offset_index("3", 0, out));
+    CHECK_THROWS(build_offset_index("[1, 2", 0, out));
+    CHECK_THROWS(build_offset_index("[1 2]", 0, out));
+    CHECK_THROWS(build_offset_index("{\"a\" 1}", 0, out));
+    CHECK_THROWS(build_offset_index("[1] [2]", 0, out));
+    // nested values are validated too, nothing is written for them
+    CHECK_THROWS_WITH(build_offset_index("[1,,2]", 0, out),
+                      "Invalid input at offset 3");
+    CHECK_THROWS(build_offset_index("[[1,,2]]", 0, out));
+    CHECK_THROWS(build_offset_index("{\"a\": {\"b\":}}", 0, out));
+    CHECK_THROWS(build_offset_index("[tru]", 0, out));
+    CHECK_THROWS(build_offset_index("[[[1]]]", 0, out, 2));
+    CHECK(out.str().empty());
+    std::ofstream(path, std::ios::binary) << "[1, 2]";
+    CHECK_THROWS(OffsetIndex(path));
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Integers beyond 2^53 stay exact", "[integer]") {
+  std::string text = R"([9007199254740993, -9223372036854775808,
+    9223372036854775807, 9223372036854775808, 1.0, -0, 1e2, 42])";
+  std::string expected = "[9007199254740993,-9223372036854775808,"
+                         "9223372036854775807,9223372036854775808,1,-0,100,"
+                         "42]";
+  JSONPrinter printer(PrintOptions{0, false, true});
+
+  SECTION("Parsers") {
+    auto tree = JSONParser().parse(JSONTokenizer().tokenize(text));
+    const auto &array = tree.get_array();
+    CHECK(array[0].is_integer());
+    CHECK(array[0].get_integer() == 9007199254740993);
+    CHECK(array[2].get_integer() == std::numeric_limits<std::int64_t>::max());
+    // past int64, fractions, -0 and exponents stay doubles
+    for (std::size_t i : {3, 4, 5, 6}) {
+      CHECK_FALSE(array[i].is_integer());
+      CHECK(array[i].is_number());
+    }
+    CHECK(array[7].get_number() == 42);
+    CHECK(printer.print(tree) == expected);
+    JSONValueBuilder builder;
+    JSONSAXParser().parse(text, builder);
+    CHECK(printer.print(builder.take()) == expected);
+  }
+
+  SECTION("Tape") {
+    TapeBuilder builder;
+    JSONSAXParser().parse(text, builder);
+    Tape tape = builder.take();
+    TapeView view = tape.view();
+    TapeRef root(view, 0);
+    CHECK(root.at(0)->is_integer());
+    CHECK(root.at(0)->is_number());
+    CHECK(root.at(1)->get_integer() ==
+          std::numeric_limits<std::int64_t>::min());
+    CHECK(root.at(7)->get_number() == 42);
+    CHECK_FALSE(root.at(4)->is_integer());
+    OutputBuffer out;
+    printer.print(root, out);
+    CHECK(out.take() == expected);
+    CHECK(printer.print(root.to_value()) == expected);
+  }
+
+  SECTION("Arithmetic") {
+    JSONValue big(std::int64_t{9007199254740993});
+    CHECK((big + JSONValue(std::int64_t{1})).get_integer() ==
+          9007199254740994);
+    CHECK((big - JSONValue(std::int64_t{2})).get_integer() ==
+          9007199254740991);
+    // overflow falls back to a double
+    JSONValue max(std::numeric_limits<std::int64_t>::max());
+    auto sum = max + JSONValue(std::int64_t{1});
+    CHECK_FALSE(sum.is_integer());
+    CHECK(sum.get_number() == 9223372036854775808.0);
+    auto low = JSONValue(std::numeric_limits<std::int64_t>::min()) -
+               JSONValue(std::int64_t{1});
+    CHECK_FALSE(low.is_integer());
+    CHECK((big + JSONValue(0.5)).get_number() == 9007199254740992.0);
+  }
+}
+
+TEST_CASE("Numbers kept as text", "[integer]") {
+  JSONValueBuilder builder;
+  builder.set_lazy_numbers(true);
+  JSONSAXParser().parse(R"([1.50, 12, -3e1, 18446744073709551616])", builder);
+  JSONValue value = builder.take();
+  const auto &array = value.get_array();
+  for (const auto &number : array) {
+    CHECK(number.is_number());
+    CHECK(number.is_number_text());
+  }
+  CHECK(array[0].get_number_text() == "1.50");
+  CHECK(array[0].get_number() == 1.5);
+  CHECK(array[1].number_value().get_integer() == 12);
+  CHECK(array[2].number_value().get_number() == -30);
+  CHECK(array[3].get_number() == 18446744073709551616.0);
+  CHECK((array[1] + array[1]).get_integer() == 24);
+  CHECK((array[0] - array[1]).get_number() == -10.5);
+
+  ParallelJSONParser parallel(2, 0);
+  parallel.set_lazy_numbers(true);
+  JSONValue parsed = parallel.parse("[1.50, [12], {\"a\": 1e2}]");
+  CHECK(parsed[0].get_number_text() == "1.50");
+  CHECK(parsed[1][0].get_number_text() == "12");
+  CHECK(parsed[2]["a"].get_number_text() == "1e2");
+
+  JSONPrinter printer(PrintOptions{0, false, true});
+  CHECK(printer.print(value) == "[1.50,12,-3e1,18446744073709551616]");
+  CHECK(printer.print(value.deepCopy()) == printer.print(value));
+  // the tape converts them
+  TapeBuilder tape;
+  tape.on_value(value);
+  TapeView view = tape.tape().view();
+  CHECK(printer.print(TapeRef(view, 0).to_value()) ==
+        "[1.5,12,-30,18446744073709551616]");
+}
+
+TEST_CASE("Deeply nested documents", "[depth]") {
+  auto nested = [](std::size_t depth) {
+    return std::string(depth, '[') + "1" + std::string(depth, ']');
+  };
+  std::string deep = nested(200000);
+  JSONPrinter printer(PrintOptions{0, false, true});
+
+  SECTION("The depth limit") {
+    CHECK_NOTHROW(JSONParser().parse(JSONTokenizer().tokenize(
+        nested(kDefaultMaxDepth))));
+    CHECK_THROWS_AS(JSONParser().parse(JSONTokenizer().tokenize(
+                        nested(kDefaultMaxDepth + 1))),
+                    JSONParserError);
+    CHECK_THROWS_AS(JSONParser(3).parse(JSONTokenizer().tokenize(
+                        R"({"a": [{"b": [1]}]})")),
+                    JSONParserError);
+    CHECK_NOTHROW(JSONParser(3).parse(JSONTokenizer().tokenize(
+        R"({"a": [{"b": 1}], "c": [[]]})")));
+
+    JSONSAXParser parser;
+    JSONValueBuilder builder;
+    CHECK_THROWS_AS(parser.parse(deep, builder), JSONParserError);
+    parser.set_max_depth(2);
+    CHECK_NOTHROW(parser.parse("[[1], {}]", builder));
+    CHECK_THROWS_AS(parser.parse("[[{}]]", builder), JSONParserError);
+  }
+
+  SECTION("No recursion past the limit") {
+    auto tokens = JSONTokenizer().tokenize(deep);
+    JSONValue value = JSONParser(deep.size()).parse(tokens);
+    CHECK(printer.print(value) == deep);
+    CHECK(printer.print(value.deepCopy()) == deep);
+    // pretty output grows with the square of the depth
+    OutputBuffer out;
+    JSONPrinter(PrintOptions{}).print(
+        JSONParser().parse(JSONTokenizer().tokenize(nested(2000))), out);
+    CHECK(out.size() == 2 * (2000 * 2001 + 2000) + 1);
+
+    JSONSAXParser parser;
+    parser.set_max_depth(deep.size());
+    TapeBuilder builder;
+    parser.parse(deep, builder);
+    Tape tape = builder.take();
+    out.clear();
+    TapeView view = tape.view();
+    printer.print(TapeRef(view, 0), out);
+    CHECK(out.take() == deep);
+  }
+}
+
+TEST_CASE("UTF-8 validation", "[utf8]") {
+  SECTION("Valid and invalid sequences") {
+    CHECK(is_utf8(""));
+    CHECK(is_utf8("plain ascii"));
+    CHECK(is_utf8("\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 \xf4\x8f\xbf\xbf"));
+    CHECK_FALSE(is_utf8("\x80"));
+    CHECK_FALSE(is_utf8("\xc3"));
+    CHECK_FALSE(is_utf8("\xc0\xaf"));
+    CHECK_FALSE(is_utf8("\xe0\x80\xaf"));
+    CHECK_FALSE(is_utf8("\xed\xa0\x80"));
+    CHECK_FALSE(is_utf8("\xf4\x90\x80\x80"));
+    CHECK_FALSE(is_utf8("\xf8\x88\x80\x80\x80"));
+    CHECK_FALSE(is_utf8("\xe2\x82 "));
+  }
+
+  SECTION("Sequences across block boundaries") {
+    const std::string euro = "\xe2\x82\xac";
+    for (std::size_t prefix = 0; prefix < 40; ++prefix) {
+      std::string text(prefix, 'a');
+      CHECK(is_utf8(text + euro + std::string(20, 'b')));
+      CHECK(is_utf8(text + euro));
+      CHECK_FALSE(is_utf8(text + euro.substr(0, 2)));
+      CHECK_FALSE(is_utf8(text + euro.substr(0, 2) + std::string(20, 'b')));
+      CHECK_FALSE(is_utf8(text + "\xff" + std::string(20, 'b')));
+    }
+  }
+
+  SECTION("Strings are read as valid UTF-8") {
+    JSONSAXParser parser;
+    CountingHandler handler;
+    std::string long_text(30, 'x');
+    parser.parse("[\"" + long_text + "\xc3\xa9\", \"" + long_text +
+                     "\xc3\", \"\xff\\n\"]",
+                 handler);
+    REQUIRE(handler.strings.size() == 3);
+    CHECK(handler.strings[0] == long_text + "\xc3\xa9");
+    CHECK(handler.strings[1] == long_text + "\xef\xbf\xbd");
+    CHECK(handler.strings[2] == "\xef\xbf\xbd\n");
+  }
+
+  SECTION("Code points are counted, not bytes") {
+    CHECK(count_code_points("") == 0);
+    CHECK(count_code_points("abc") == 3);
+    CHECK(count_code_points("\xc3\xa9") == 1);
+    CHECK(count_code_points(std::string(40, 'a') +
+                            "b\xe2\x82\xac\xf0\x9f\x98\x80") == 43);
+  }
+}
+
+TEST_CASE("Validation without parsing", "[validate]") {
+  SECTION("Valid texts") {
+    for (std::string text :
+         {"", " {\"a\": [1, -2.5e+3, true, false, null, {}, []]} ",
+          R"("a\"\\\/\b\f\n\r\t\u00e9\ud83d\ude00")", "0", "-0.0E1",
+          "[1][2] 3 \"x\"", "\"caf\xc3\xa9\""}) {
+      auto result = validate_json(text);
+      CHECK(result.valid);
+      CHECK(result.offset == text.size());
+      CHECK(result.message == nullptr);
+    }
+    CHECK(validate_json("[1][2] 3 \"x\"").documents == 4);
+    CHECK(validate_json("  ").documents == 0);
+    CHECK(validate_json("0 1\n").documents == 2);
+    CHECK(validate_json("\"a\"1 {}").documents == 3);
+  }
+
+  SECTION("The first error is reported with its offset") {
+    std::vector<std::pair<std::string, std::size_t>> cases = {
+        {"[1, 2", 5},
+        {"[1 2]", 3},
+        {"{\"a\": 1]", 7},
+        {"{1: 2}", 1},
+        {"{\"a\" 1}", 5},
+        {"[1,]", 3},
+        {"[tru]", 1},
+        {"[01]", 2},
+        {"[1.]", 3},
+        {"-", 1},
+        {"\"abc", 4},
+        {"\"a\\x\"", 2},
+        {"\"\\u12\"", 1},
+        {"\"a\tb\"", 2},
+        {"[\"ok\", \"\xc3\xa9\xc3(\"]", 10},
+        {"\"\xed\xa0\x80\"", 1},
+        {"[1] \xff", 4},
+        {"01", 1},
+        {"1true", 1},
+        {"-1.5e3[1]", 6},
+        {"null0", 4},
+        {"[1] 2\"a\"", 5},
+    };
+    for (const auto &[text, offset] : cases) {
+      auto result = validate_json(text);
+      CHECK_FALSE(result.valid);
+      CHECK(result.offset == offset);
+      CHECK(result.message != nullptr);
+    }
+    CHECK(std::string(validate_json("\"\xc3(\"").message) ==
+          "Invalid UTF-8");
+  }
+
+  SECTION("The parsers reject raw control characters too") {
+    std::string long_text(40, 'x');
+    for (const std::string &text : std::vector<std::string>{
+             "\"a\tb\"", "[\"" + long_text + "\n\"]",
+             "{\"" + long_text + "\x01\": 1}", "\"\\n\x1f\""}) {
+      CAPTURE(text);
+      CHECK_FALSE(validate_json(text).valid);
+      CountingHandler handler;
+      CHECK_THROWS_AS(JSONSAXParser().parse(text, handler),
+                      JSONTokenizerError);
+      CHECK_THROWS_AS(JSONTokenizer().tokenize(text), JSONTokenizerError);
+    }
+  }
+
+  SECTION("Depth limit") {
+    std::string deep = std::string(20000, '[') + std::string(20000, ']');
+    auto result = validate_json(deep);
+    CHECK_FALSE(result.valid);
+    CHECK(result.offset == kDefaultMaxDepth);
+    CHECK(validate_json(deep, 20000).valid);
+    CHECK(validate_json("[{\"a\": [{}]}]", 4).valid);
+    CHECK_FALSE(validate_json("[{\"a\": [{}]}]", 3).valid);
+  }
+}
+
+TEST_CASE("Kernels agree at every SIMD level", "[simd]") {
+  // random texts of pieces which are often valid UTF-8, sometimes with a
+  // byte changed
+  std::mt19937 random(42);
+  const std::vector<std::string> pieces = {
+      "a", "\"", "\\", "\n", "\x7f", "\xc3\xa9", "\xe2\x82\xac",
+      "\xf0\x9f\x98\x80", "\xed\x9f\xbf", "\xf4\x8f\xbf\xbf", "0123456789"};
+  std::vector<std::string> texts;
+  for (int n = 0; n < 3000; ++n) {
+    std::string text;
+    std::size_t count = random() % 40;
+    for (std::size_t k = 0; k < count; ++k) {
+      text += pieces[random() % pieces.size()];
+    }
+    if (!text.empty() && random() % 2 == 0) {
+      text[random() % text.size()] = static_cast<char>(random() % 256);
+    }
+    texts.push_back(text);
+  }
+
+  struct Results {
+    std::size_t escape, end, non_ascii;
+    bool ascii, utf8;
+    bool operator==(const Results &other) const {
+      return escape == other.escape && end == other.end &&
+             non_ascii == other.non_ascii && ascii == other.ascii &&
+             utf8 == other.utf8;
+    }
+  };
+  auto results = [&texts]() {
+    std::vector<Results> all;
+    for (const auto &text : texts) {
+      Results r{};
+      r.escape = find_escape_char(text);
+      r.ascii = true;
+      r.end = find_string_end(text, r.ascii);
+      r.non_ascii = find_non_ascii(text);
+      r.utf8 = is_utf8(text);
+      all.push_back(r);
+    }
+    return all;
+  };
+
+  SimdLevel detected = detected_simd_level();
+  set_simd_level(SimdLevel::Scalar);
+  CHECK(simd_level() == SimdLevel::Scalar);
+  auto expected = results();
+  for (int level = 1; level <= static_cast<int>(detected); ++level) {
+    set_simd_level(static_cast<SimdLevel>(level));
+    INFO(simd_level_name(simd_level()));
+    CHECK(results() == expected);
+  }
+  set_simd_level(detected);
+
+  SimdLevel level;
+  CHECK(parse_simd_level("avx2", level));
+  CHECK(level == SimdLevel::Avx2);
+  CHECK_FALSE(parse_simd_level("avx3", level));
+  if (detected != SimdLevel::Avx512) {
+    CHECK_THROWS_AS(set_simd_level(SimdLevel::Avx512), std::invalid_argument);
+  }
+}
@@ -37,7 +37,19 @@ TEST_CASE("JSONTokenizer handles strings", "[tokenizer]") {
     auto tokens = tokenizer.tokenize(R"("\u00A9")");
     CHECK(tokens.size() == 1);
     CHECK(tokens[0].type == TokenType::String);
-    CHECK(tokens[0].value == "\\u00A9");
+    CHECK(tokens[0].value == "\xC2\xA9");
+  }
+
+  SECTION("Surrogate pairs and lone surrogates") {
+    auto tokens = tokenizer.tokenize(R"(["\ud83d\ude00", "\ud83d!"])");
+    CHECK(tokens[1].value == "\xF0\x9F\x98\x80");
+    CHECK(tokens[3].value == "\xEF\xBF\xBD!");
+  }
+
+  SECTION("Invalid UTF-8 is replaced") {
+    auto tokens = tokenizer.tokenize("\"caf\xC3\xA9 \xC3(\xF0\x9F\x98\"");
+    CHECK(tokens[0].value == "caf\xC3\xA9 \xEF\xBF\xBD(\xEF\xBF\xBD"
+                             "\xEF\xBF\xBD\xEF\xBF\xBD");
   }
 }
 
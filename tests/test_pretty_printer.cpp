@@ -1,6 +1,8 @@
 #include "jqcpp/json_parser.hpp"
 #include "jqcpp/pretty_printer.hpp"
 #include <catch2/catch_all.hpp>
+#include <cmath>
+#include <sstream>
 
 using namespace jqcpp::json;
 
@@ -192,3 +194,147 @@ TEST_CASE("JSONPrinter formats objects correctly simple", "[printer]") {
           reparsed_age_it->second.get_number());
   }
 }
+
+TEST_CASE("JSONPrinter writes into an output buffer", "[printer]") {
+  JSONParser parser;
+  JSONPrinter printer;
+  std::string input = R"({"a":[1,{"b":[true,null]}],"c":"x"})";
+  auto json = parser.parse(JSONTokenizer().tokenize(input));
+  std::string expected = printer.print(json);
+
+  SECTION("Small chunks are flushed to the stream in order") {
+    std::ostringstream oss;
+    {
+      OutputBuffer out(oss, 4);
+      printer.print(json, out);
+      out.append('\n');
+    }
+    CHECK(oss.str() == expected + "\n");
+  }
+
+  SECTION("Several values share one buffer") {
+    OutputBuffer out;
+    printer.print(json, out);
+    printer.print(json, out);
+    CHECK(out.str() == expected + expected);
+  }
+
+  SECTION("Deep nesting reuses the cached indentation") {
+    std::string deep = std::string(40, '[') + "1" + std::string(40, ']');
+    auto nested = parser.parse(JSONTokenizer().tokenize(deep));
+    auto output = printer.print(nested);
+    CHECK(output.find(std::string(80, ' ') + "1") != std::string::npos);
+  }
+}
+
+TEST_CASE("JSONPrinter output options", "[printer]") {
+  JSONParser parser;
+  std::string input = R"({"a":[1,{"b":null}],"c":{},"d":[]})";
+  auto json = parser.parse(JSONTokenizer().tokenize(input));
+
+  SECTION("Compact output") {
+    PrintOptions options;
+    options.compact = true;
+    JSONPrinter printer(options);
+    CHECK(printer.print(json) == R"({"a":[1,{"b":null}],"c":{},"d":[]})");
+  }
+
+  SECTION("Indent 0 is compact") {
+    PrintOptions options;
+    options.indent_width = 0;
+    JSONPrinter printer(options);
+    CHECK(printer.is_compact());
+    CHECK(printer.print(json) == R"({"a":[1,{"b":null}],"c":{},"d":[]})");
+  }
+
+  SECTION("Custom indent width") {
+    PrintOptions options;
+    options.indent_width = 4;
+    JSONPrinter printer(options);
+    auto value = parser.parse(JSONTokenizer().tokenize(R"({"x":[1]})"));
+    CHECK(printer.print(value) == "{\n    \"x\": [\n        1\n    ]\n}");
+  }
+
+  SECTION("Tab indent") {
+    PrintOptions options;
+    options.use_tab = true;
+    JSONPrinter printer(options);
+    auto value = parser.parse(JSONTokenizer().tokenize(R"({"x":[1]})"));
+    CHECK(printer.print(value) == "{\n\t\"x\": [\n\t\t1\n\t]\n}");
+  }
+}
+
+TEST_CASE("JSONPrinter formats numbers for round trip", "[printer]") {
+  JSONPrinter printer;
+
+  SECTION("Integers keep all their digits") {
+    CHECK(printer.print(JSONValue(1234567890123.0)) == "1234567890123");
+    CHECK(printer.print(JSONValue(-9007199254740992.0)) ==
+          "-9007199254740992");
+    CHECK(printer.print(JSONValue(0.0)) == "0");
+    CHECK(printer.print(JSONValue(-0.0)) == "-0");
+  }
+
+  SECTION("Fractions use the shortest round trip text") {
+    CHECK(printer.print(JSONValue(0.1)) == "0.1");
+    CHECK(printer.print(JSONValue(1.0 / 3.0)) == "0.3333333333333333");
+    CHECK(printer.print(JSONValue(1712345678.125)) == "1712345678.125");
+  }
+
+  SECTION("Large and small magnitudes use an exponent") {
+    CHECK(printer.print(JSONValue(1e100)) == "1e+100");
+    CHECK(printer.print(JSONValue(1e-7)) == "1e-07");
+  }
+
+  SECTION("Non finite values") {
+    CHECK(printer.print(JSONValue(std::nan(""))) == "null");
+    CHECK(printer.print(JSONValue(HUGE_VAL)) == "1.7976931348623157e+308");
+  }
+
+  SECTION("Printed numbers parse back to the same value") {
+    JSONParser parser;
+    for (double v : {0.1, 2.5e-300, 123456.789, 6.02214076e23}) {
+      auto text = printer.print(JSONValue(v));
+      CHECK(parser.parse(JSONTokenizer().tokenize(text)).get_number() == v);
+    }
+  }
+}
+
+TEST_CASE("JSONPrinter escapes strings", "[printer]") {
+  JSONPrinter printer;
+
+  SECTION("Quotes, backslashes and control chars") {
+    CHECK(printer.print(JSONValue(std::string("say \"hi\""))) ==
+          R"("say \"hi\"")");
+    CHECK(printer.print(JSONValue(std::string("C:\\tmp"))) == R"("C:\\tmp")");
+    CHECK(printer.print(JSONValue(std::string("a\nb\tc\r\b\f"))) ==
+          R"("a\nb\tc\r\b\f")");
+    CHECK(printer.print(JSONValue(std::string("\x01\x1f\x7f", 3))) ==
+          R"("\u0001\u001f\u007f")");
+  }
+
+  SECTION("Non ASCII bytes are copied unchanged") {
+    CHECK(printer.print(JSONValue(std::string("caf\xc3\xa9"))) ==
+          "\"caf\xc3\xa9\"");
+  }
+
+  SECTION("Escapes at every position of long strings") {
+    for (std::size_t pos = 0; pos < 70; ++pos) {
+      std::string s(70, 'x');
+      s[pos] = '"';
+      std::string expected = "\"" + std::string(pos, 'x') + "\\\"" +
+                             std::string(69 - pos, 'x') + "\"";
+      CHECK(printer.print(JSONValue(s)) == expected);
+    }
+  }
+
+  SECTION("Object keys are escaped in every layout") {
+    JSONObject obj;
+    jsonObjectInsert(obj, "a\"b", JSONValue(std::string("\n")));
+    JSONValue value(std::move(obj));
+    CHECK(printer.print(value) == "{\n  \"a\\\"b\": \"\\n\"\n}");
+    PrintOptions options;
+    options.compact = true;
+    CHECK(JSONPrinter(options).print(value) == R"({"a\"b":"\n"})");
+  }
+}